@@ -1,10 +1,25 @@
 #include "AABBTree.h"
+#include "JobSystem.h"
+#include <algorithm>
 #include <queue>
 #include <utility>
 #include <iostream>
 #include <functional>
 #include <stack>
 
+constexpr int SAH_BIN_COUNT = 16; // Number of bins the centres of a range are sorted into along each axis by Build.
+constexpr size_t PARALLEL_BUILD_SIZE = 4096; // Number of leaves from which Build builds the halves of a range as parallel jobs.
+
+/**
+ * @struct AABBTree::BuildItem
+ * @brief A proxy being sorted into the subtrees of Build.
+ */
+struct AABBTree::BuildItem
+{
+	Vector3 centre; // Centre of the proxy's box, which decides the bin it falls in.
+	uint32_t proxyIndex = 0;
+};
+
 struct QueueNode {
 	int index;
 	float cost;
@@ -15,44 +30,43 @@ struct QueueNode {
 
 AABBTree::AABBTree()
 {
-	unsigned int maxNodes = 2 * MAX_ENTITIES - 1;
-	for (unsigned int i = 0; i < maxNodes; i++)
-	{
-		m_availableNodes.push(i);
-	}
-
-	m_entityToNodeIndex.resize(MAX_ENTITIES, NULL_NODE_INDEX);
-	m_nodeToDenseIndex.resize(maxNodes, NULL_NODE_INDEX);
+	// the node pool grows as entities are inserted
 }
 
 Node& AABBTree::GetNode(int nodeIndex)
 {
-	return m_nodes[m_nodeToDenseIndex[nodeIndex]];
+	return m_nodes[nodeIndex];
 }
 
 Node& AABBTree::GetNodeFromEntity(Entity entity)
 {
-	return m_nodes[m_nodeToDenseIndex[m_entityToNodeIndex[entity]]];
+	return m_nodes[m_entityToNodeIndex.Get(entity)];
 }
 
 void AABBTree::InsertEntity(Entity entity, AABB box, bool isStatic)
 {
 	int leafIndex = AllocateLeafNode(entity, box);
 	GetNode(leafIndex).isStatic = isStatic;
-	m_entityToNodeIndex[entity] = leafIndex;
+	m_entityToNodeIndex.Set(entity, leafIndex);
+
+	InsertNode(leafIndex);
+}
 
+void AABBTree::InsertNode(int nodeIndex)
+{
 	if (m_rootIndex == NULL_NODE_INDEX)
 	{
-		m_rootIndex = leafIndex;
+		m_rootIndex = nodeIndex;
 		return;
 	}
 
-	// stage 1: find the best sibling for the new leaf
+	// stage 1: find the best sibling for the new node
+	AABB box = GetNode(nodeIndex).box;
 	int bestSibling = PickBest(box);
 
 	// stage 2: create a new parent
 	int oldParent = GetNode(bestSibling).parentIndex;
-	int newParent = AllocateInternalNode();
+	int newParent = AllocateNode();
 	GetNode(newParent).parentIndex = oldParent;
 	GetNode(newParent).box = AABB::Union(box, GetNode(bestSibling).box);
 
@@ -74,23 +88,208 @@ void AABBTree::InsertEntity(Entity entity, AABB box, bool isStatic)
 	}
 
 	GetNode(newParent).child1 = bestSibling;
-	GetNode(newParent).child2 = leafIndex;
+	GetNode(newParent).child2 = nodeIndex;
 	GetNode(bestSibling).parentIndex = newParent;
-	GetNode(leafIndex).parentIndex = newParent;
+	GetNode(nodeIndex).parentIndex = newParent;
 
 	// stage 3: walk back up the tree refitting AABBs
 	RefitFromNode(newParent);
 }
 
+void AABBTree::Build(std::span<const TreeProxy> proxies)
+{
+	if (proxies.empty()) { return; }
+
+	// allocate every node up front, so subtrees can be built in parallel without touching the pool. Leaves and
+	// internal nodes alternate in the order the build leaves the proxies in, so on a fresh pool the nodes of
+	// every subtree are contiguous
+	std::vector<int> nodeIndices(proxies.size() * 2 - 1);
+	for (int& nodeIndex : nodeIndices)
+	{
+		nodeIndex = AllocateNode();
+	}
+
+	std::vector<BuildItem> items(proxies.size());
+	for (size_t i = 0; i < proxies.size(); i++)
+	{
+		items[i].centre = proxies[i].box.GetPosition();
+		items[i].proxyIndex = (uint32_t)i;
+	}
+
+	int subtreeIndex = BuildRange(items, proxies, nodeIndices, 0, items.size());
+
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		m_entityToNodeIndex.Set(proxies[items[i].proxyIndex].entity, nodeIndices[i * 2]);
+	}
+
+	InsertNode(subtreeIndex);
+}
+
+void AABBTree::Rebuild()
+{
+	std::vector<TreeProxy> proxies;
+	proxies.reserve(m_nodeCount / 2 + 1);
+	for (const Node& node : m_nodes)
+	{
+		if (node.isLeaf)
+		{
+			proxies.push_back({ node.entity, node.box, node.isStatic });
+		}
+	}
+
+	// start from an empty pool, so the rebuilt nodes are laid out in build order
+	m_nodes.clear();
+	m_enlargedBoxes.clear();
+	m_costCache.clear();
+	m_nodeCount = 0;
+	m_rootIndex = NULL_NODE_INDEX;
+	m_freeListIndex = NULL_NODE_INDEX;
+	m_entityToNodeIndex.Clear();
+
+	Build(proxies);
+}
+
+int AABBTree::BuildRange(std::vector<BuildItem>& items, std::span<const TreeProxy> proxies, const std::vector<int>& nodeIndices, size_t begin, size_t end)
+{
+	if (end - begin == 1)
+	{
+		const TreeProxy& proxy = proxies[items[begin].proxyIndex];
+		int leafIndex = nodeIndices[begin * 2];
+
+		Node& leaf = GetNode(leafIndex);
+		leaf.box = proxy.box;
+		leaf.entity = proxy.entity;
+		leaf.isLeaf = true;
+		leaf.isStatic = proxy.isStatic;
+		m_enlargedBoxes[leafIndex] = proxy.box.GetEnlarged(BOX_ENLARGEMENT_FACTOR);
+		return leafIndex;
+	}
+
+	Vector3 centreMin = items[begin].centre;
+	Vector3 centreMax = items[begin].centre;
+	for (size_t i = begin + 1; i < end; i++)
+	{
+		centreMin = Vector3::Min(centreMin, items[i].centre);
+		centreMax = Vector3::Max(centreMax, items[i].centre);
+	}
+
+	// bin the centres along each axis, and pick the split between bins with the lowest surface area cost
+	int bestAxis = -1;
+	int bestSplit = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centreMax[axis] - centreMin[axis];
+		if (extent <= 0.0f) { continue; }
+
+		float binScale = SAH_BIN_COUNT / extent;
+		int counts[SAH_BIN_COUNT] = {};
+		AABB boxes[SAH_BIN_COUNT];
+		for (size_t i = begin; i < end; i++)
+		{
+			int bin = std::min((int)((items[i].centre[axis] - centreMin[axis]) * binScale), SAH_BIN_COUNT - 1);
+			const AABB& box = proxies[items[i].proxyIndex].box;
+			boxes[bin] = counts[bin] == 0 ? box : AABB::Union(boxes[bin], box);
+			counts[bin]++;
+		}
+
+		// sweep from the right to find the area of every right side, then from the left to cost each split
+		float rightAreas[SAH_BIN_COUNT] = {};
+		int rightCount = 0;
+		AABB rightBox;
+		for (int bin = SAH_BIN_COUNT - 1; bin > 0; bin--)
+		{
+			if (counts[bin] > 0)
+			{
+				rightBox = rightCount == 0 ? boxes[bin] : AABB::Union(rightBox, boxes[bin]);
+				rightCount += counts[bin];
+			}
+			rightAreas[bin] = rightCount > 0 ? rightBox.GetArea() : 0.0f;
+		}
+
+		int leftCount = 0;
+		AABB leftBox;
+		for (int bin = 0; bin < SAH_BIN_COUNT - 1; bin++)
+		{
+			if (counts[bin] > 0)
+			{
+				leftBox = leftCount == 0 ? boxes[bin] : AABB::Union(leftBox, boxes[bin]);
+				leftCount += counts[bin];
+			}
+
+			int splitRightCount = (int)(end - begin) - leftCount;
+			if (leftCount == 0 || splitRightCount == 0) { continue; }
+
+			float cost = leftBox.GetArea() * leftCount + rightAreas[bin + 1] * splitRightCount;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = bin;
+			}
+		}
+	}
+
+	size_t middle = begin + (end - begin) / 2;
+	if (bestAxis >= 0)
+	{
+		float binScale = SAH_BIN_COUNT / (centreMax[bestAxis] - centreMin[bestAxis]);
+		auto split = std::partition(items.begin() + begin, items.begin() + end, [&](const BuildItem& item) {
+			return std::min((int)((item.centre[bestAxis] - centreMin[bestAxis]) * binScale), SAH_BIN_COUNT - 1) <= bestSplit;
+			});
+		middle = split - items.begin();
+	}
+
+	// every centre is in the same place, so any split is as good as another
+	if (middle == begin || middle == end)
+	{
+		middle = begin + (end - begin) / 2;
+	}
+
+	// the range's internal node sits between its two halves, using the internal slots [begin, end - 1)
+	int children[2];
+	auto buildHalf = [&](size_t half) {
+		children[half] = half == 0 ? BuildRange(items, proxies, nodeIndices, begin, middle) : BuildRange(items, proxies, nodeIndices, middle, end);
+	};
+
+	if (end - begin >= PARALLEL_BUILD_SIZE)
+	{
+		ParallelOptions options;
+		options.grainSize = 1;
+		JobSystem::GetInstance().ParallelFor(2, options, [&](size_t first, size_t last) {
+			for (size_t half = first; half < last; half++)
+			{
+				buildHalf(half);
+			}
+			});
+	}
+	else
+	{
+		buildHalf(0);
+		buildHalf(1);
+	}
+
+	int nodeIndex = nodeIndices[middle * 2 - 1];
+	Node& node = GetNode(nodeIndex);
+	node.child1 = children[0];
+	node.child2 = children[1];
+	GetNode(children[0]).parentIndex = nodeIndex;
+	GetNode(children[1]).parentIndex = nodeIndex;
+	RefitInternalNode(nodeIndex);
+
+	return nodeIndex;
+}
+
 void AABBTree::RemoveLeaf(int leafIndex)
 {
-	if (m_nodeToDenseIndex[leafIndex] == NULL_NODE_INDEX)
+	if (GetNode(leafIndex).isFree)
 	{
 		return;
 	}
 
 	Entity entity = GetNode(leafIndex).entity;
-	m_entityToNodeIndex[entity] = NULL_NODE_INDEX;
+	m_entityToNodeIndex.Erase(entity);
 
 	if (leafIndex == m_rootIndex)
 	{
@@ -131,12 +330,17 @@ void AABBTree::RemoveLeaf(int leafIndex)
 
 void AABBTree::RemoveEntity(Entity entity)
 {
-	RemoveLeaf(m_entityToNodeIndex[entity]);
+	int leafIndex = m_entityToNodeIndex.Get(entity);
+
+	// check the entity is in the tree, and not a stale handle sharing the index of a newer entity
+	if (leafIndex == NULL_NODE_INDEX || GetNode(leafIndex).entity != entity) { return; }
+
+	RemoveLeaf(leafIndex);
 }
 
 void AABBTree::UpdatePosition(Entity entity, const Vector3& newPosition)
 {
-	int leafIndex = m_entityToNodeIndex[entity];
+	int leafIndex = m_entityToNodeIndex.Get(entity);
 
 	// check if the entity actually exists in the tree
 	if (leafIndex == NULL_NODE_INDEX) { return; }
@@ -146,7 +350,7 @@ void AABBTree::UpdatePosition(Entity entity, const Vector3& newPosition)
 
 void AABBTree::UpdateScale(Entity entity, const Vector3& newScale)
 {
-	int leafIndex = m_entityToNodeIndex[entity];
+	int leafIndex = m_entityToNodeIndex.Get(entity);
 
 	// check if the entity actually exists in the tree
 	if (leafIndex == NULL_NODE_INDEX) { return; }
@@ -156,7 +360,7 @@ void AABBTree::UpdateScale(Entity entity, const Vector3& newScale)
 
 void AABBTree::TriggerUpdate(Entity entity)
 {
-	int leafIndex = m_entityToNodeIndex[entity];
+	int leafIndex = m_entityToNodeIndex.Get(entity);
 
 	// check if the entity actually exists in the tree
 	if (leafIndex == NULL_NODE_INDEX) { return; }
@@ -176,27 +380,98 @@ void AABBTree::TriggerUpdate(Entity entity)
 	InsertEntity(entity, previousBox, false);
 }
 
-Entity AABBTree::Intersect(const Ray& ray, float& closestDistance)
+void AABBTree::UpdateLeaves(std::span<const LeafUpdate> updates)
+{
+	m_movedLeaves.clear();
+	m_escapedLeaves.clear();
+
+	for (const LeafUpdate& update : updates)
+	{
+		int leafIndex = m_entityToNodeIndex.Get(update.entity);
+
+		// check the entity is in the tree, and not a stale handle sharing the index of a newer entity
+		if (leafIndex == NULL_NODE_INDEX || GetNode(leafIndex).entity != update.entity) { continue; }
+
+		Node& leaf = GetNode(leafIndex);
+		if (update.keepSize)
+		{
+			leaf.box.UpdatePosition(update.box.GetPosition());
+		}
+		else
+		{
+			leaf.box = update.box;
+		}
+
+		if (leaf.isStatic) { continue; }
+
+		if (NeedsUpdate(leafIndex))
+		{
+			m_escapedLeaves.emplace_back(update.entity, leaf.box);
+		}
+		else
+		{
+			m_movedLeaves.push_back(leafIndex);
+		}
+	}
+
+	// remove every escaped leaf before reinserting any, so none is picked as the sibling of another
+	for (const std::pair<Entity, AABB>& escaped : m_escapedLeaves)
+	{
+		RemoveLeaf(m_entityToNodeIndex.Get(escaped.first));
+	}
+
+	for (const std::pair<Entity, AABB>& escaped : m_escapedLeaves)
+	{
+		InsertEntity(escaped.first, escaped.second, false);
+	}
+
+	// mark the ancestors of the remaining leaves once the tree's structure is final, stopping at nodes already
+	// marked as their ancestors are marked too
+	for (int leafIndex : m_movedLeaves)
+	{
+		int index = GetNode(leafIndex).parentIndex;
+		while (index != NULL_NODE_INDEX && !GetNode(index).isDirty)
+		{
+			GetNode(index).isDirty = true;
+			index = GetNode(index).parentIndex;
+		}
+	}
+
+	RefitDirtyNodes();
+}
+
+Entity AABBTree::Intersect(const Ray& ray, float& closestDistance) const
 {
 	Entity closestEntity = INVALID_ENTITY;
 	closestDistance = FLT_MAX;
 
-	for (const Node& node : m_nodes)
+	if (m_rootIndex == NULL_NODE_INDEX) { return closestEntity; }
+
+	// descend only into nodes the ray passes through before the closest hit found so far, so the work depends on
+	// the tree's quality
+	NodeStack stack;
+	stack.Push(m_rootIndex);
+
+	while (!stack.IsEmpty())
 	{
+		const Node& node = m_nodes[stack.Pop()];
+
+		float distance;
 		if (node.isLeaf)
 		{
-			float distance;
-			if (ray.Intersect(node.box, distance))
+			if (ray.Intersect(node.box, distance) && distance < closestDistance)
 			{
-				if (distance < closestDistance)
-				{
-					closestDistance = distance;
-					closestEntity = node.entity;
-				}
+				closestDistance = distance;
+				closestEntity = node.entity;
 			}
 		}
+		else if (ray.IntersectEntry(node.box, distance) && distance < closestDistance)
+		{
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
 	}
-	
+
 	return closestEntity;
 }
 
@@ -224,9 +499,10 @@ void AABBTree::PotentialIntersectionHelper(std::vector<std::pair<Entity, Entity>
 	if (a.isStatic && b.isStatic) return;
 
 	if (a.isLeaf && b.isLeaf && a.entity != b.entity) {
-		uint64_t a64 = (uint64_t)a.entity;
-		uint64_t b64 = (uint64_t)b.entity;
-		uint64_t hash = a.entity > b.entity ? ((a64 << 32) | b64) : ((b64 << 32) | a64);
+		// a tree holds one leaf per entity index, so the two indices identify the pair
+		uint64_t a64 = GetEntityIndex(a.entity);
+		uint64_t b64 = GetEntityIndex(b.entity);
+		uint64_t hash = a64 > b64 ? ((a64 << 32) | b64) : ((b64 << 32) | a64);
 
 		if (found.find(hash) == found.end())
 		{
@@ -252,35 +528,76 @@ void AABBTree::PotentialIntersectionHelper(std::vector<std::pair<Entity, Entity>
 	}
 }
 
+TreeQuality AABBTree::GetQuality() const
+{
+	TreeQuality quality;
+	if (m_rootIndex == NULL_NODE_INDEX) { return quality; }
+
+	int64_t totalLeafDepth = 0;
+	std::vector<std::pair<int, int>> stack; // Node index and depth of the nodes left to visit.
+	stack.emplace_back(m_rootIndex, 0);
+
+	while (!stack.empty())
+	{
+		auto [index, depth] = stack.back();
+		stack.pop_back();
+
+		const Node& node = m_nodes[index];
+		if (node.isLeaf)
+		{
+			quality.leafCount++;
+			quality.height = std::max(quality.height, depth);
+			totalLeafDepth += depth;
+			continue;
+		}
+
+		quality.totalArea += node.box.GetArea();
+		stack.emplace_back(node.child1, depth + 1);
+		stack.emplace_back(node.child2, depth + 1);
+	}
+
+	float rootArea = m_nodes[m_rootIndex].box.GetArea();
+	quality.sahCost = rootArea > 0.0f ? quality.totalArea / rootArea : 0.0f;
+	quality.averageLeafDepth = (float)totalLeafDepth / quality.leafCount;
+	return quality;
+}
+
 int AABBTree::AllocateLeafNode(Entity entity, const AABB& box)
 {
-	Node leafNode;
+	int nodeIndex = AllocateNode();
+
+	Node& leafNode = GetNode(nodeIndex);
 	leafNode.box = box;
-	leafNode.enlargedBox = box.GetEnlarged(BOX_ENLARGEMENT_FACTOR);
 	leafNode.entity = entity;
 	leafNode.isLeaf = true;
-	m_nodes.push_back(leafNode);
-
-	int nodeIndex = m_availableNodes.front();
-	m_availableNodes.pop();
-
-	m_nodeToDenseIndex[nodeIndex] = m_nodeCount;
-	m_denseToNodeIndex.push_back(nodeIndex);
-	m_nodeCount++;
+	m_enlargedBoxes[nodeIndex] = box.GetEnlarged(BOX_ENLARGEMENT_FACTOR);
 
 	return nodeIndex;
 }
 
-int AABBTree::AllocateInternalNode()
+int AABBTree::AllocateNode()
 {
-	Node internalNode;
-	m_nodes.push_back(internalNode);
-
-	int nodeIndex = m_availableNodes.front();
-	m_availableNodes.pop();
+	if (m_freeListIndex == NULL_NODE_INDEX)
+	{
+		// grow the pool, linking the new nodes into the free list in index order
+		size_t oldCapacity = m_nodes.size();
+		size_t newCapacity = std::max(oldCapacity * 2, INITIAL_NODE_CAPACITY);
+		m_nodes.resize(newCapacity);
+		m_enlargedBoxes.resize(newCapacity);
+		m_costCache.resize(newCapacity);
+
+		for (size_t i = oldCapacity; i < newCapacity; i++)
+		{
+			m_nodes[i].parentIndex = i + 1 < newCapacity ? (int)i + 1 : NULL_NODE_INDEX;
+			m_nodes[i].isFree = true;
+		}
+		m_freeListIndex = (int)oldCapacity;
+	}
 
-	m_nodeToDenseIndex[nodeIndex] = m_nodeCount;
-	m_denseToNodeIndex.push_back(nodeIndex);
+	// the most recently freed node is reused first, as it is the most likely to still be cached
+	int nodeIndex = m_freeListIndex;
+	m_freeListIndex = m_nodes[nodeIndex].parentIndex;
+	m_nodes[nodeIndex] = Node();
 	m_nodeCount++;
 
 	return nodeIndex;
@@ -288,25 +605,12 @@ int AABBTree::AllocateInternalNode()
 
 void AABBTree::DeallocateNode(int index)
 {
-	size_t removedDenseIndex = m_nodeToDenseIndex[index];
-	size_t lastDenseIndex = m_nodes.size() - 1;
-
-	if (removedDenseIndex != lastDenseIndex)
-	{
-		// Replace removed element with the last one
-		m_nodes[removedDenseIndex] = m_nodes[lastDenseIndex];
-		size_t lastNodeIndex = m_denseToNodeIndex[lastDenseIndex];
-
-		// Update mappings
-		m_nodeToDenseIndex[lastNodeIndex] = removedDenseIndex;
-		m_denseToNodeIndex[removedDenseIndex] = lastNodeIndex;
-	}
+	Node& node = m_nodes[index];
+	node = Node();
+	node.parentIndex = m_freeListIndex;
+	node.isFree = true;
 
-	// Erase the last element
-	m_nodes.pop_back();
-	m_denseToNodeIndex.pop_back();
-	m_nodeToDenseIndex[index] = NULL_NODE_INDEX;
-	m_availableNodes.push(index);
+	m_freeListIndex = index;
 	m_nodeCount--;
 }
 
@@ -316,7 +620,8 @@ int AABBTree::PickBest(const AABB& leafBox)
 	int bestSibling = m_rootIndex;
 	float bestCost = AABB::Union(GetNode(m_rootIndex).box, leafBox).GetArea();
 
-	std::vector<float> costCache(m_nodeToDenseIndex.size());
+	// every node's cost is written before its children read it, so the cache is reused without clearing
+	std::vector<float>& costCache = m_costCache;
 	std::vector<QueueNode> queue;
 	queue.push_back({ m_rootIndex, bestCost });
 
@@ -371,22 +676,146 @@ void AABBTree::RefitFromNode(int index)
 {
 	while (index != NULL_NODE_INDEX)
 	{
-		Node& currentNode = GetNode(index);
-		Node& child1 = GetNode(currentNode.child1);
-		Node& child2 = GetNode(currentNode.child2);
+		RefitInternalNode(index);
+		RotateNodes(index);
+
+		index = GetNode(index).parentIndex;
+	}
+}
+
+void AABBTree::RefitDirtyNodes()
+{
+	if (m_rootIndex == NULL_NODE_INDEX || !GetNode(m_rootIndex).isDirty) { return; }
+
+	// every dirty node's parent is dirty, so the dirty nodes form a subtree hanging from the root
+	m_refitOrder.clear();
+	m_refitOrder.push_back(m_rootIndex);
+	for (size_t i = 0; i < m_refitOrder.size(); i++)
+	{
+		const Node& node = GetNode(m_refitOrder[i]);
+		if (GetNode(node.child1).isDirty) { m_refitOrder.push_back(node.child1); }
+		if (GetNode(node.child2).isDirty) { m_refitOrder.push_back(node.child2); }
+	}
+
+	// refit in reverse, so both children of a node are refitted before it. Nodes are not rotated here, as the
+	// rotations made when escaped leaves are reinserted keep the tree about as good at a fraction of the cost
+	for (auto it = m_refitOrder.rbegin(); it != m_refitOrder.rend(); ++it)
+	{
+		RefitInternalNode(*it);
+		GetNode(*it).isDirty = false;
+	}
+}
+
+void AABBTree::RefitInternalNode(int index)
+{
+	Node& currentNode = GetNode(index);
+	const Node& child1 = GetNode(currentNode.child1);
+	const Node& child2 = GetNode(currentNode.child2);
+
+	currentNode.box = AABB::Union(child1.box, child2.box);
+	currentNode.isStatic = child1.isStatic && child2.isStatic;
+}
+
+void AABBTree::RotateNodes(int index)
+{
+	// node A has children B and C, B has children D and E, and C has children F and G. A rotation swaps a child
+	// of A with a grandchild through the other child, or swaps two grandchildren. A keeps the same leaves, so only
+	// the areas of B and C can change
+	enum class Rotation { NONE, B_F, B_G, C_D, C_E, D_F, D_G };
+
+	Node& a = GetNode(index);
+	int b = a.child1;
+	int c = a.child2;
+	Node& nodeB = GetNode(b);
+	Node& nodeC = GetNode(c);
+
+	if (nodeB.isLeaf && nodeC.isLeaf) { return; }
+
+	float areaB = nodeB.box.GetArea();
+	float areaC = nodeC.box.GetArea();
+
+	Rotation bestRotation = Rotation::NONE;
+	float bestCost = 0.0f; // Change in the total area, a rotation is only applied if it reduces the area.
+
+	if (!nodeC.isLeaf)
+	{
+		const AABB& boxF = GetNode(nodeC.child1).box;
+		const AABB& boxG = GetNode(nodeC.child2).box;
+
+		// swapping B with F leaves C holding B and G, and swapping B with G leaves C holding B and F
+		float costBF = AABB::Union(nodeB.box, boxG).GetArea() - areaC;
+		float costBG = AABB::Union(nodeB.box, boxF).GetArea() - areaC;
+		if (costBF < bestCost) { bestRotation = Rotation::B_F; bestCost = costBF; }
+		if (costBG < bestCost) { bestRotation = Rotation::B_G; bestCost = costBG; }
+	}
+
+	if (!nodeB.isLeaf)
+	{
+		const AABB& boxD = GetNode(nodeB.child1).box;
+		const AABB& boxE = GetNode(nodeB.child2).box;
 
-		currentNode.box = AABB::Union(child1.box, child2.box);
-		currentNode.isStatic = child1.isStatic && child2.isStatic;
+		float costCD = AABB::Union(nodeC.box, boxE).GetArea() - areaB;
+		float costCE = AABB::Union(nodeC.box, boxD).GetArea() - areaB;
+		if (costCD < bestCost) { bestRotation = Rotation::C_D; bestCost = costCD; }
+		if (costCE < bestCost) { bestRotation = Rotation::C_E; bestCost = costCE; }
 
-		index = currentNode.parentIndex;
+		if (!nodeC.isLeaf)
+		{
+			const AABB& boxF = GetNode(nodeC.child1).box;
+			const AABB& boxG = GetNode(nodeC.child2).box;
+
+			// swapping grandchildren changes the areas of both B and C
+			float costDF = AABB::Union(boxF, boxE).GetArea() + AABB::Union(boxD, boxG).GetArea() - areaB - areaC;
+			float costDG = AABB::Union(boxG, boxE).GetArea() + AABB::Union(boxF, boxD).GetArea() - areaB - areaC;
+			if (costDF < bestCost) { bestRotation = Rotation::D_F; bestCost = costDF; }
+			if (costDG < bestCost) { bestRotation = Rotation::D_G; bestCost = costDG; }
+		}
+	}
+
+	// swaps the node at child slot 'slot' of 'parent' with the node at child slot 'otherSlot' of 'otherParent'
+	auto swap = [&](int parent, int& slot, int otherParent, int& otherSlot) {
+		std::swap(slot, otherSlot);
+		GetNode(slot).parentIndex = parent;
+		GetNode(otherSlot).parentIndex = otherParent;
+	};
+
+	switch (bestRotation)
+	{
+	case Rotation::NONE:
+		return;
+	case Rotation::B_F:
+		swap(index, a.child1, c, nodeC.child1);
+		RefitInternalNode(c);
+		break;
+	case Rotation::B_G:
+		swap(index, a.child1, c, nodeC.child2);
+		RefitInternalNode(c);
+		break;
+	case Rotation::C_D:
+		swap(index, a.child2, b, nodeB.child1);
+		RefitInternalNode(b);
+		break;
+	case Rotation::C_E:
+		swap(index, a.child2, b, nodeB.child2);
+		RefitInternalNode(b);
+		break;
+	case Rotation::D_F:
+		swap(b, nodeB.child1, c, nodeC.child1);
+		RefitInternalNode(b);
+		RefitInternalNode(c);
+		break;
+	case Rotation::D_G:
+		swap(b, nodeB.child1, c, nodeC.child2);
+		RefitInternalNode(b);
+		RefitInternalNode(c);
+		break;
 	}
 }
 
 bool AABBTree::NeedsUpdate(int index)
 {
-	Node& node = GetNode(index);
-	AABB newBox = node.box;
-	AABB oldBox = node.enlargedBox;
+	AABB newBox = GetNode(index).box;
+	AABB oldBox = m_enlargedBoxes[index];
 
 	Vector3 lowerBoundNew = newBox.GetLowerBound();
 	Vector3 upperBoundNew = newBox.GetUpperBound();
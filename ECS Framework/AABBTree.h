@@ -7,37 +7,124 @@
 #ifndef AABBTREE_H_
 #define AABBTREE_H_
 
+#include <span>
 #include <vector>
-#include <queue>
 #include <unordered_set>
 
 #include "Definitions.h"
+#include "PagedSparseMap.h"
 #include "Vector3.h"
 #include "Colliders.h"
 #include "Ray.h"
 
 constexpr int NULL_NODE_INDEX = -1; // Constant representing a null index for a node.
 constexpr float BOX_ENLARGEMENT_FACTOR = 0.3f; // Constant factor by which enlarged box is scaled up from node box
+constexpr size_t INITIAL_NODE_CAPACITY = 256; // Number of nodes in the pool once the first node is allocated.
 
 /**
  * @struct Node
- * @brief Represents a node in the AABB tree.
+ * @brief Represents a node in the AABB tree. A node fills one cache line, so traversals read a single line per
+ * node. The enlarged boxes of leaves are kept apart from the nodes, as only leaf updates read them.
  */
-struct Node
+struct alignas(64) Node
 {
-	AABB enlargedBox; // Larger bounding box to delay node rebuilds. Leaf nodes only.
-	AABB box; // Actual bounding box for the node. Leaf ndoes only.
-	Entity entity; // ECS entity associated with this node. Leaf nodes only.
-	int parentIndex = NULL_NODE_INDEX; // Node index for parent node.
+	AABB box; // Bounding box of the leaf, or of both children for internal nodes.
+	Entity entity = INVALID_ENTITY; // ECS entity associated with this node. Leaf nodes only.
+	int parentIndex = NULL_NODE_INDEX; // Node index for parent node. Index of the next free node while free.
 	int child1 = NULL_NODE_INDEX; // Node index for left child node. Internal nodes only.
 	int child2 = NULL_NODE_INDEX; // Node index for right child node. Internal nodes only.
 	bool isLeaf = false; // Flag indicating whether this node is a leaf.
 	bool isStatic = false;
+	bool isFree = false; // Flag indicating whether this node is in the free list.
+	bool isDirty = false; // Flag indicating whether this internal node needs refitting. Set during UpdateLeaves only.
+};
+
+static_assert(sizeof(Node) == 64, "AABB tree nodes should fill exactly one cache line.");
+
+/**
+ * @struct LeafUpdate
+ * @brief The new bounding box of an entity's leaf, applied by AABBTree::UpdateLeaves.
+ */
+struct LeafUpdate
+{
+	Entity entity = INVALID_ENTITY;
+	AABB box; // New bounding box of the leaf.
+	bool keepSize = false; // Moves the leaf's box to the centre of the new box without resizing it, for colliders without an extent.
+};
+
+/**
+ * @struct TreeProxy
+ * @brief An entity and its bounding box, inserted in bulk by AABBTree::Build.
+ */
+struct TreeProxy
+{
+	Entity entity = INVALID_ENTITY;
+	AABB box;
+	bool isStatic = false;
+};
+
+/**
+ * @struct TreeQuality
+ * @brief Measures of how well an AABB tree's structure fits its leaves, for charting over a long run. Lower is
+ * better for every measure.
+ */
+struct TreeQuality
+{
+	float totalArea = 0.0f; // Sum of the surface areas of every internal node, the cost rotations minimise.
+	float sahCost = 0.0f; // Total area divided by the root's area, comparable between scenes of different sizes.
+	int height = 0; // Number of edges on the longest path from the root to a leaf.
+	float averageLeafDepth = 0.0f; // Mean number of edges from the root to a leaf.
+	int leafCount = 0;
+};
+
+/**
+ * @class NodeStack
+ * @brief The nodes left to visit by a read-only traversal. Typical tree depths fit in an inline array, so each
+ * traversal keeps its own stack without allocating, and only a deeper tree spills the rest to the heap.
+ */
+class NodeStack
+{
+public:
+	void Push(int nodeIndex)
+	{
+		if (m_count < INLINE_CAPACITY)
+		{
+			m_inline[m_count] = nodeIndex;
+		}
+		else
+		{
+			m_overflow.push_back(nodeIndex);
+		}
+		m_count++;
+	}
+
+	int Pop()
+	{
+		m_count--;
+		if (m_count < INLINE_CAPACITY) { return m_inline[m_count]; }
+
+		int nodeIndex = m_overflow.back();
+		m_overflow.pop_back();
+		return nodeIndex;
+	}
+
+	bool IsEmpty() const { return m_count == 0; }
+
+private:
+	static constexpr size_t INLINE_CAPACITY = 64; // A depth first traversal holds about one node per level.
+
+	int m_inline[INLINE_CAPACITY];
+	std::vector<int> m_overflow; // Nodes past the inline array, only allocated for very deep trees.
+	size_t m_count = 0;
 };
 
 /**
  * @class AABBTree
- * @brief A dynamic bounding volume hierachy that uses axis aligned bounding boxes.
+ * @brief A dynamic bounding volume hierachy that uses axis aligned bounding boxes. Nodes live in a pool that
+ * doubles when full, so a node keeps its index for as long as it is allocated, and freed nodes are linked into an
+ * intrusive free list. References to nodes are invalidated when a node is allocated. Inserting and removing
+ * leaves rotates the nodes refitted on the way back to the root wherever swapping a child with a grandchild
+ * reduces the surface area of the tree, so its quality holds up under churn.
  */
 class AABBTree
 {
@@ -62,10 +149,15 @@ public:
 	Node& GetNodeFromEntity(Entity entity);
 
 	/**
-	 * @brief Get all the nodes currently in the tree.
-	 * @return A vector of all tree nodes.
+	 * @brief Get the node pool, indexed by node index.
+	 * @return Every node of the pool. Free nodes are included, and are never leaves.
 	 */
-	std::vector<Node> GetNodes() const { return m_nodes; }
+	const std::vector<Node>& GetNodes() const { return m_nodes; }
+
+	/**
+	 * @brief Gets the number of allocated nodes.
+	 */
+	int GetNodeCount() const { return m_nodeCount; }
 
 	/**
 	 * @brief Create a new leaf node in the tree that represents an ECS entity.
@@ -76,43 +168,135 @@ public:
 
 	void RemoveEntity(Entity entity);
 
+	/**
+	 * @brief Inserts many entities at once. A subtree is built over them top down with the binned surface area
+	 * heuristic, with the halves of large ranges built in parallel on the job system, and then inserted as a
+	 * whole. On an empty tree this is a full build, which is faster than inserting the entities one by one and
+	 * gives a lower cost tree.
+	 * @param proxies The entity and box of every new leaf. The entities must not already be in the tree.
+	 */
+	void Build(std::span<const TreeProxy> proxies);
+
+	/**
+	 * @brief Rebuilds the whole tree with Build from the current boxes of its leaves, for when incremental
+	 * updates have left it worse than a fresh build.
+	 */
+	void Rebuild();
+
 	void UpdatePosition(Entity entity, const Vector3& newPosition);
 	void UpdateScale(Entity entity, const Vector3& newScale);
 	void TriggerUpdate(Entity entity);
 
-	Entity Intersect(const Ray& ray, float& closestDistance);
+	/**
+	 * @brief Updates the boxes of many leaves at once. Leaves that escape their enlarged box are removed and
+	 * reinserted, then the internal nodes above the other moved leaves are refitted bottom up, each exactly once.
+	 * Entities not in the tree are skipped and static leaves are resized without being refitted or reinserted,
+	 * as with UpdatePosition, UpdateScale and TriggerUpdate.
+	 * @param updates The new box of each leaf. An entity should appear at most once.
+	 */
+	void UpdateLeaves(std::span<const LeafUpdate> updates);
+
+	/**
+	 * @brief Finds the closest leaf hit by a ray. Read only, so rays can be cast on the same tree concurrently.
+	 * @param ray The ray to cast.
+	 * @param closestDistance Set to the distance along the ray of the closest hit, FLT_MAX if nothing is hit.
+	 * @return The entity of the closest hit, INVALID_ENTITY if nothing is hit.
+	 */
+	Entity Intersect(const Ray& ray, float& closestDistance) const;
+
+	/**
+	 * @brief Calls a function with every leaf whose box overlaps a box, descending only into overlapping nodes.
+	 * Read only, so queries can run on the same tree concurrently or from inside another query's callback.
+	 * @param box The box to query.
+	 * @param callback Called with each overlapping leaf node. Must not modify the tree.
+	 */
+	template <typename Callback>
+	void Query(const AABB& box, Callback&& callback) const
+	{
+		if (m_rootIndex == NULL_NODE_INDEX) { return; }
+
+		NodeStack stack;
+		stack.Push(m_rootIndex);
+
+		while (!stack.IsEmpty())
+		{
+			const Node& node = m_nodes[stack.Pop()];
+			if (!AABB::Overlap(node.box, box)) { continue; }
+
+			if (node.isLeaf)
+			{
+				callback(node);
+			}
+			else
+			{
+				stack.Push(node.child1);
+				stack.Push(node.child2);
+			}
+		}
+	}
+
+	/**
+	 * @brief Checks whether an entity has a leaf in the tree.
+	 * @param entity The entity. A stale handle sharing the index of a newer entity is not contained.
+	 */
+	bool Contains(Entity entity) const
+	{
+		int leafIndex = m_entityToNodeIndex.Get(entity);
+		return leafIndex != NULL_NODE_INDEX && m_nodes[leafIndex].entity == entity;
+	}
 
 	int GetRootIndex() const { return m_rootIndex; }
 
 	std::vector<std::pair<Entity, Entity>> GetPotentialIntersections();
 
+	/**
+	 * @brief Measures the quality of the tree's structure, visiting every node.
+	 */
+	TreeQuality GetQuality() const;
+
 private:
+	friend class SceneSnapshot; // Saves and restores the node pool directly.
+
 	/**
 	 * @brief Removes a leaf node from the tree.
 	 * @param leafIndex The node index of the leaf node.
 	 */
 	void RemoveLeaf(int leafIndex);
 
+	/**
+	 * @brief Inserts a detached leaf or subtree under a new parent next to the best sibling for its box.
+	 * @param nodeIndex The node index of the leaf or subtree root.
+	 */
+	void InsertNode(int nodeIndex);
+
+	struct BuildItem;
+	int BuildRange(std::vector<BuildItem>& items, std::span<const TreeProxy> proxies, const std::vector<int>& nodeIndices, size_t begin, size_t end);
+
 	int AllocateLeafNode(Entity entity, const AABB& box);
-	int AllocateInternalNode();
+	int AllocateNode();
 	void DeallocateNode(int index);
 
 	int PickBest(const AABB& leafBox);
 
 	void RefitFromNode(int index);
+	void RefitDirtyNodes();
+	void RotateNodes(int index);
+	void RefitInternalNode(int index);
 	bool NeedsUpdate(int index);
 
 	void PotentialIntersectionHelper(std::vector<std::pair<Entity, Entity>>& intersections, std::unordered_set<uint64_t>& found, int nodeA, int nodeB);
 
-	std::vector<Node> m_nodes;
-	int m_nodeCount;
+	std::vector<Node> m_nodes; // Node pool, indexed by node index.
+	std::vector<AABB> m_enlargedBoxes; // Larger bounding box of each leaf to delay rebuilds, indexed by node index.
+	int m_nodeCount = 0; // Number of allocated nodes.
 	int m_rootIndex = NULL_NODE_INDEX;
+	int m_freeListIndex = NULL_NODE_INDEX; // Node index of the first free node.
+	std::vector<float> m_costCache; // Scratch cost of each node visited by PickBest, indexed by node index.
+	std::vector<int> m_movedLeaves; // Scratch leaves of UpdateLeaves that stayed inside their enlarged box.
+	std::vector<std::pair<Entity, AABB>> m_escapedLeaves; // Scratch entities and boxes of UpdateLeaves to reinsert.
+	std::vector<int> m_refitOrder; // Scratch dirty nodes of RefitDirtyNodes, parents before children.
 
-	std::vector<size_t> m_denseToNodeIndex;
-	std::vector<int> m_nodeToDenseIndex;
-	std::vector<int> m_entityToNodeIndex;
-
-	std::queue<int> m_availableNodes;
+	PagedSparseMap<int, NULL_NODE_INDEX> m_entityToNodeIndex;
 };
 
 #endif // AABBTREE_H_
\ No newline at end of file
@@ -8,180 +8,692 @@
 #include <unordered_map>
 #include <array>
 #include <tuple>
-#include "TypeIDGenerator.h"
+#include "ComponentID.h"
+#include "ChangeVersion.h"
+#include "QueryTerm.h"
+#include "ProfileCounters.h"
+#include "MemoryReport.h"
 #include <iostream>
 #include <utility>
 #include <bit>
-
-struct ComponentData
-{
-	ComponentType type;
-	void* data;
-};
-
-// type-erased buffer for component data
+#include <new>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <span>
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+constexpr size_t CHUNK_SIZE = 16 * 1024; // Size in bytes of a chunk of archetype storage
+constexpr size_t CACHE_LINE_SIZE = 64; // Alignment of chunks and of each column inside a chunk
+
+// location of a component type's data inside a chunk. A column is one or more streams of equal length, a single
+// stream of whole components, or one stream per float for components split with ECS_SOA_COMPONENT
 struct Column
 {
-	std::vector<char> m_elements; // buffer with component data
 	size_t m_elementSize; // size of a single element
+	size_t m_offset; // byte offset of the first element from the start of a chunk
+	size_t m_index; // position of the component type in the archetype, indexes the chunk change versions
+	size_t m_streamCount; // number of streams the column is split into
+	size_t m_streamElementSize; // size of one element of a stream, the element size unless the column is split
+	size_t m_streamStride; // byte distance between the first elements of consecutive streams
+
+	Column() : m_elementSize(0), m_offset(0), m_index(0), m_streamCount(1), m_streamElementSize(0), m_streamStride(0) {};
 
-	Column() : m_elementSize(0) {};
+	Column(size_t elementSize, size_t index, size_t splitStreamCount) : m_elementSize(elementSize), m_offset(0), m_index(index),
+		m_streamCount(std::max<size_t>(splitStreamCount, 1)), m_streamElementSize(splitStreamCount > 0 ? elementSize / splitStreamCount : elementSize), m_streamStride(0) {}
 
-	Column(size_t elementSize) : m_elementSize(elementSize) {}
+	bool IsSplit() const { return m_streamCount > 1; }
 
-	void AddComponent(const void* data)
+	// number of bytes from the start of the column to the end of the given number of rows of its last stream
+	size_t GetByteCount(size_t rowCount) const
 	{
-		assert(data != nullptr && "Component data cannot be null!");
+		return rowCount == 0 ? 0 : (m_streamCount - 1) * m_streamStride + rowCount * m_streamElementSize;
+	}
+};
 
-		// cast data into array of bytes
-		const char* rawData = static_cast<const char*>(data);
+// fixed size block of memory storing every component of up to the archetype's chunk capacity of entities.
+// the entity identifiers come first, followed by the cache aligned streams of each component type.
+struct Chunk
+{
+	char* m_data = nullptr; // aligned chunk memory
+	uint32_t m_count = 0; // number of rows in use
 
-		// insert it into the buffer
-		m_elements.insert(m_elements.end(), rawData, rawData + m_elementSize);
-	}
+	Entity* GetEntities() const { return std::bit_cast<Entity*>(m_data); }
 
-	void RemoveComponent(size_t index)
+	char* GetStreamElement(const Column& column, size_t stream, size_t index) const
 	{
-		assert(index < GetCount() && "Index out of bounds!");
+		return m_data + column.m_offset + stream * column.m_streamStride + index * column.m_streamElementSize;
+	}
 
-		// Get iterators to the element to remove
-		auto startIt = m_elements.begin() + index * m_elementSize;
-		auto endIt = startIt + m_elementSize;
+	template<typename T>
+	T* GetComponentData(const Column& column, size_t index) const
+	{
+		static_assert(!IsSoAComponent<T>, "Split components have no per row pointer, use ComponentStreams.");
+		return std::bit_cast<T*>(m_data + column.m_offset) + index;
+	}
 
-		// Replace the removed element with the last element in the vector
-		if (index != GetCount() - 1)
+	// copies the component of a row out of its streams
+	void ReadComponent(const Column& column, size_t index, void* destination) const
+	{
+		for (size_t stream = 0; stream < column.m_streamCount; stream++)
 		{
-			auto lastElementStart = m_elements.end() - m_elementSize;
-			std::copy(lastElementStart, m_elements.end(), startIt);
+			std::memcpy(static_cast<char*>(destination) + stream * column.m_streamElementSize, GetStreamElement(column, stream, index), column.m_streamElementSize);
 		}
-
-		// Erase the last element
-		m_elements.erase(m_elements.end() - m_elementSize, m_elements.end());
 	}
 
-	void* GetComponent(size_t index) const
+	// copies a whole component into the streams of a row
+	void WriteComponent(const Column& column, size_t index, const void* source) const
 	{
-		assert(index < GetCount() && "Index out of bounds!");
-
-		return const_cast<char*>(m_elements.data() + index * m_elementSize);
+		for (size_t stream = 0; stream < column.m_streamCount; stream++)
+		{
+			std::memcpy(GetStreamElement(column, stream, index), static_cast<const char*>(source) + stream * column.m_streamElementSize, column.m_streamElementSize);
+		}
 	}
 
-	template<typename T>
-	T* GetComponentData(size_t index)
+	// copies a component between two columns of the same type, which may have different stream strides
+	void CopyComponent(const Column& column, size_t index, const Chunk& sourceChunk, const Column& sourceColumn, size_t sourceIndex) const
 	{
-		assert(index < GetCount() && "Index out of bounds!");
-
-		char* data = m_elements.data() + index * m_elementSize;
-		return std::bit_cast<T*>(data);
+		for (size_t stream = 0; stream < column.m_streamCount; stream++)
+		{
+			std::memcpy(GetStreamElement(column, stream, index), sourceChunk.GetStreamElement(sourceColumn, stream, sourceIndex), column.m_streamElementSize);
+		}
 	}
+};
+
+// the rows of a split component in a chunk, passed to chunk callbacks in place of a span. Each float of the
+// component has a stream of its own holding that float for every row
+template<typename T>
+class ComponentStreams
+{
+public:
+	using Float = std::conditional_t<std::is_const_v<T>, const float, float>;
+
+	ComponentStreams() : m_first(nullptr), m_stride(0), m_count(0) {}
+	ComponentStreams(Float* first, size_t stride, size_t count) : m_first(first), m_stride(stride), m_count(count) {}
 
-	size_t GetCount() const
+	// gets the stream of a float member, or of one float of a member such as 1 for the y of a Vector3.
+	// the member offset is a byte offset inside the component, given with offsetof
+	std::span<Float> GetStream(size_t memberOffset, size_t element = 0) const
 	{
-		return m_elements.size() / m_elementSize;
+		size_t stream = memberOffset / sizeof(float) + element;
+		assert(stream < ComponentLayout<std::remove_cv_t<T>>::STREAM_COUNT && "Stream out of range!");
+		return std::span<Float>(std::bit_cast<Float*>(std::bit_cast<std::conditional_t<std::is_const_v<T>, const char*, char*>>(m_first) + stream * m_stride), m_count);
 	}
+
+	size_t size() const { return m_count; }
+	bool empty() const { return m_count == 0; }
+
+private:
+	Float* m_first; // first row of the first stream
+	size_t m_stride; // byte distance between the starts of consecutive streams
+	size_t m_count; // number of rows
+};
+
+// copy of the rows of one column of a chunk, taken the first time the column is written after a snapshot
+struct ColumnBackup
+{
+	uint32_t chunkIndex;
+	uint32_t columnIndex; // position of the component type in the archetype, the component count for the entity identifiers
+	size_t offset; // byte offset of the copy in the backup data
+	size_t size; // size in bytes of the copy
+};
+
+// the columns an archetype backed up while a snapshot was the newest, copying them back restores the snapshot
+struct ArchetypeBackup
+{
+	uint32_t epoch = 0; // the snapshot this backup restores
+	bool hasEntityCount = false; // set once the entity count has been recorded
+	uint32_t entityCount = 0; // entity count when the snapshot was taken, recorded before the first structural change
+	std::vector<ColumnBackup> columns; // in backup order
+	std::vector<char> data; // the copied rows of every column
 };
 
 class Archetype
 {
 public:
-	Archetype(Signature signature, std::array<size_t, MAX_COMPONENT_TYPES>& componentSizes) : m_entityToDenseIndex(MAX_ENTITIES, UINT32_MAX)
+	// The location table is indexed by entity index and shared by every archetype of a scene, each archetype
+	// keeps the records of its own entities up to date. The stream counts give the number of float streams of
+	// each split component type, 0 for types stored whole. The snapshot epoch is the newest snapshot of the scene,
+	// or 0 when no snapshots are kept, columns are backed up the first time they are written in each epoch
+	Archetype(Signature signature, std::array<size_t, MAX_COMPONENT_TYPES>& componentSizes, std::array<size_t, MAX_COMPONENT_TYPES>& componentStreamCounts,
+		std::vector<EntityLocation>& locations, const std::atomic<uint32_t>& snapshotEpoch) : m_locations(locations), m_snapshotEpoch(snapshotEpoch)
 	{
 		m_signature = signature;
 		m_entityCount = 0;
-		
-		for (size_t i = 0; i < MAX_COMPONENT_TYPES; i++)
+
+		signature.ForEachSetBit([&](size_t i) {
+			m_componentColumns[i] = Column(componentSizes[i], m_componentTypes.size(), componentStreamCounts[i]);
+			m_componentTypes.push_back((ComponentType)i);
+			});
+
+		m_addEdges.fill(nullptr);
+		m_removeEdges.fill(nullptr);
+
+		BuildChunkLayout();
+	}
+
+	~Archetype()
+	{
+		for (Chunk& chunk : m_chunks)
 		{
-			if (signature[i])
-			{
-				m_componentColumns[i] = Column(componentSizes[i]);
-			}
+			FreeChunk(chunk);
 		}
 	}
 
-	template<typename... Components, typename Callback>
+	Archetype(const Archetype&) = delete;
+	Archetype& operator=(const Archetype&) = delete;
+
+	// Iterates over every row whose chunk passes the change filters of the query terms, see QueryTerm.h
+	template<typename... Terms, typename Callback>
 	void ForEach(Callback&& callback)
 	{
 		if (m_entityCount == 0) { return; }
+		ProfileCounters::CountArchetype();
 
-		constexpr size_t componentCount = sizeof...(Components);
+		// look up the columns of the used components once for the whole archetype, optional components missing from
+		// this archetype have no column
+		std::array<const Column*, sizeof...(Terms)> columns = { GetTermColumn<Terms>()... };
+		uint32_t lastRunVersion = ChangeVersion::GetLastRunVersion();
+		uint32_t writeVersion = ChangeVersion::GetWriteVersion();
 
-		// create an array of the used component columns in this archetype
-		std::array<Column*, componentCount> orderedColumns = { (&m_componentColumns[TypeIndexGenerator::GetTypeIndex<Components>()])... };
+		// chunks are indexed rather than iterated so the callback may add entities to this archetype
+		for (size_t chunkIndex = 0; chunkIndex < m_chunks.size() && m_chunks[chunkIndex].m_count > 0; chunkIndex++)
+		{
+			if (AcquireChunk<Terms...>(columns, chunkIndex, lastRunVersion, writeVersion))
+			{
+				ProfileCounters::CountEntities(m_chunks[chunkIndex].m_count);
+				ForEachHelper<Terms...>(callback, columns, chunkIndex, 0, SIZE_MAX, std::index_sequence_for<Terms...>{});
+			}
+		}
+	}
+
+	// Calls the callback once per chunk that passes the change filters of the query terms, passing the row count
+	// followed by a contiguous span of the entities and of each component, or ComponentStreams for split components.
+	// Optional components missing from this archetype are passed as empty spans. The callback must not add or remove
+	// entities of this archetype.
+	template<typename... Terms, typename Callback>
+	void ForEachChunk(Callback&& callback)
+	{
+		if (m_entityCount == 0) { return; }
+		ProfileCounters::CountArchetype();
 
-		// for each entity gets its component data and execute the callback
-		for (size_t i = 0; i < m_entityCount; i++) {
-			int index = componentCount;
-			auto componentData = std::make_tuple(m_denseIndexToEntity[i], (orderedColumns[--index]->GetComponentData<Components>(i))...);
+		std::array<const Column*, sizeof...(Terms)> columns = { GetTermColumn<Terms>()... };
+		uint32_t lastRunVersion = ChangeVersion::GetLastRunVersion();
+		uint32_t writeVersion = ChangeVersion::GetWriteVersion();
 
-			std::apply(callback, componentData);
+		for (size_t chunkIndex = 0; chunkIndex < m_chunks.size() && m_chunks[chunkIndex].m_count > 0; chunkIndex++)
+		{
+			if (AcquireChunk<Terms...>(columns, chunkIndex, lastRunVersion, writeVersion))
+			{
+				ProfileCounters::CountEntities(m_chunks[chunkIndex].m_count);
+				ForEachChunkRangeHelper<Terms...>(callback, columns, chunkIndex, 0, m_chunks[chunkIndex].m_count, std::index_sequence_for<Terms...>{});
+			}
 		}
 	}
 
+	// Checks if a chunk passes the change filters of the query terms, and if it does marks the components
+	// written through the terms as changed. Must be called before iterating a chunk with ForEachInChunk.
+	template<typename... Terms>
+	bool AcquireChunk(size_t chunkIndex, uint32_t lastRunVersion, uint32_t writeVersion)
+	{
+		std::array<const Column*, sizeof...(Terms)> columns = { GetTermColumn<Terms>()... };
+		return AcquireChunk<Terms...>(columns, chunkIndex, lastRunVersion, writeVersion);
+	}
+
+	// Iterates over the rows [begin, end) of a single chunk. The rows must be in use, and entities of this
+	// archetype must not be added or removed until the call returns.
+	template<typename... Terms, typename Callback>
+	void ForEachInChunk(size_t chunkIndex, size_t begin, size_t end, Callback&& callback)
+	{
+		assert(end <= m_chunks[chunkIndex].m_count && "Row range out of bounds!");
+
+		std::array<const Column*, sizeof...(Terms)> columns = { GetTermColumn<Terms>()... };
+
+		ForEachHelper<Terms...>(callback, columns, chunkIndex, begin, end, std::index_sequence_for<Terms...>{});
+	}
+
+	// Calls the callback once for the rows [begin, end) of a single chunk, passing the row count followed by a
+	// contiguous span of the entities and of each component. The same restrictions as ForEachInChunk apply.
+	template<typename... Terms, typename Callback>
+	void ForEachChunkRange(size_t chunkIndex, size_t begin, size_t end, Callback&& callback)
+	{
+		assert(begin <= end && end <= m_chunks[chunkIndex].m_count && "Row range out of bounds!");
+
+		std::array<const Column*, sizeof...(Terms)> columns = { GetTermColumn<Terms>()... };
+
+		ForEachChunkRangeHelper<Terms...>(callback, columns, chunkIndex, begin, end, std::index_sequence_for<Terms...>{});
+	}
+
+	// Gets the version a component type of a chunk was last written at
+	uint32_t GetChangeVersion(size_t chunkIndex, ComponentType type) const
+	{
+		return m_changeVersions[chunkIndex * m_componentTypes.size() + m_componentColumns[type].m_index];
+	}
+
+	// Marks a component type of a chunk as changed, for code that writes through pointers it cached earlier.
+	// Must be called before the writes, as the chunk's column is backed up first if a snapshot needs it.
+	void MarkComponentChanged(size_t chunkIndex, ComponentType type)
+	{
+		const Column& column = m_componentColumns[type];
+		BackupColumn(chunkIndex, column.m_index);
+		GetChangeVersions(chunkIndex)[column.m_index] = ChangeVersion::GetWriteVersion();
+	}
+
+	// Gets a component of a row without marking it as changed, writes through the pointer must be announced
+	// with MarkComponentChanged
+	template<typename T>
+	T* GetComponentAtRowUnmarked(size_t row)
+	{
+		return GetChunk(row).GetComponentData<T>(m_componentColumns[GetComponentID<T>()], row & m_chunkMask);
+	}
+
+	size_t GetChunkIndex(size_t row) const { return row >> m_chunkShift; }
+
+	// Gets the start of a component type's column in a chunk, holding one element per row of the chunk. Split
+	// components have no such array, see ReadComponents
+	const void* GetColumnData(size_t chunkIndex, ComponentType type) const
+	{
+		assert(!m_componentColumns[type].IsSplit() && "Split components are not stored as an array of components!");
+		return m_chunks[chunkIndex].GetStreamElement(m_componentColumns[type], 0, 0);
+	}
+
+	size_t GetComponentSize(ComponentType type) const { return m_componentColumns[type].m_elementSize; }
+	bool IsSplitComponent(ComponentType type) const { return m_componentColumns[type].IsSplit(); }
+
 	Signature GetSignature() const { return m_signature; }
+	bool HasComponent(ComponentType type) const { return m_signature.test(type); }
 
-	// Method to add an entity with its component data
-	void AddEntity(Entity entity, const std::vector<ComponentData>& components) {
+	const std::vector<ComponentType>& GetComponentTypes() const { return m_componentTypes; }
 
-		m_entityToDenseIndex[entity] = m_entityCount++;
-		m_denseIndexToEntity.push_back(entity);
+	// Archetype graph edges, these cache the archetype reached by adding or removing a single component type
+	Archetype* GetAddEdge(ComponentType type) const { return m_addEdges[type]; }
+	Archetype* GetRemoveEdge(ComponentType type) const { return m_removeEdges[type]; }
+	void SetAddEdge(ComponentType type, Archetype* archetype) { m_addEdges[type] = archetype; }
+	void SetRemoveEdge(ComponentType type, Archetype* archetype) { m_removeEdges[type] = archetype; }
 
-		for (const ComponentData& component : components) {
-			assert(m_signature.test(component.type) && "Component type not present in this archetype!");
+	uint32_t GetEntityCount() const { return m_entityCount; }
+	size_t GetChunkCapacity() const { return m_chunkCapacity; }
+	size_t GetCapacity() const { return m_chunks.size() * m_chunkCapacity; }
+	const std::vector<Chunk>& GetChunks() const { return m_chunks; }
 
-			m_componentColumns[component.type].AddComponent(component.data);
+	// Allocates enough chunks to hold the given number of entities without further allocation
+	void Reserve(size_t entityCount)
+	{
+		while (GetCapacity() < entityCount)
+		{
+			AllocateChunk();
 		}
 	}
 
-	template<typename T>
-	T* GetComponent(Entity entity)
+	// Frees every chunk that no longer holds any entities
+	void ShrinkToFit()
+	{
+		BackupEntityCount();
+
+		while (!m_chunks.empty() && m_chunks.back().m_count == 0)
+		{
+			FreeChunk(m_chunks.back());
+			m_chunks.pop_back();
+		}
+
+		m_changeVersions.resize(m_chunks.size() * m_componentTypes.size());
+		m_backupEpochs.resize(m_chunks.size() * (m_componentTypes.size() + 1));
+	}
+
+	// Frees the chunks without rows, the unused capacity of the metadata and the recycled snapshot backups
+	void Compact()
 	{
-		return m_componentColumns[TypeIndexGenerator::GetTypeIndex<T>()].GetComponentData<T>(m_entityToDenseIndex[entity]);
+		ShrinkToFit();
+		m_chunks.shrink_to_fit();
+		m_changeVersions.shrink_to_fit();
+		m_backupEpochs.shrink_to_fit();
+
+		std::lock_guard<std::mutex> lock(m_backupMutex);
+		m_freeBackups.clear();
+		m_freeBackups.shrink_to_fit();
 	}
 
-	std::vector<ComponentData> GetComponentData(Entity entity)
+	// Reorders the rows by ascending key, given one key per row, keeping rows with equal keys in their current order.
+	// Entity locations are updated and every chunk is marked as changed. Returns false if the rows were already in
+	// order, in which case nothing is moved
+	bool SortRows(const std::vector<uint64_t>& keys)
 	{
-		std::vector<ComponentData> componentData;
+		assert(keys.size() == m_entityCount && "One sort key is needed per row!");
+		if (std::is_sorted(keys.begin(), keys.end())) { return false; }
+
+		std::vector<uint32_t> order(m_entityCount);
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+		// each stream of each column, including the entity identifiers, is gathered into sorted order and then copied
+		// back one chunk at a time
+		std::vector<char> sorted;
+		for (size_t columnIndex = 0; columnIndex <= m_componentTypes.size(); columnIndex++)
+		{
+			Column column = GetStorageColumn(columnIndex);
+			size_t elementSize = column.m_streamElementSize;
+			sorted.resize(m_entityCount * elementSize);
+
+			for (size_t chunkIndex = 0; chunkIndex < m_chunks.size() && m_chunks[chunkIndex].m_count > 0; chunkIndex++)
+			{
+				BackupColumn(chunkIndex, columnIndex);
+			}
+
+			for (size_t stream = 0; stream < column.m_streamCount; stream++)
+			{
+				for (size_t row = 0; row < m_entityCount; row++)
+				{
+					size_t sourceRow = order[row];
+					std::memcpy(sorted.data() + row * elementSize, GetChunk(sourceRow).GetStreamElement(column, stream, sourceRow & m_chunkMask), elementSize);
+				}
+
+				for (size_t chunkIndex = 0; chunkIndex < m_chunks.size() && m_chunks[chunkIndex].m_count > 0; chunkIndex++)
+				{
+					std::memcpy(m_chunks[chunkIndex].GetStreamElement(column, stream, 0), sorted.data() + chunkIndex * m_chunkCapacity * elementSize, m_chunks[chunkIndex].m_count * elementSize);
+				}
+			}
+		}
 
-		for (size_t i = 0; i < MAX_COMPONENT_TYPES; i++)
+		for (size_t chunkIndex = 0; chunkIndex < m_chunks.size() && m_chunks[chunkIndex].m_count > 0; chunkIndex++)
 		{
-			if (m_signature[i])
+			MarkChunkChanged(chunkIndex);
+
+			const Entity* entities = m_chunks[chunkIndex].GetEntities();
+			for (size_t i = 0; i < m_chunks[chunkIndex].m_count; i++)
 			{
-				const ComponentData data = { (ComponentType)i, m_componentColumns[i].GetComponent(m_entityToDenseIndex[entity]) };
-				componentData.push_back(data);
+				m_locations[GetEntityIndex(entities[i])].row = (uint32_t)((chunkIndex << m_chunkShift) + i);
 			}
 		}
 
-		return componentData;
+		return true;
 	}
 
-	void RemoveEntity(Entity entity)
+	// Clears the graph edges leading to archetypes that are about to be freed, the removed archetypes must be sorted
+	void ClearEdgesTo(const std::vector<Archetype*>& removed)
+	{
+		for (size_t type = 0; type < MAX_COMPONENT_TYPES; type++)
+		{
+			if (m_addEdges[type] != nullptr && std::binary_search(removed.begin(), removed.end(), m_addEdges[type])) { m_addEdges[type] = nullptr; }
+			if (m_removeEdges[type] != nullptr && std::binary_search(removed.begin(), removed.end(), m_removeEdges[type])) { m_removeEdges[type] = nullptr; }
+		}
+	}
+
+	// Reports the memory of the chunks, metadata and snapshot backups
+	ArchetypeMemoryReport GetMemoryReport() const
+	{
+		ArchetypeMemoryReport report;
+		report.signature = m_signature;
+		report.entityCount = m_entityCount;
+		report.chunkCount = m_chunks.size();
+		report.chunkBytes = m_chunks.size() * m_chunkSize;
+
+		size_t rowSize = sizeof(Entity);
+		for (ComponentType type : m_componentTypes)
+		{
+			const Column& column = m_componentColumns[type];
+			rowSize += column.m_elementSize;
+			report.columns.push_back({ type, column.m_elementSize, m_entityCount * column.m_elementSize, GetCapacity() * column.m_elementSize });
+		}
+
+		for (const Chunk& chunk : m_chunks)
+		{
+			if (chunk.m_count == 0) { report.emptyChunkCount++; }
+		}
+
+		report.usedRowBytes = m_entityCount * rowSize;
+		report.freeRowBytes = (GetCapacity() - m_entityCount) * rowSize;
+		report.paddingBytes = report.chunkBytes - GetCapacity() * rowSize;
+
+		report.metadataBytes = sizeof(Archetype) + m_chunks.capacity() * sizeof(Chunk) + m_changeVersions.capacity() * sizeof(uint32_t)
+			+ m_backupEpochs.capacity() * sizeof(uint32_t) + m_componentTypes.capacity() * sizeof(ComponentType);
+		report.spareBytes = (m_chunks.capacity() - m_chunks.size()) * sizeof(Chunk) + (m_changeVersions.capacity() - m_changeVersions.size()) * sizeof(uint32_t)
+			+ (m_backupEpochs.capacity() - m_backupEpochs.size()) * sizeof(uint32_t);
+
+		auto addBackup = [&](const ArchetypeBackup& backup) {
+			report.snapshotBytes += sizeof(ArchetypeBackup) + backup.columns.capacity() * sizeof(ColumnBackup) + backup.data.capacity();
+			};
+		std::for_each(m_backups.begin(), m_backups.end(), addBackup);
+		std::for_each(m_freeBackups.begin(), m_freeBackups.end(), addBackup);
+
+		return report;
+	}
+
+	// Adds a new row for an entity, the component data of the row is left for the caller to write
+	size_t AddEntity(Entity entity)
+	{
+		BackupEntityCount();
+
+		size_t row = m_entityCount;
+		if (row == GetCapacity())
+		{
+			AllocateChunk();
+		}
+
+		Chunk& chunk = m_chunks[row >> m_chunkShift];
+		chunk.GetEntities()[chunk.m_count++] = entity;
+		MarkChunkChanged(row >> m_chunkShift);
+
+		m_locations[GetEntityIndex(entity)] = { this, (uint32_t)row };
+		m_entityCount++;
+
+		return row;
+	}
+
+	// Adds rows for a range of entities at once, the component data of the rows is left for the caller to write.
+	// The entities get consecutive rows, and the row of the first entity is returned.
+	size_t AddEntities(const Entity* entities, size_t count)
 	{
-		if (m_entityToDenseIndex[entity] == INVALID_ENTITY) return;
+		BackupEntityCount();
 
-		// Get indices
-		size_t removedEntityIndex = m_entityToDenseIndex[entity];
-		size_t lastEntityIndex = (size_t)m_entityCount - 1;
+		size_t firstRow = m_entityCount;
+		Reserve(firstRow + count);
 
-		// remove the entities components from all columns
-		for (size_t i = 0; i < MAX_COMPONENT_TYPES; i++)
+		for (size_t written = 0; written < count;)
 		{
-			if (m_signature[i])
+			size_t row = firstRow + written;
+			size_t rowCount = std::min(count - written, m_chunkCapacity - (row & m_chunkMask));
+
+			Chunk& chunk = GetChunk(row);
+			std::memcpy(chunk.GetEntities() + (row & m_chunkMask), entities + written, rowCount * sizeof(Entity));
+			chunk.m_count += (uint32_t)rowCount;
+			MarkChunkChanged(row >> m_chunkShift);
+			written += rowCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			m_locations[GetEntityIndex(entities[i])] = { this, (uint32_t)(firstRow + i) };
+		}
+		m_entityCount += (uint32_t)count;
+
+		return firstRow;
+	}
+
+	// Moves an entity and the component data it shares with the destination archetype into the destination.
+	// Components missing from the destination are dropped and components missing from this archetype are left
+	// for the caller to write. Returns the row of the entity in the destination.
+	size_t MoveEntity(Entity entity, Archetype& destination)
+	{
+		size_t sourceRow = m_locations[GetEntityIndex(entity)].row;
+		size_t destinationRow = destination.AddEntity(entity);
+
+		const Chunk& sourceChunk = GetChunk(sourceRow);
+		const Chunk& destinationChunk = destination.GetChunk(destinationRow);
+		size_t sourceIndex = sourceRow & m_chunkMask;
+		size_t destinationIndex = destinationRow & destination.m_chunkMask;
+
+		for (ComponentType type : m_componentTypes)
+		{
+			if (destination.m_signature.test(type))
 			{
-				m_componentColumns[i].RemoveComponent(removedEntityIndex);
+				destinationChunk.CopyComponent(destination.m_componentColumns[type], destinationIndex, sourceChunk, m_componentColumns[type], sourceIndex);
 			}
 		}
 
-		Entity lastEntity = m_denseIndexToEntity[lastEntityIndex];
+		// the entity's location already points at the destination
+		RemoveRow(sourceRow);
 
-		// Update mappings
-		m_entityToDenseIndex[lastEntity] = removedEntityIndex;
-		m_denseIndexToEntity[removedEntityIndex] = lastEntity;
+		return destinationRow;
+	}
 
-		// Erase removed entity
-		m_entityToDenseIndex[entity] = UINT32_MAX;
-		m_denseIndexToEntity.pop_back();
+	void SetComponent(ComponentType type, size_t row, const void* data)
+	{
+		assert(m_signature.test(type) && "Component type not present in this archetype!");
 
-		m_entityCount--;
+		const Column& column = m_componentColumns[type];
+		BackupColumn(row >> m_chunkShift, column.m_index);
+		GetChunk(row).WriteComponent(column, row & m_chunkMask, data);
+		GetChangeVersions(row >> m_chunkShift)[column.m_index] = ChangeVersion::GetWriteVersion();
+	}
+
+	// Copies an array of component data into consecutive rows, one block copy per chunk. Split components are
+	// scattered into their streams a row at a time
+	void SetComponents(ComponentType type, size_t firstRow, const void* data, size_t count)
+	{
+		assert(m_signature.test(type) && "Component type not present in this archetype!");
+
+		const Column& column = m_componentColumns[type];
+		const char* source = static_cast<const char*>(data);
+		for (size_t written = 0; written < count;)
+		{
+			size_t row = firstRow + written;
+			size_t rowCount = std::min(count - written, m_chunkCapacity - (row & m_chunkMask));
+
+			BackupColumn(row >> m_chunkShift, column.m_index);
+			if (column.IsSplit())
+			{
+				for (size_t i = 0; i < rowCount; i++)
+				{
+					GetChunk(row).WriteComponent(column, (row & m_chunkMask) + i, source + (written + i) * column.m_elementSize);
+				}
+			}
+			else
+			{
+				std::memcpy(GetChunk(row).GetStreamElement(column, 0, row & m_chunkMask), source + written * column.m_elementSize, rowCount * column.m_elementSize);
+			}
+			GetChangeVersions(row >> m_chunkShift)[column.m_index] = ChangeVersion::GetWriteVersion();
+			written += rowCount;
+		}
+	}
+
+	// Copies the components of consecutive rows out into an array of whole components, the inverse of SetComponents
+	void ReadComponents(ComponentType type, size_t firstRow, void* data, size_t count) const
+	{
+		assert(m_signature.test(type) && "Component type not present in this archetype!");
+
+		const Column& column = m_componentColumns[type];
+		char* destination = static_cast<char*>(data);
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t row = firstRow + i;
+			m_chunks[row >> m_chunkShift].ReadComponent(column, row & m_chunkMask, destination + i * column.m_elementSize);
+		}
+	}
+
+	// Copies out the component of a row, the only way to read a single split component
+	template<typename T>
+	T LoadComponentAtRow(size_t row) const
+	{
+		alignas(T) char data[sizeof(T)];
+		ReadComponents(GetComponentID<T>(), row, data, 1);
+		return std::bit_cast<T>(data);
+	}
+
+	// Gets the row of an entity stored in this archetype
+	size_t GetRow(Entity entity) const
+	{
+		return m_locations[GetEntityIndex(entity)].row;
+	}
+
+	// Gets a pointer to an entity's component. Chunks never move, so the pointer stays valid until an entity
+	// is removed from this archetype, which may move the last row into the removed row.
+	// Unless T is const qualified the component is marked as changed.
+	template<typename T>
+	T* GetComponent(Entity entity)
+	{
+		return GetComponentAtRow<T>(m_locations[GetEntityIndex(entity)].row);
+	}
+
+	template<typename T>
+	T* GetComponentAtRow(size_t row)
+	{
+		const Column& column = m_componentColumns[GetComponentID<T>()];
+		if constexpr (!std::is_const_v<T>)
+		{
+			BackupColumn(row >> m_chunkShift, column.m_index);
+			GetChangeVersions(row >> m_chunkShift)[column.m_index] = ChangeVersion::GetWriteVersion();
+		}
+
+		return GetChunk(row).GetComponentData<T>(column, row & m_chunkMask);
+	}
+
+	void RemoveEntity(Entity entity)
+	{
+		EntityLocation& location = m_locations[GetEntityIndex(entity)];
+		if (location.archetype != this) return;
+
+		RemoveRow(location.row);
+		location = EntityLocation();
+	}
+
+	// Restores the archetype to a snapshot by copying back every column backed up since the snapshot was taken,
+	// newest first, and drops those backups. Restored columns are marked as changed. Entity locations are not
+	// restored, the caller restores the location table as a whole
+	void RestoreSnapshot(uint32_t epoch)
+	{
+		while (!m_backups.empty() && m_backups.back().epoch >= epoch)
+		{
+			ArchetypeBackup& backup = m_backups.back();
+
+			// a column may be backed up more than once in an epoch after an earlier restore, the oldest copy wins
+			for (auto it = backup.columns.rbegin(); it != backup.columns.rend(); ++it)
+			{
+				// chunks emptied since the snapshot may have been freed
+				while (m_chunks.size() <= it->chunkIndex)
+				{
+					AllocateChunk();
+				}
+
+				std::memcpy(GetColumnStart(it->chunkIndex, it->columnIndex), backup.data.data() + it->offset, it->size);
+				if (it->columnIndex < m_componentTypes.size())
+				{
+					GetChangeVersions(it->chunkIndex)[it->columnIndex] = ChangeVersion::GetWriteVersion();
+				}
+				else
+				{
+					MarkChunkChanged(it->chunkIndex);
+				}
+			}
+
+			if (backup.hasEntityCount)
+			{
+				m_entityCount = backup.entityCount;
+			}
+
+			RecycleBackup(backup);
+			m_backups.pop_back();
+		}
+
+		// every chunk but the last is full, so the row counts follow from the entity count
+		for (size_t chunkIndex = 0; chunkIndex < m_chunks.size(); chunkIndex++)
+		{
+			size_t firstRow = std::min<size_t>(chunkIndex * m_chunkCapacity, m_entityCount);
+			m_chunks[chunkIndex].m_count = (uint32_t)std::min(m_entityCount - firstRow, m_chunkCapacity);
+		}
+
+		m_entityCountEpoch = 0;
+	}
+
+	// Drops the backups of a snapshot and every older snapshot, which can no longer be restored
+	void ReleaseSnapshots(uint32_t epoch)
+	{
+		while (!m_backups.empty() && m_backups.front().epoch <= epoch)
+		{
+			RecycleBackup(m_backups.front());
+			m_backups.pop_front();
+		}
 	}
 
 private:
@@ -189,6 +701,322 @@ private:
 	Signature m_signature;
 	uint32_t m_entityCount;
 	std::array<Column, MAX_COMPONENT_TYPES> m_componentColumns;
-	std::vector<Entity> m_denseIndexToEntity;    // Maps dense index -> entity
-	std::vector<size_t> m_entityToDenseIndex;    // Maps entity -> dense index
-};
\ No newline at end of file
+	std::vector<ComponentType> m_componentTypes; // The component types in the signature, in ascending order
+	std::array<Archetype*, MAX_COMPONENT_TYPES> m_addEdges; // Archetype reached by adding a component type
+	std::array<Archetype*, MAX_COMPONENT_TYPES> m_removeEdges; // Archetype reached by removing a component type
+	std::vector<Chunk> m_chunks; // Storage for the rows, every chunk but the last is full
+	std::vector<uint32_t> m_changeVersions; // Version each column of each chunk was last written at, one row of columns per chunk
+	size_t m_chunkCapacity; // Number of rows per chunk, always a power of two
+	size_t m_chunkShift; // log2 of the chunk capacity, maps a row to its chunk
+	size_t m_chunkMask; // Maps a row to its index inside its chunk
+	size_t m_chunkSize; // Size in bytes of each chunk allocation
+	std::vector<EntityLocation>& m_locations; // Location of every entity in the scene, indexed by entity index
+
+	const std::atomic<uint32_t>& m_snapshotEpoch; // Newest snapshot of the scene, 0 when no snapshots are kept
+	std::vector<uint32_t> m_backupEpochs; // Epoch each column of each chunk was last backed up in, laid out like the change versions with an extra column for the entity identifiers
+	uint32_t m_entityCountEpoch = 0; // Epoch the entity count was last backed up in
+	std::deque<ArchetypeBackup> m_backups; // Backups of the snapshots that can still be restored, oldest first
+	std::vector<ArchetypeBackup> m_freeBackups; // Dropped backups, kept so their memory is reused
+	std::mutex m_backupMutex; // Guards the backups, as systems running concurrently may write the same chunk
+
+	// Removes a row by moving the last row into it, and updates the location of the moved entity
+	void RemoveRow(size_t removedRow)
+	{
+		size_t lastRow = (size_t)m_entityCount - 1;
+
+		BackupEntityCount();
+		BackupChunk(removedRow >> m_chunkShift);
+		BackupChunk(lastRow >> m_chunkShift);
+
+		Chunk& removedChunk = GetChunk(removedRow);
+		Chunk& lastChunk = GetChunk(lastRow);
+		size_t removedIndex = removedRow & m_chunkMask;
+		size_t lastIndex = lastRow & m_chunkMask;
+
+		// Replace the removed row with the last row
+		if (removedRow != lastRow)
+		{
+			Entity lastEntity = lastChunk.GetEntities()[lastIndex];
+			for (ComponentType type : m_componentTypes)
+			{
+				const Column& column = m_componentColumns[type];
+				removedChunk.CopyComponent(column, removedIndex, lastChunk, column, lastIndex);
+			}
+
+			removedChunk.GetEntities()[removedIndex] = lastEntity;
+			m_locations[GetEntityIndex(lastEntity)].row = (uint32_t)removedRow;
+
+			// the moved row keeps its change state, so the chunk it moves into is at least as new as the chunk it left
+			uint32_t* removedVersions = GetChangeVersions(removedRow >> m_chunkShift);
+			const uint32_t* lastVersions = GetChangeVersions(lastRow >> m_chunkShift);
+			for (size_t i = 0; i < m_componentTypes.size(); i++)
+			{
+				removedVersions[i] = std::max(removedVersions[i], lastVersions[i]);
+			}
+		}
+
+		lastChunk.m_count--;
+		m_entityCount--;
+	}
+
+	static size_t AlignToCacheLine(size_t size)
+	{
+		return (size + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+	}
+
+	// Gets the number of bytes needed to store the given number of rows, and sets the column offsets for it. Each
+	// stream of a split column starts on a cache line of its own
+	size_t LayoutColumns(size_t rowCount)
+	{
+		size_t offset = AlignToCacheLine(rowCount * sizeof(Entity));
+		for (ComponentType type : m_componentTypes)
+		{
+			Column& column = m_componentColumns[type];
+			column.m_offset = offset;
+			column.m_streamStride = AlignToCacheLine(rowCount * column.m_streamElementSize);
+			offset += column.m_streamCount * column.m_streamStride;
+		}
+
+		return offset;
+	}
+
+	// Picks the largest power of two row count that fits in a chunk. Rows too big for a single chunk
+	// get one row per chunk with the chunk enlarged to fit.
+	void BuildChunkLayout()
+	{
+		size_t rowSize = sizeof(Entity);
+		for (ComponentType type : m_componentTypes)
+		{
+			rowSize += m_componentColumns[type].m_elementSize;
+		}
+
+		m_chunkCapacity = std::bit_floor(std::max<size_t>(CHUNK_SIZE / rowSize, 1));
+		while (m_chunkCapacity > 1 && LayoutColumns(m_chunkCapacity) > CHUNK_SIZE)
+		{
+			m_chunkCapacity >>= 1;
+		}
+
+		m_chunkSize = std::max(CHUNK_SIZE, LayoutColumns(m_chunkCapacity));
+		m_chunkShift = std::countr_zero(m_chunkCapacity);
+		m_chunkMask = m_chunkCapacity - 1;
+	}
+
+	Chunk& GetChunk(size_t row)
+	{
+		return m_chunks[row >> m_chunkShift];
+	}
+
+	uint32_t* GetChangeVersions(size_t chunkIndex)
+	{
+		return m_changeVersions.data() + chunkIndex * m_componentTypes.size();
+	}
+
+	// Marks every component of a chunk as changed, used when rows are added to it
+	void MarkChunkChanged(size_t chunkIndex)
+	{
+		std::fill_n(GetChangeVersions(chunkIndex), m_componentTypes.size(), ChangeVersion::GetWriteVersion());
+	}
+
+	void AllocateChunk()
+	{
+		Chunk chunk;
+		chunk.m_data = static_cast<char*>(::operator new(m_chunkSize, std::align_val_t(CACHE_LINE_SIZE)));
+		ProfileCounters::CountAllocation(m_chunkSize);
+		m_chunks.push_back(chunk);
+		m_changeVersions.resize(m_chunks.size() * m_componentTypes.size(), 0);
+		m_backupEpochs.resize(m_chunks.size() * (m_componentTypes.size() + 1), 0);
+	}
+
+	// Gets a column by its position, the column after the last component is the entity identifiers
+	Column GetStorageColumn(size_t columnIndex) const
+	{
+		return columnIndex < m_componentTypes.size() ? m_componentColumns[m_componentTypes[columnIndex]] : Column(sizeof(Entity), columnIndex, 0);
+	}
+
+	// Gets the first row of a column of a chunk, the column after the last component is the entity identifiers
+	char* GetColumnStart(size_t chunkIndex, size_t columnIndex)
+	{
+		return m_chunks[chunkIndex].GetStreamElement(GetStorageColumn(columnIndex), 0, 0);
+	}
+
+	// Copies the rows of a column of a chunk the first time it is written after a snapshot, so the snapshot
+	// shares every column that is never written. Safe to call from several threads.
+	void BackupColumn(size_t chunkIndex, size_t columnIndex)
+	{
+		uint32_t epoch = m_snapshotEpoch.load(std::memory_order_relaxed);
+		if (epoch == 0) { return; }
+
+		std::atomic_ref<uint32_t> backupEpoch(m_backupEpochs[chunkIndex * (m_componentTypes.size() + 1) + columnIndex]);
+		if (backupEpoch.load(std::memory_order_acquire) == epoch) { return; }
+
+		std::lock_guard<std::mutex> lock(m_backupMutex);
+		if (backupEpoch.load(std::memory_order_relaxed) == epoch) { return; }
+
+		// the rows of a split column are copied with the unused rows between its streams, which are never read
+		ArchetypeBackup& backup = GetBackup(epoch);
+		ColumnBackup column = { (uint32_t)chunkIndex, (uint32_t)columnIndex, backup.data.size(), GetStorageColumn(columnIndex).GetByteCount(m_chunks[chunkIndex].m_count) };
+
+		backup.data.resize(column.offset + column.size);
+		std::memcpy(backup.data.data() + column.offset, GetColumnStart(chunkIndex, columnIndex), column.size);
+		backup.columns.push_back(column);
+
+		backupEpoch.store(epoch, std::memory_order_release);
+	}
+
+	// Backs up every column of a chunk, including the entity identifiers, used before rows are moved
+	void BackupChunk(size_t chunkIndex)
+	{
+		for (size_t columnIndex = 0; columnIndex <= m_componentTypes.size(); columnIndex++)
+		{
+			BackupColumn(chunkIndex, columnIndex);
+		}
+	}
+
+	// Records the entity count the first time entities are added or removed after a snapshot. Rows added after
+	// the snapshot are dropped by restoring the count, so their data never needs backing up.
+	void BackupEntityCount()
+	{
+		uint32_t epoch = m_snapshotEpoch.load(std::memory_order_relaxed);
+		if (epoch == 0 || m_entityCountEpoch == epoch) { return; }
+
+		std::lock_guard<std::mutex> lock(m_backupMutex);
+		ArchetypeBackup& backup = GetBackup(epoch);
+		if (!backup.hasEntityCount)
+		{
+			backup.hasEntityCount = true;
+			backup.entityCount = m_entityCount;
+		}
+
+		m_entityCountEpoch = epoch;
+	}
+
+	// Gets the backup of the newest snapshot, starting it if nothing has been backed up for the snapshot yet
+	ArchetypeBackup& GetBackup(uint32_t epoch)
+	{
+		if (m_backups.empty() || m_backups.back().epoch != epoch)
+		{
+			if (!m_freeBackups.empty())
+			{
+				m_backups.push_back(std::move(m_freeBackups.back()));
+				m_freeBackups.pop_back();
+			}
+			else
+			{
+				m_backups.emplace_back();
+			}
+
+			m_backups.back().epoch = epoch;
+		}
+
+		return m_backups.back();
+	}
+
+	// Clears a dropped backup and keeps it for reuse
+	void RecycleBackup(ArchetypeBackup& backup)
+	{
+		backup.hasEntityCount = false;
+		backup.columns.clear();
+		backup.data.clear();
+		m_freeBackups.push_back(std::move(backup));
+	}
+
+	void FreeChunk(Chunk& chunk)
+	{
+		::operator delete(chunk.m_data, std::align_val_t(CACHE_LINE_SIZE));
+		chunk.m_data = nullptr;
+	}
+
+	// Gets the column of a query term's component, or nullptr for an optional component this archetype does not have
+	template<typename Term>
+	const Column* GetTermColumn() const
+	{
+		ComponentType type = GetComponentID<TermComponent<Term>>();
+		if constexpr (IsOptionalTerm<Term>)
+		{
+			if (!m_signature.test(type)) { return nullptr; }
+		}
+		assert(m_signature.test(type) && "Archetype does not contain a required component of the query.");
+		return &m_componentColumns[type];
+	}
+
+	// Gets a query term's component data of a chunk starting at a row, or nullptr if the term has no column
+	template<typename Term>
+	static TermComponent<Term>* GetTermData(const Chunk& chunk, const Column* column, size_t index)
+	{
+		if constexpr (IsOptionalTerm<Term>)
+		{
+			if (column == nullptr) { return nullptr; }
+		}
+		return chunk.GetComponentData<TermComponent<Term>>(*column, index);
+	}
+
+	// Gets the rows [begin, begin + count) of a query term's component in a chunk, as a span or as ComponentStreams
+	// for a split component. Empty if the term has no column
+	template<typename Term>
+	static auto GetTermRows(const Chunk& chunk, const Column* column, size_t begin, size_t count)
+	{
+		using Component = TermComponent<Term>;
+		if constexpr (IsSoAComponent<Component>)
+		{
+			if (column == nullptr) { return ComponentStreams<Component>(); }
+			return ComponentStreams<Component>(std::bit_cast<typename ComponentStreams<Component>::Float*>(chunk.GetStreamElement(*column, 0, begin)), column->m_streamStride, count);
+		}
+		else
+		{
+			return std::span<Component>(GetTermData<Term>(chunk, column, begin), column != nullptr ? count : 0);
+		}
+	}
+
+	template<typename... Terms>
+	bool AcquireChunk(const std::array<const Column*, sizeof...(Terms)>& columns, size_t chunkIndex, uint32_t lastRunVersion, uint32_t writeVersion)
+	{
+		return AcquireChunkHelper<Terms...>(columns, chunkIndex, lastRunVersion, writeVersion, std::index_sequence_for<Terms...>{});
+	}
+
+	template<typename... Terms, size_t... Indices>
+	bool AcquireChunkHelper(const std::array<const Column*, sizeof...(Terms)>& columns, size_t chunkIndex, uint32_t lastRunVersion, uint32_t writeVersion, std::index_sequence<Indices...>)
+	{
+		uint32_t* versions = GetChangeVersions(chunkIndex);
+
+		// the filters are checked before marking, so a term can both filter on and write the same component
+		if constexpr ((QueryTermTraits<Terms>::CHANGE_FILTER || ...))
+		{
+			bool changed = ((QueryTermTraits<Terms>::CHANGE_FILTER && versions[columns[Indices]->m_index] > lastRunVersion) || ...);
+			if (!changed) { return false; }
+		}
+
+		// optional components this archetype does not have are not written
+		((IsWriteTerm<Terms> && columns[Indices] != nullptr ? BackupColumn(chunkIndex, columns[Indices]->m_index) : void()), ...);
+		((IsWriteTerm<Terms> && columns[Indices] != nullptr ? void(versions[columns[Indices]->m_index] = writeVersion) : void()), ...);
+		return true;
+	}
+
+	template<typename... Terms, typename Callback, size_t... Indices>
+	void ForEachChunkRangeHelper(Callback& callback, const std::array<const Column*, sizeof...(Terms)>& columns, size_t chunkIndex, size_t begin, size_t end, std::index_sequence<Indices...>)
+	{
+		const Chunk& chunk = m_chunks[chunkIndex];
+		size_t count = end - begin;
+
+		callback(count, std::span<const Entity>(chunk.GetEntities() + begin, count), GetTermRows<Terms>(chunk, columns[Indices], begin, count)...);
+	}
+
+	// Calls the callback for the rows of a chunk starting at begin, up to end or the end of the chunk
+	template<typename... Terms, typename Callback, size_t... Indices>
+	void ForEachHelper(Callback& callback, const std::array<const Column*, sizeof...(Terms)>& columns, size_t chunkIndex, size_t begin, size_t end, std::index_sequence<Indices...>)
+	{
+		// resolve the base pointer of each component array once per chunk
+		const Chunk& chunk = m_chunks[chunkIndex];
+		const Entity* entities = chunk.GetEntities();
+		std::tuple<TermComponent<Terms>*...> componentArrays = { GetTermData<Terms>(chunk, columns[Indices], 0)... };
+
+		// the row of an optional component is masked to 0 when it has no column, so its null base pointer is passed
+		// to every row without a branch
+		std::array<size_t, sizeof...(Terms)> rowMasks = { (columns[Indices] != nullptr ? SIZE_MAX : 0)... };
+
+		// the count is re-read every row so the callback may remove entities from this archetype
+		for (size_t i = begin; i < end && i < m_chunks[chunkIndex].m_count; i++)
+		{
+			callback(entities[i], (std::get<Indices>(componentArrays) + (IsOptionalTerm<Terms> ? i & rowMasks[Indices] : i))...);
+		}
+	}
+};
@@ -0,0 +1,771 @@
+#include "Benchmark.h"
+#include "ECSScene.h"
+#include "Components.h"
+#include "PhysicsHelper.h"
+#include "AABBTree.h"
+#include "BroadPhase.h"
+#include "Terrain.h"
+#include "SceneSnapshot.h"
+#include "IntegratorSystem.h"
+#include "ColliderUpdateSystem.h"
+#include "BroadPhaseUpdateSystem.h"
+#include "NarrowPhaseSystem.h"
+#include "Collision.h"
+#include "RelationCache.h"
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace
+{
+	constexpr unsigned int SPHERE_PILE_SETTLE_FRAMES = 120; // Untimed frames the sphere pile is stepped before timing.
+
+	/**
+	 * @brief Creates a scene with all of the framework components registered.
+	 * @param maxEntities The entity limit of the scene.
+	 */
+	std::unique_ptr<ECSScene> CreateBenchmarkScene(uint32_t maxEntities = DEFAULT_MAX_ENTITIES)
+	{
+		std::unique_ptr<ECSScene> scene = std::make_unique<ECSScene>();
+		scene->Init(maxEntities);
+
+		scene->RegisterComponent<Particle>();
+		scene->RegisterComponent<Transform>();
+		scene->RegisterComponent<RigidBody>();
+		scene->RegisterComponent<Collider>();
+		scene->RegisterComponent<Mesh>();
+		scene->RegisterComponent<Spring>();
+		scene->RegisterComponent<PhysicsMaterial>();
+		scene->RegisterComponent<RenderMaterial>();
+		scene->RegisterComponent<StaticCollider>();
+
+		return scene;
+	}
+
+	/**
+	 * @brief Spawns cubes like SpawnCubes, giving every other cube a physics material and every third cube
+	 * a render material so the entities are spread over several archetypes.
+	 * @return The spawned entities in creation order.
+	 */
+	std::vector<Entity> SpawnMixedCubes(ECSScene& scene, unsigned int entityCount)
+	{
+		std::vector<Entity> entities(entityCount);
+		for (unsigned int i = 0; i < entityCount; i++)
+		{
+			Vector3 position = Vector3((float)(i % 100), (float)(i / 10000), (float)((i / 100) % 100));
+
+			Entity entity = scene.CreateEntity();
+			scene.AddComponent(entity, Transform(position, Quaternion(), Vector3::One));
+			scene.AddComponent(entity, Particle(1.0f));
+			scene.AddComponent(entity, RigidBody(Vector3::One));
+			if (i % 2 == 0) { scene.AddComponent(entity, PhysicsMaterial()); }
+			if (i % 3 == 0) { scene.AddComponent(entity, RenderMaterial{ 0 }); }
+
+			entities[i] = entity;
+		}
+
+		return entities;
+	}
+
+	constexpr unsigned int STARTUP_CLOTH_SIZE = 100; // Rows and columns of the start up benchmark cloth.
+	constexpr uint32_t STARTUP_MAX_ENTITIES = DEFAULT_MAX_ENTITIES + STARTUP_CLOTH_SIZE * STARTUP_CLOTH_SIZE * 7;
+
+	/**
+	 * @brief Builds the start up benchmark scene, the terrain collision and a cloth with every spring type.
+	 */
+	void BuildStartupSceneInto(ECSScene& scene, BroadPhase& broadPhase, Terrain& terrain)
+	{
+		terrain.BuildCollision(&scene, &broadPhase);
+		PhysicsHelper::CreateCloth(scene, broadPhase, Vector3(0.0f, 10.0f, 0.0f), STARTUP_CLOTH_SIZE, STARTUP_CLOTH_SIZE, 0.2f, 1.0f, true, true, true);
+	}
+
+	/**
+	 * @brief Applies the impulse of one spring to the particles at its ends, as NarrowPhaseSystem does.
+	 */
+	void SolveSpring(const Spring& spring, const Transform& e1Transform, Particle& e1Particle, const Transform& e2Transform, Particle& e2Particle)
+	{
+		float totalMass = e1Particle.inverseMass + e2Particle.inverseMass;
+		if (totalMass == 0.0f) { return; }
+
+		Vector3 delta = e2Transform.position - e1Transform.position;
+		float currentLength = delta.magnitude();
+		if (currentLength < EPSILON) { return; }
+
+		Vector3 normal = delta / currentLength;
+		float relVelAlongNormal = Vector3::Dot(e2Particle.linearVelocity - e1Particle.linearVelocity, normal);
+		float force = -spring.stiffness * (currentLength - spring.restLength) - 0.5f * relVelAlongNormal;
+
+		Vector3 impulse = normal * (force / totalMass);
+		e1Particle.ApplyLinearImpulse(-impulse);
+		e2Particle.ApplyLinearImpulse(impulse);
+	}
+
+	/**
+	 * @brief Creates static proxies for the triangles of a square height field of rolling hills, two per cell.
+	 * @param proxyCount The number of triangles, rounded down to fill whole cells.
+	 */
+	std::vector<TreeProxy> CreateHeightFieldProxies(unsigned int proxyCount)
+	{
+		unsigned int side = (unsigned int)std::sqrt(proxyCount / 2.0f);
+		auto getPoint = [](unsigned int x, unsigned int z) {
+			return Vector3((float)x, std::sin(x * 0.3f) * std::cos(z * 0.2f) * 3.0f, (float)z);
+		};
+
+		std::vector<TreeProxy> proxies;
+		proxies.reserve((size_t)side * side * 2);
+		for (unsigned int z = 0; z < side; z++)
+		{
+			for (unsigned int x = 0; x < side; x++)
+			{
+				Vector3 p1 = getPoint(x, z);
+				Vector3 p2 = getPoint(x + 1, z);
+				Vector3 p3 = getPoint(x, z + 1);
+				Vector3 p4 = getPoint(x + 1, z + 1);
+
+				proxies.push_back({ (Entity)proxies.size(), AABB::FromTriangle(p1, p2, p3), true });
+				proxies.push_back({ (Entity)proxies.size(), AABB::FromTriangle(p2, p4, p3), true });
+			}
+		}
+		return proxies;
+	}
+
+	/**
+	 * @brief Fills a tree with proxies, either in one bulk build or one insertion at a time.
+	 */
+	void FillTree(AABBTree& tree, const std::vector<TreeProxy>& proxies, bool bulk)
+	{
+		if (bulk)
+		{
+			tree.Build(proxies);
+			return;
+		}
+
+		for (const TreeProxy& proxy : proxies)
+		{
+			tree.InsertEntity(proxy.entity, proxy.box, proxy.isStatic);
+		}
+	}
+
+	/**
+	 * @brief Creates a scene running the physics systems, without any entities.
+	 * @param maxEntities The entity limit of the scene.
+	 * @param broadPhase The broad phase of the scene's colliders.
+	 * @param debugPoints The contact points written by the narrow phase.
+	 */
+	std::unique_ptr<ECSScene> CreatePhysicsScene(uint32_t maxEntities, BroadPhase& broadPhase, std::vector<Vector3>& debugPoints)
+	{
+		std::unique_ptr<ECSScene> scene = CreateBenchmarkScene(std::max<uint32_t>(maxEntities, DEFAULT_MAX_ENTITIES));
+
+		Collision::Init();
+		scene->RegisterSystem(std::make_unique<IntegratorSystem>());
+		scene->RegisterSystem(std::make_unique<ColliderUpdateSystem>());
+		scene->RegisterSystem(std::make_unique<BroadPhaseUpdateSystem>(broadPhase));
+		scene->RegisterSystem(std::make_unique<NarrowPhaseSystem>(broadPhase, debugPoints));
+
+		return scene;
+	}
+
+	/**
+	 * @brief Sums the durations of a system's samples, in milliseconds.
+	 * @param profiler The profiler holding the samples.
+	 * @param name The name of the system.
+	 * @param samples Scratch storage for the samples.
+	 */
+	double GetSystemMilliseconds(const SystemProfiler& profiler, const char* name, std::vector<SystemSample>& samples)
+	{
+		profiler.CopySamples(samples);
+
+		int64_t nanoseconds = 0;
+		for (const SystemSample& sample : samples)
+		{
+			if (std::strcmp(profiler.GetSystemName(sample.systemIndex), name) == 0)
+			{
+				nanoseconds += sample.durationNanoseconds;
+			}
+		}
+
+		return nanoseconds / 1.0e6;
+	}
+
+	/**
+	 * @brief Creates a scene running the physics systems, with a square grid of cubes resting on a floor. The systems
+	 * have already been updated once, as the first step updates the broad phase for every new collider.
+	 * @param bodyCount The number of dynamic cubes.
+	 * @param broadPhase The broad phase of the scene's colliders.
+	 * @param debugPoints The contact points written by the narrow phase.
+	 */
+	std::unique_ptr<ECSScene> CreateFallingCubesScene(unsigned int bodyCount, BroadPhase& broadPhase, std::vector<Vector3>& debugPoints)
+	{
+		std::unique_ptr<ECSScene> scene = CreatePhysicsScene(bodyCount + 1, broadPhase, debugPoints);
+
+		// a square grid of cubes with gaps between them, the bottom layer resting on the floor
+		unsigned int side = (unsigned int)std::ceil(std::sqrt(bodyCount / 16.0f));
+		PhysicsHelper::CreateCube(*scene, broadPhase, Vector3(0.0f, -0.5f, 0.0f), Vector3(side * 2.0f + 2.0f, 1.0f, side * 2.0f + 2.0f), Quaternion(), -1.0f);
+		for (unsigned int i = 0; i < bodyCount; i++)
+		{
+			Vector3 position = Vector3((i % side) * 2.0f - side, 0.5f + (i / (side * side)) * 2.0f, ((i / side) % side) * 2.0f - side);
+			PhysicsHelper::CreateCube(*scene, broadPhase, position, Vector3::One, Quaternion(), 1.0f);
+		}
+
+		scene->UpdateSystems(FPS60);
+		return scene;
+	}
+}
+
+BenchmarkResult Benchmark::SpawnCubes(unsigned int entityCount)
+{
+	std::unique_ptr<ECSScene> scene = CreateBenchmarkScene(std::max<unsigned int>(entityCount, DEFAULT_MAX_ENTITIES));
+
+	BenchmarkResult result;
+	result.iterations = entityCount;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < entityCount; i++)
+	{
+		Vector3 position = Vector3((float)(i % 100), (float)(i / 10000), (float)((i / 100) % 100));
+		Vector3 size = Vector3::One;
+
+		Entity entity = scene->CreateEntity();
+		scene->AddComponent(entity, Transform(position, Quaternion(), size));
+		scene->AddComponent(entity, Particle(1.0f));
+		scene->AddComponent(entity, RigidBody(Vector3::One));
+		scene->AddComponent(entity, Collider{ OBB(position, size, Quaternion()) });
+		scene->AddComponent(entity, Mesh{ 0 });
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::BuildTerrainCollision(Terrain& terrain)
+{
+	std::unique_ptr<ECSScene> scene = CreateBenchmarkScene();
+	std::unique_ptr<BroadPhase> broadPhase = std::make_unique<BroadPhase>();
+
+	BenchmarkResult result;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	terrain.BuildCollision(scene.get(), broadPhase.get());
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.iterations = scene->GetEntityCount();
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::SpawnCloth(unsigned int rows, unsigned int cols)
+{
+	// each point has at most two structural, two shearing and two bending springs
+	std::unique_ptr<ECSScene> scene = CreateBenchmarkScene(std::max<unsigned int>(rows * cols * 7, DEFAULT_MAX_ENTITIES));
+	std::unique_ptr<BroadPhase> broadPhase = std::make_unique<BroadPhase>();
+
+	BenchmarkResult result;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	PhysicsHelper::CreateCloth(*scene, *broadPhase, Vector3::Zero, rows, cols, 0.2f, 1.0f, true, true, true);
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.iterations = scene->GetEntityCount();
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::RandomGetComponent(unsigned int entityCount, unsigned int lookupCount)
+{
+	std::unique_ptr<ECSScene> scene = CreateBenchmarkScene(std::max<unsigned int>(entityCount, DEFAULT_MAX_ENTITIES));
+	std::vector<Entity> entities = SpawnMixedCubes(*scene, entityCount);
+
+	// pick the entities up front so only the lookups are timed
+	std::mt19937 random(42);
+	std::uniform_int_distribution<size_t> distribution(0, entities.size() - 1);
+	std::vector<Entity> lookups(lookupCount);
+	for (Entity& entity : lookups)
+	{
+		entity = entities[distribution(random)];
+	}
+
+	BenchmarkResult result;
+	result.iterations = lookupCount;
+
+	float checksum = 0.0f;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (Entity entity : lookups)
+	{
+		Transform* transform = scene->GetComponent<Transform>(entity);
+		Particle* particle = scene->GetComponent<Particle>(entity);
+		checksum += transform->position.x + particle->inverseMass;
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	// keep the lookups from being optimised away
+	volatile float sink = checksum;
+	(void)sink;
+
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::DestroyEntities(unsigned int entityCount)
+{
+	std::unique_ptr<ECSScene> scene = CreateBenchmarkScene(std::max<unsigned int>(entityCount, DEFAULT_MAX_ENTITIES));
+	std::vector<Entity> entities = SpawnMixedCubes(*scene, entityCount);
+	std::shuffle(entities.begin(), entities.end(), std::mt19937(42));
+
+	BenchmarkResult result;
+	result.iterations = entityCount;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (Entity entity : entities)
+	{
+		scene->DestroyEntity(entity);
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::BuildStartupScene(Terrain& terrain)
+{
+	std::unique_ptr<ECSScene> scene = CreateBenchmarkScene(STARTUP_MAX_ENTITIES);
+	std::unique_ptr<BroadPhase> broadPhase = std::make_unique<BroadPhase>();
+
+	BenchmarkResult result;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	BuildStartupSceneInto(*scene, *broadPhase, terrain);
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.iterations = scene->GetEntityCount();
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::LoadStartupSnapshot(Terrain& terrain, const std::string& path)
+{
+	BenchmarkResult result;
+
+	{
+		std::unique_ptr<ECSScene> scene = CreateBenchmarkScene(STARTUP_MAX_ENTITIES);
+		std::unique_ptr<BroadPhase> broadPhase = std::make_unique<BroadPhase>();
+		BuildStartupSceneInto(*scene, *broadPhase, terrain);
+
+		if (!SceneSnapshot::Save(path, *scene, *broadPhase)) { return result; }
+	}
+
+	std::unique_ptr<ECSScene> scene = CreateBenchmarkScene(STARTUP_MAX_ENTITIES);
+	std::unique_ptr<BroadPhase> broadPhase = std::make_unique<BroadPhase>();
+
+	// the file was just written, so it is read from the file cache rather than from disk
+	auto start = std::chrono::high_resolution_clock::now();
+	bool loaded = SceneSnapshot::Load(path, *scene, *broadPhase);
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	if (!loaded) { return result; }
+
+	result.iterations = scene->GetEntityCount();
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::RollbackPhysics(unsigned int bodyCount, unsigned int frameCount, unsigned int rollbackSteps)
+{
+	std::unique_ptr<BroadPhase> broadPhase = std::make_unique<BroadPhase>();
+	std::vector<Vector3> debugPoints;
+	std::unique_ptr<ECSScene> scene = CreateFallingCubesScene(bodyCount, *broadPhase, debugPoints);
+
+	BenchmarkResult result;
+	result.iterations = frameCount;
+
+	std::deque<SnapshotID> snapshots;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		if (rollbackSteps > 0)
+		{
+			snapshots.push_back(scene->TakeSnapshot());
+			if (snapshots.size() > rollbackSteps)
+			{
+				scene->ReleaseSnapshot(snapshots.front());
+				snapshots.pop_front();
+			}
+		}
+
+		scene->UpdateSystems(FPS60);
+
+		if (rollbackSteps > 0 && snapshots.size() == rollbackSteps)
+		{
+			// restoring the oldest snapshot drops every snapshot, they are retaken while resimulating
+			scene->RestoreSnapshot(snapshots.front());
+			snapshots.clear();
+
+			for (unsigned int step = 0; step < rollbackSteps; step++)
+			{
+				snapshots.push_back(scene->TakeSnapshot());
+				scene->UpdateSystems(FPS60);
+			}
+		}
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::SolveSprings(unsigned int rows, unsigned int cols, unsigned int passes, bool useRelationCache)
+{
+	std::unique_ptr<ECSScene> scene = CreateBenchmarkScene(std::max<unsigned int>(rows * cols * 7, DEFAULT_MAX_ENTITIES));
+	std::unique_ptr<BroadPhase> broadPhase = std::make_unique<BroadPhase>();
+	PhysicsHelper::CreateCloth(*scene, *broadPhase, Vector3::Zero, rows, cols, 0.2f, 1.0f, true, true, true);
+
+	RelationCache<Spring, const Transform, Particle> springs;
+
+	BenchmarkResult result;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int pass = 0; pass < passes; pass++)
+	{
+		if (useRelationCache)
+		{
+			springs.ForEach(*scene, [&](Entity entity, const Spring* spring, const Transform* e1Transform, Particle* e1Particle, const Transform* e2Transform, Particle* e2Particle) {
+				SolveSpring(*spring, *e1Transform, *e1Particle, *e2Transform, *e2Particle);
+				result.iterations++;
+				});
+		}
+		else
+		{
+			scene->ForEach<const Spring>([&](Entity entity, const Spring* spring) {
+				const Transform* e1Transform = scene->GetComponent<const Transform>(spring->entityA);
+				Particle* e1Particle = scene->GetComponent<Particle>(spring->entityA);
+				const Transform* e2Transform = scene->GetComponent<const Transform>(spring->entityB);
+				Particle* e2Particle = scene->GetComponent<Particle>(spring->entityB);
+				if (e1Transform == nullptr || e1Particle == nullptr || e2Transform == nullptr || e2Particle == nullptr) { return; }
+
+				SolveSpring(*spring, *e1Transform, *e1Particle, *e2Transform, *e2Particle);
+				result.iterations++;
+				});
+		}
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::IntegrateParticles(unsigned int entityCount, unsigned int passes, bool deterministic)
+{
+	std::unique_ptr<ECSScene> scene = CreateBenchmarkScene(std::max<unsigned int>(entityCount, DEFAULT_MAX_ENTITIES));
+	SpawnMixedCubes(*scene, entityCount);
+	scene->ForEach<Particle>([](Entity entity, Particle* particle) {
+		particle->linearVelocity = Vector3(0.0f, -1.0f, 0.0f);
+		});
+
+	ParallelOptions options;
+	options.deterministic = deterministic;
+
+	BenchmarkResult result;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int pass = 0; pass < passes; pass++)
+	{
+		scene->ParallelForEach<const Particle, Transform>([](Entity entity, const Particle* particle, Transform* transform) {
+			transform->position += particle->linearVelocity * FPS60;
+			}, options);
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.iterations = entityCount * passes;
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::ProfilePhysics(unsigned int bodyCount, unsigned int frameCount, const std::string& tracePath)
+{
+	std::unique_ptr<BroadPhase> broadPhase = std::make_unique<BroadPhase>();
+	std::vector<Vector3> debugPoints;
+	std::unique_ptr<ECSScene> scene = CreateFallingCubesScene(bodyCount, *broadPhase, debugPoints);
+
+	SystemProfiler& profiler = scene->GetSystemProfiler();
+	profiler.Clear();
+	profiler.SetEnabled(true);
+
+	BenchmarkResult result;
+	result.iterations = frameCount;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		scene->UpdateSystems(FPS60);
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	if (!tracePath.empty())
+	{
+		profiler.ExportChromeTrace(tracePath);
+	}
+	return result;
+}
+
+BenchmarkResult Benchmark::SpherePile(unsigned int bodyCount, unsigned int frameCount, unsigned int sortInterval)
+{
+	std::unique_ptr<BroadPhase> broadPhase = std::make_unique<BroadPhase>();
+	std::vector<Vector3> debugPoints;
+	std::unique_ptr<ECSScene> scene = CreatePhysicsScene(bodyCount + 1, *broadPhase, debugPoints);
+
+	// spheres fill a column above a floor in shuffled order, so neighbours in space are scattered across the rows
+	// as when bodies are spawned over time
+	unsigned int side = (unsigned int)std::ceil(std::sqrt(bodyCount / 8.0f));
+	std::vector<Vector3> positions;
+	positions.reserve(bodyCount);
+	for (unsigned int i = 0; i < bodyCount; i++)
+	{
+		positions.push_back(Vector3((i % side) * 1.1f - side * 0.55f, 0.5f + (i / (side * side)) * 1.1f, ((i / side) % side) * 1.1f - side * 0.55f));
+	}
+	std::shuffle(positions.begin(), positions.end(), std::mt19937(42));
+
+	PhysicsHelper::CreateCube(*scene, *broadPhase, Vector3(0.0f, -0.5f, 0.0f), Vector3(side * 4.0f, 1.0f, side * 4.0f), Quaternion(), -1.0f);
+	for (const Vector3& position : positions)
+	{
+		PhysicsHelper::CreateSphere(*scene, *broadPhase, position, 0.5f, 1.0f);
+	}
+	// the spheres land and settle into a pile before timing starts
+	for (unsigned int frame = 0; frame < SPHERE_PILE_SETTLE_FRAMES; frame++)
+	{
+		scene->UpdateSystems(FPS60);
+	}
+
+	SystemProfiler& profiler = scene->GetSystemProfiler();
+	profiler.SetEnabled(true);
+	std::vector<SystemSample> samples;
+
+	BenchmarkResult result;
+	result.iterations = frameCount;
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		if (sortInterval > 0 && frame % sortInterval == 0)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			scene->SortRows<Transform>([](const Transform& transform) { return PhysicsHelper::GetMortonCode(transform.position, 1.0f); });
+			auto stop = std::chrono::high_resolution_clock::now();
+
+			result.totalMilliseconds += std::chrono::duration<double, std::milli>(stop - start).count();
+		}
+
+		// the profiler is cleared every frame, so no samples are overwritten however many frames are run
+		profiler.Clear();
+		scene->UpdateSystems(FPS60);
+		result.totalMilliseconds += GetSystemMilliseconds(profiler, "NarrowPhaseSystem", samples);
+	}
+
+	return result;
+}
+
+BenchmarkResult Benchmark::TreeChurn(unsigned int proxyCount, unsigned int frameCount, bool batched)
+{
+	std::unique_ptr<AABBTree> tree = std::make_unique<AABBTree>();
+
+	// unit boxes scattered through a cube 64 times their total volume, each drifting with its own velocity, picked
+	// up front so only the tree is timed
+	float extent = std::cbrt((float)proxyCount) * 2.0f;
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> positionDistribution(-extent, extent);
+	std::uniform_real_distribution<float> velocityDistribution(-0.05f, 0.05f);
+
+	std::vector<Vector3> positions(proxyCount);
+	std::vector<Vector3> velocities(proxyCount);
+	for (unsigned int i = 0; i < proxyCount; i++)
+	{
+		positions[i] = Vector3(positionDistribution(random), positionDistribution(random), positionDistribution(random));
+		velocities[i] = Vector3(velocityDistribution(random), velocityDistribution(random), velocityDistribution(random));
+	}
+
+	// one in a hundred proxies is removed and reinserted each frame, as when bodies are destroyed and spawned
+	unsigned int respawnCount = std::max(proxyCount / 100, 1u);
+	std::uniform_int_distribution<unsigned int> proxyDistribution(0, proxyCount - 1);
+	std::vector<Entity> respawns((size_t)respawnCount * frameCount);
+	for (Entity& entity : respawns)
+	{
+		entity = (Entity)proxyDistribution(random);
+	}
+
+	std::vector<LeafUpdate> updates(proxyCount);
+
+	BenchmarkResult result;
+	result.iterations = proxyCount + (proxyCount + respawnCount * 2) * frameCount;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < proxyCount; i++)
+	{
+		tree->InsertEntity((Entity)i, AABB::FromPositionScale(positions[i], Vector3::One));
+	}
+
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		for (unsigned int i = 0; i < proxyCount; i++)
+		{
+			positions[i] += velocities[i];
+			if (batched)
+			{
+				updates[i].entity = (Entity)i;
+				updates[i].box = AABB::FromPositionScale(positions[i], Vector3::One);
+			}
+			else
+			{
+				tree->UpdatePosition((Entity)i, positions[i]);
+				tree->TriggerUpdate((Entity)i);
+			}
+		}
+
+		if (batched)
+		{
+			tree->UpdateLeaves(updates);
+		}
+
+		for (unsigned int i = 0; i < respawnCount; i++)
+		{
+			Entity entity = respawns[(size_t)frame * respawnCount + i];
+			tree->RemoveEntity(entity);
+			tree->InsertEntity(entity, AABB::FromPositionScale(positions[entity], Vector3::One));
+		}
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::BuildTree(unsigned int proxyCount, bool bulk)
+{
+	std::vector<TreeProxy> proxies = CreateHeightFieldProxies(proxyCount);
+	std::unique_ptr<AABBTree> tree = std::make_unique<AABBTree>();
+
+	BenchmarkResult result;
+	result.iterations = (unsigned int)proxies.size();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	FillTree(*tree, proxies, bulk);
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::QueryTree(unsigned int proxyCount, unsigned int rayCount, bool bulk)
+{
+	std::vector<TreeProxy> proxies = CreateHeightFieldProxies(proxyCount);
+	std::unique_ptr<AABBTree> tree = std::make_unique<AABBTree>();
+	FillTree(*tree, proxies, bulk);
+
+	// rays start above random points of the height field and point steeply down, picked up front so only the
+	// casts are timed
+	float side = std::sqrt(proxyCount / 2.0f);
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> positionDistribution(0.0f, side);
+	std::uniform_real_distribution<float> slopeDistribution(-0.3f, 0.3f);
+	std::vector<Ray> rays;
+	rays.reserve(rayCount);
+	for (unsigned int i = 0; i < rayCount; i++)
+	{
+		Vector3 origin(positionDistribution(random), 10.0f, positionDistribution(random));
+		rays.emplace_back(origin, Vector3(slopeDistribution(random), -1.0f, slopeDistribution(random)).normalized());
+	}
+
+	BenchmarkResult result;
+	result.iterations = rayCount;
+
+	Entity checksum = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (const Ray& ray : rays)
+	{
+		float distance;
+		checksum += tree->Intersect(ray, distance);
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	// keep the casts from being optimised away
+	volatile Entity sink = checksum;
+	(void)sink;
+
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
+
+BenchmarkResult Benchmark::FindPairs(unsigned int staticCount, unsigned int dynamicCount, unsigned int frameCount, bool splitTrees)
+{
+	std::vector<TreeProxy> proxies = CreateHeightFieldProxies(staticCount);
+	Entity firstDynamic = (Entity)proxies.size();
+
+	// unit boxes drifting through the hills, some touching the triangles, picked up front so only the broad phase
+	// is timed
+	float side = std::sqrt(staticCount / 2.0f);
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> positionDistribution(0.0f, side);
+	std::uniform_real_distribution<float> heightDistribution(-3.0f, 5.0f);
+	std::uniform_real_distribution<float> velocityDistribution(-0.05f, 0.05f);
+
+	std::vector<Vector3> positions(dynamicCount);
+	std::vector<Vector3> velocities(dynamicCount);
+	for (unsigned int i = 0; i < dynamicCount; i++)
+	{
+		positions[i] = Vector3(positionDistribution(random), heightDistribution(random), positionDistribution(random));
+		velocities[i] = Vector3(velocityDistribution(random), velocityDistribution(random), velocityDistribution(random));
+		proxies.push_back({ firstDynamic + i, AABB::FromPositionScale(positions[i], Vector3::One), false });
+	}
+
+	std::unique_ptr<AABBTree> tree = std::make_unique<AABBTree>();
+	std::unique_ptr<BroadPhase> broadPhase = std::make_unique<BroadPhase>();
+
+	// the first pair update finds the pairs of every new proxy, which is start up work and is not timed
+	size_t pairCount = 0;
+	if (splitTrees)
+	{
+		broadPhase->Build(proxies);
+		pairCount += broadPhase->GetPotentialIntersections().size();
+	}
+	else
+	{
+		tree->Build(proxies);
+		pairCount += tree->GetPotentialIntersections().size();
+	}
+
+	std::vector<LeafUpdate> updates(dynamicCount);
+
+	BenchmarkResult result;
+	result.iterations = frameCount;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		for (unsigned int i = 0; i < dynamicCount; i++)
+		{
+			positions[i] += velocities[i];
+			updates[i].entity = firstDynamic + i;
+			updates[i].box = AABB::FromPositionScale(positions[i], Vector3::One);
+		}
+
+		if (splitTrees)
+		{
+			broadPhase->UpdateLeaves(updates);
+			pairCount += broadPhase->GetPotentialIntersections().size();
+		}
+		else
+		{
+			tree->UpdateLeaves(updates);
+			pairCount += tree->GetPotentialIntersections().size();
+		}
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	// keep the pair finding from being optimised away
+	volatile size_t sink = pairCount;
+	(void)sink;
+
+	result.totalMilliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+	return result;
+}
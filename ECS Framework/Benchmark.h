@@ -0,0 +1,188 @@
+// Headless benchmarks for the ECS and physics framework.
+// Each benchmark builds its own scene so it can be run at any point without
+// disturbing the application's scene.
+
+#pragma once
+#include <string>
+
+class Terrain;
+
+/**
+ * @struct BenchmarkResult
+ * @brief Timing information returned from a benchmark run.
+ */
+struct BenchmarkResult
+{
+	unsigned int iterations = 0; // The number of operations that were timed.
+	double totalMilliseconds = 0.0; // The total wall time of the timed section.
+
+	/**
+	 * @brief Gets the throughput of the benchmark.
+	 * @return The number of operations completed per second.
+	 */
+	double GetOperationsPerSecond() const
+	{
+		return totalMilliseconds > 0.0 ? iterations / (totalMilliseconds / 1000.0) : 0.0;
+	}
+};
+
+/**
+ * @class Benchmark
+ * @brief Collection of self contained benchmarks that can be run from the application or a headless build.
+ */
+class Benchmark
+{
+public:
+	/**
+	 * @brief Times spawning entities with the same component set as PhysicsHelper::CreateCube, one component at a time.
+	 * @param entityCount The number of entities to spawn.
+	 * @return The time taken to spawn every entity.
+	 */
+	static BenchmarkResult SpawnCubes(unsigned int entityCount);
+
+	/**
+	 * @brief Times building the collision entities and AABB tree leaves of a terrain into an empty scene.
+	 * @param terrain An initialised terrain.
+	 * @return The time taken, with one iteration per triangle.
+	 */
+	static BenchmarkResult BuildTerrainCollision(Terrain& terrain);
+
+	/**
+	 * @brief Times spawning a cloth with every spring type through PhysicsHelper::CreateCloth into an empty scene.
+	 * @param rows The number of rows of points in the cloth.
+	 * @param cols The number of columns of points in the cloth.
+	 * @return The time taken, with one iteration per spawned entity.
+	 */
+	static BenchmarkResult SpawnCloth(unsigned int rows, unsigned int cols);
+
+	/**
+	 * @brief Times GetComponent calls on randomly chosen entities spread over several archetypes, the access
+	 * pattern of the collision solver.
+	 * @param entityCount The number of entities in the scene.
+	 * @param lookupCount The number of lookups to time.
+	 * @return The time taken, with one iteration per lookup.
+	 */
+	static BenchmarkResult RandomGetComponent(unsigned int entityCount, unsigned int lookupCount);
+
+	/**
+	 * @brief Times destroying every entity of a scene in random order.
+	 * @param entityCount The number of entities to create and then destroy.
+	 * @return The time taken, with one iteration per destroyed entity.
+	 */
+	static BenchmarkResult DestroyEntities(unsigned int entityCount);
+
+	/**
+	 * @brief Times building the start up scene procedurally, the terrain collision and a 100x100 cloth with every
+	 * spring type, into an empty scene.
+	 * @param terrain An initialised terrain.
+	 * @return The time taken, with one iteration per spawned entity.
+	 */
+	static BenchmarkResult BuildStartupScene(Terrain& terrain);
+
+	/**
+	 * @brief Builds the same scene as BuildStartupScene and saves a snapshot of it, then times loading the snapshot
+	 * into an empty scene and AABB tree.
+	 * @param terrain An initialised terrain.
+	 * @param path The path the snapshot is written to.
+	 * @return The time taken, with one iteration per loaded entity, or no iterations if the snapshot failed.
+	 */
+	static BenchmarkResult LoadStartupSnapshot(Terrain& terrain, const std::string& path);
+
+	/**
+	 * @brief Times stepping the physics systems on a scene of falling cubes resting on a floor at 60 Hz. With
+	 * rollback enabled, a snapshot is kept for each of the last rollback steps frames, and after every frame the
+	 * scene is rolled back to the oldest one and resimulated to the present, as when a late input arrives.
+	 * @param bodyCount The number of dynamic cubes.
+	 * @param frameCount The number of frames to time.
+	 * @param rollbackSteps The number of frames rolled back and resimulated every frame, 0 to step without snapshots.
+	 * @return The time taken, with one iteration per frame.
+	 */
+	static BenchmarkResult RollbackPhysics(unsigned int bodyCount, unsigned int frameCount, unsigned int rollbackSteps);
+
+	/**
+	 * @brief Times solving the springs of a cloth the way NarrowPhaseSystem does, either resolving both ends of every
+	 * spring through GetComponent or through a RelationCache.
+	 * @param rows The number of rows of points in the cloth.
+	 * @param cols The number of columns of points in the cloth.
+	 * @param passes The number of passes over every spring.
+	 * @param useRelationCache True to iterate the springs through a RelationCache, false to look up both ends.
+	 * @return The time taken, with one iteration per spring solved.
+	 */
+	static BenchmarkResult SolveSprings(unsigned int rows, unsigned int cols, unsigned int passes, bool useRelationCache);
+
+	/**
+	 * @brief Times moving the particles of a scene of cubes by their velocity with ParallelForEach, either letting
+	 * idle threads steal ranges or pinning every range to a fixed lane with ParallelOptions::deterministic.
+	 * @param entityCount The number of cubes in the scene.
+	 * @param passes The number of passes over every particle.
+	 * @param deterministic True to pin the ranges to fixed lanes, false to let them be stolen.
+	 * @return The time taken, with one iteration per particle moved.
+	 */
+	static BenchmarkResult IntegrateParticles(unsigned int entityCount, unsigned int passes, bool deterministic);
+
+	/**
+	 * @brief Times stepping the physics systems on the same scene as RollbackPhysics with the system profiler
+	 * recording, and exports the per-system samples as a Chrome trace. Needs no window, so it can profile a
+	 * headless run.
+	 * @param bodyCount The number of dynamic cubes.
+	 * @param frameCount The number of frames to time.
+	 * @param tracePath The path of the trace file to write, empty to skip the export.
+	 * @return The time taken, with one iteration per frame.
+	 */
+	static BenchmarkResult ProfilePhysics(unsigned int bodyCount, unsigned int frameCount, const std::string& tracePath);
+
+	/**
+	 * @brief Times the narrow phase and collision solver on a pile of spheres resting on a floor, spawned in
+	 * shuffled order so that bodies touching in space are scattered across the archetype rows. The pile is left
+	 * to settle before timing starts. With sorting enabled, the rows are periodically reordered by the Morton code
+	 * of their position and the sorting time is included in the result.
+	 * @param bodyCount The number of dynamic spheres.
+	 * @param frameCount The number of frames to step.
+	 * @param sortInterval The number of frames between sorts of the rows, 0 to never sort.
+	 * @return The time taken by NarrowPhaseSystem and the sorts, with one iteration per frame.
+	 */
+	static BenchmarkResult SpherePile(unsigned int bodyCount, unsigned int frameCount, unsigned int sortInterval);
+
+	/**
+	 * @brief Times the churn an AABB tree sees from moving bodies: inserting every proxy, then each frame moving
+	 * every proxy and removing and reinserting a few of them. Proxies that leave their enlarged box are reinserted
+	 * by the tree, so most frames free and allocate nodes throughout the pool.
+	 * @param proxyCount The number of proxies in the tree.
+	 * @param frameCount The number of frames of updates.
+	 * @param batched True to move the proxies of a frame with one UpdateLeaves call, false to move each one with
+	 * UpdatePosition and TriggerUpdate.
+	 * @return The time taken, with one iteration per insert, update and removal.
+	 */
+	static BenchmarkResult TreeChurn(unsigned int proxyCount, unsigned int frameCount, bool batched);
+
+	/**
+	 * @brief Times building an AABB tree over the triangles of a generated height field, as the terrain's
+	 * collision is built on start up.
+	 * @param proxyCount The number of triangles.
+	 * @param bulk True to build the tree with AABBTree::Build, false to insert the triangles one by one.
+	 * @return The time taken, with one iteration per triangle.
+	 */
+	static BenchmarkResult BuildTree(unsigned int proxyCount, bool bulk);
+
+	/**
+	 * @brief Times ray casts against an AABB tree built over the same height field as BuildTree, measuring the
+	 * query cost of the tree each build produces.
+	 * @param proxyCount The number of triangles.
+	 * @param rayCount The number of rays cast down onto the height field.
+	 * @param bulk True to build the tree with AABBTree::Build, false to insert the triangles one by one.
+	 * @return The time taken by the ray casts, with one iteration per ray.
+	 */
+	static BenchmarkResult QueryTree(unsigned int proxyCount, unsigned int rayCount, bool bulk);
+
+	/**
+	 * @brief Times finding the overlapping pairs of unit boxes drifting over the same height field as BuildTree, as
+	 * bodies moving over the terrain. Each frame moves every box with one batched update, then finds the pairs.
+	 * @param staticCount The number of triangles.
+	 * @param dynamicCount The number of moving boxes.
+	 * @param frameCount The number of frames of updates.
+	 * @param splitTrees True to keep the triangles and boxes in the separate trees of a BroadPhase, false to keep
+	 * them all in one AABBTree that finds its pairs by traversing itself.
+	 * @return The time taken by the updates and pair finding, with one iteration per frame.
+	 */
+	static BenchmarkResult FindPairs(unsigned int staticCount, unsigned int dynamicCount, unsigned int frameCount, bool splitTrees);
+};
@@ -0,0 +1,164 @@
+#include "BroadPhase.h"
+#include <algorithm>
+
+namespace
+{
+	bool IsSameBox(const AABB& a, const AABB& b)
+	{
+		return a.GetLowerBound() == b.GetLowerBound() && a.GetUpperBound() == b.GetUpperBound();
+	}
+}
+
+void BroadPhase::InsertEntity(Entity entity, AABB box, bool isStatic)
+{
+	(isStatic ? m_staticTree : m_dynamicTree).InsertEntity(entity, box, isStatic);
+	MarkMoved(entity);
+}
+
+void BroadPhase::RemoveEntity(Entity entity)
+{
+	if (m_dynamicTree.Contains(entity))
+	{
+		m_dynamicTree.RemoveEntity(entity);
+	}
+	else if (m_staticTree.Contains(entity))
+	{
+		m_staticTree.RemoveEntity(entity);
+	}
+	else
+	{
+		return;
+	}
+
+	// the pairs of a removed entity are dropped by the next pair update, like those of a moved one
+	MarkMoved(entity);
+}
+
+void BroadPhase::Build(std::span<const TreeProxy> proxies)
+{
+	std::vector<TreeProxy> staticProxies;
+	std::vector<TreeProxy> dynamicProxies;
+	for (const TreeProxy& proxy : proxies)
+	{
+		(proxy.isStatic ? staticProxies : dynamicProxies).push_back(proxy);
+		MarkMoved(proxy.entity);
+	}
+
+	bool hasStaticLeaves = m_staticTree.GetRootIndex() != NULL_NODE_INDEX;
+	m_staticTree.Build(staticProxies);
+	if (hasStaticLeaves && !staticProxies.empty())
+	{
+		m_staticTree.Rebuild();
+	}
+
+	m_dynamicTree.Build(dynamicProxies);
+}
+
+void BroadPhase::Rebuild()
+{
+	m_staticTree.Rebuild();
+	m_dynamicTree.Rebuild();
+}
+
+void BroadPhase::UpdateLeaves(std::span<const LeafUpdate> updates)
+{
+	// static colliders share chunks with moving ones, so most of their updates repeat the box they already have
+	// and are skipped. Dynamic leaves whose box is unchanged keep their pairs too
+	for (const LeafUpdate& update : updates)
+	{
+		if (m_dynamicTree.Contains(update.entity))
+		{
+			const AABB& box = m_dynamicTree.GetNodeFromEntity(update.entity).box;
+			if (update.keepSize ? box.GetPosition() != update.box.GetPosition() : !IsSameBox(box, update.box))
+			{
+				MarkMoved(update.entity);
+			}
+			continue;
+		}
+
+		if (!m_staticTree.Contains(update.entity)) { continue; }
+
+		AABB box = m_staticTree.GetNodeFromEntity(update.entity).box;
+		if (update.keepSize)
+		{
+			// a point has no extent, so a static point is only moved once it leaves its box
+			if (AABB::Overlap(box, update.box)) { continue; }
+			box.UpdatePosition(update.box.GetPosition());
+		}
+		else
+		{
+			if (IsSameBox(box, update.box)) { continue; }
+			box = update.box;
+		}
+
+		m_staticTree.RemoveEntity(update.entity);
+		m_staticTree.InsertEntity(update.entity, box, true);
+		MarkMoved(update.entity);
+	}
+
+	// static entities are not in the dynamic tree, so it skips them
+	m_dynamicTree.UpdateLeaves(updates);
+}
+
+Entity BroadPhase::Intersect(const Ray& ray, float& closestDistance) const
+{
+	Entity closestEntity = m_dynamicTree.Intersect(ray, closestDistance);
+
+	float staticDistance;
+	Entity staticEntity = m_staticTree.Intersect(ray, staticDistance);
+	if (staticDistance < closestDistance)
+	{
+		closestDistance = staticDistance;
+		closestEntity = staticEntity;
+	}
+
+	return closestEntity;
+}
+
+const std::vector<std::pair<Entity, Entity>>& BroadPhase::GetPotentialIntersections()
+{
+	// pairs whose entities both stayed put still overlap, every other pair is found again by the queries below. An
+	// entity index in the move buffer drops the pairs of any handle with that index, including removed ones
+	std::erase_if(m_pairs, [this](const std::pair<Entity, Entity>& pair) {
+		return m_movedEntityAtIndex.Get(pair.first) != INVALID_ENTITY || m_movedEntityAtIndex.Get(pair.second) != INVALID_ENTITY;
+		});
+
+	for (Entity entity : m_movedEntities)
+	{
+		// a pair of two moved entities is found from both sides, so only the smaller entity adds it
+		auto addPair = [&](const Node& leaf) {
+			if (leaf.entity == entity) { return; }
+			if (leaf.entity < entity && m_movedEntityAtIndex.Get(leaf.entity) == leaf.entity) { return; }
+
+			m_pairs.emplace_back(entity, leaf.entity);
+			};
+
+		if (m_dynamicTree.Contains(entity))
+		{
+			AABB box = m_dynamicTree.GetNodeFromEntity(entity).box;
+			m_staticTree.Query(box, addPair);
+			m_dynamicTree.Query(box, addPair);
+		}
+		else if (m_staticTree.Contains(entity))
+		{
+			// static entities never pair with each other, so the static tree is not queried
+			m_dynamicTree.Query(m_staticTree.GetNodeFromEntity(entity).box, addPair);
+		}
+	}
+
+	for (Entity entity : m_movedEntities)
+	{
+		m_movedEntityAtIndex.Erase(entity);
+	}
+	m_movedEntities.clear();
+
+	return m_pairs;
+}
+
+void BroadPhase::MarkMoved(Entity entity)
+{
+	if (m_movedEntityAtIndex.Get(entity) == entity) { return; }
+
+	m_movedEntityAtIndex.Set(entity, entity);
+	m_movedEntities.push_back(entity);
+}
@@ -0,0 +1,97 @@
+// Physics broad phase, finding the pairs of colliders whose boxes overlap.
+//
+// Static colliders, such as terrain triangles and immovable boxes, live in a tree of their own that is built once
+// and never refitted, while every other collider lives in a dynamic tree. The overlapping pairs are kept between
+// updates and only the proxies that moved since the last update are queried, a moved dynamic proxy against both
+// trees and a moved static proxy against the dynamic tree, so the static region is never traversed on its own.
+
+#pragma once
+#ifndef BROAD_PHASE_H_
+#define BROAD_PHASE_H_
+
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "Definitions.h"
+#include "PagedSparseMap.h"
+#include "AABBTree.h"
+
+/**
+ * @class BroadPhase
+ * @brief Keeps the static and dynamic AABB trees of a scene's colliders and the pairs of leaves that overlap.
+ * Whether an entity is static is decided when it is inserted.
+ */
+class BroadPhase
+{
+public:
+	/**
+	 * @brief Creates a leaf for an entity in the static or dynamic tree.
+	 * @param entity The ECS entity to insert.
+	 * @param box The bounding box of the entity's collider.
+	 * @param isStatic True to insert the entity in the static tree.
+	 */
+	void InsertEntity(Entity entity, AABB box, bool isStatic = false);
+
+	/**
+	 * @brief Removes an entity's leaf from whichever tree holds it. Entities not in either tree are skipped.
+	 */
+	void RemoveEntity(Entity entity);
+
+	/**
+	 * @brief Inserts many entities at once with AABBTree::Build. When static proxies are added to a static tree that
+	 * already has leaves, the static tree is rebuilt whole, as its quality only ever comes from how it was built.
+	 * @param proxies The entity and box of every new leaf. The entities must not already be in either tree.
+	 */
+	void Build(std::span<const TreeProxy> proxies);
+
+	/**
+	 * @brief Rebuilds both trees from the current boxes of their leaves, see AABBTree::Rebuild.
+	 */
+	void Rebuild();
+
+	/**
+	 * @brief Updates the boxes of many leaves at once. Dynamic leaves are updated in one batch with
+	 * AABBTree::UpdateLeaves. A static leaf is only touched when its collider was really moved, such as when it
+	 * is first placed, and is then reinserted rather than refitted. Entities not in either tree are skipped.
+	 * @param updates The new box of each leaf. An entity should appear at most once.
+	 */
+	void UpdateLeaves(std::span<const LeafUpdate> updates);
+
+	/**
+	 * @brief Finds the closest leaf of either tree hit by a ray. Read only, like AABBTree::Intersect.
+	 * @param ray The ray to cast.
+	 * @param closestDistance Set to the distance along the ray of the closest hit, FLT_MAX if nothing is hit.
+	 * @return The entity of the closest hit, INVALID_ENTITY if nothing is hit.
+	 */
+	Entity Intersect(const Ray& ray, float& closestDistance) const;
+
+	/**
+	 * @brief Updates the overlapping pairs for the proxies inserted, moved or removed since the last call. Pairs
+	 * between two static entities are never reported.
+	 * @return Every pair of entities whose leaf boxes overlap, each pair once. Invalidated by the next call.
+	 */
+	const std::vector<std::pair<Entity, Entity>>& GetPotentialIntersections();
+
+	bool Contains(Entity entity) const { return m_staticTree.Contains(entity) || m_dynamicTree.Contains(entity); }
+
+	const AABBTree& GetStaticTree() const { return m_staticTree; }
+	const AABBTree& GetDynamicTree() const { return m_dynamicTree; }
+
+private:
+	friend class SceneSnapshot; // Saves and restores both trees directly.
+
+	/**
+	 * @brief Adds an entity to the move buffer, so its pairs are found again by the next pair update.
+	 */
+	void MarkMoved(Entity entity);
+
+	AABBTree m_staticTree; // Leaves of static entities, never refitted.
+	AABBTree m_dynamicTree; // Leaves of every other entity.
+
+	std::vector<Entity> m_movedEntities; // Entities inserted, moved or removed since the last pair update.
+	PagedSparseMap<Entity, INVALID_ENTITY> m_movedEntityAtIndex; // Entity in the move buffer at each entity index.
+	std::vector<std::pair<Entity, Entity>> m_pairs; // Overlapping pairs as of the last pair update.
+};
+
+#endif // BROAD_PHASE_H_
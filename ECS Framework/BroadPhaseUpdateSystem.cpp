@@ -1,37 +1,60 @@
 #include "BroadPhaseUpdateSystem.h"
 #include "Components.h"
 #include "ECSScene.h"
-#include "AABBTree.h"
+#include "BroadPhase.h"
+
+void BroadPhaseUpdateSystem::DeclareAccess(SystemAccess& access)
+{
+    access.Read<Transform>();
+    access.Read<Collider>();
+    access.WriteResource(&m_broadPhase);
+}
 
 void BroadPhaseUpdateSystem::Update(ECSScene& scene, float dt)
 {
-    // aabb update
-    scene.ForEach<Transform, Collider>([&](Entity entity, Transform* transform, Collider* collider) {
-        std::visit([&](auto& specificCollider) {
+    // aabb update, only for colliders updated since the last broad phase update
+    m_leafUpdates.clear();
+    scene.ForEach<Changed<const Collider>, With<Transform>>([&](Entity entity, const Collider* collider) {
+        LeafUpdate update;
+        update.entity = entity;
+
+        bool hasBox = std::visit([&](const auto& specificCollider) {
             using T = std::decay_t<decltype(specificCollider)>;
 
             if constexpr (std::is_same_v<T, Sphere>)
             {
-                m_aabbTree.UpdatePosition(entity, specificCollider.GetCenter());
-                m_aabbTree.UpdateScale(entity, Vector3::One * 2.0f * specificCollider.GetRadius());
+                update.box = AABB::FromPositionScale(specificCollider.GetCenter(), Vector3::One * 2.0f * specificCollider.GetRadius());
+                return true;
             }
             else if constexpr (std::is_same_v<T, OBB>)
             {
-                AABB aabb = specificCollider.ToAABB();
-                m_aabbTree.UpdatePosition(entity, aabb.GetPosition());
-                m_aabbTree.UpdateScale(entity, aabb.GetSize());
+                update.box = specificCollider.ToAABB();
+                return true;
             }
             else if constexpr (std::is_same_v<T, AABB>)
             {
-                m_aabbTree.UpdatePosition(entity, specificCollider.GetPosition());
-                m_aabbTree.UpdateScale(entity, specificCollider.GetSize());
+                update.box = specificCollider;
+                return true;
             }
             else if constexpr (std::is_same_v<T, Point>)
             {
-                m_aabbTree.UpdatePosition(entity, specificCollider.GetPosition());
+                // points have no extent, so the leaf keeps the size it was inserted with
+                update.box = AABB(specificCollider.GetPosition(), specificCollider.GetPosition());
+                update.keepSize = true;
+                return true;
+            }
+            else
+            {
+                return false;
             }
             }, collider->collider);
 
-        m_aabbTree.TriggerUpdate(entity);
+        if (hasBox)
+        {
+            m_leafUpdates.push_back(update);
+        }
         });
+
+    // moved leaves are refitted together, so ancestors shared by many leaves are refitted once
+    m_broadPhase.UpdateLeaves(m_leafUpdates);
 }
@@ -1,16 +1,20 @@
 #pragma once
-#include "System.h"
+#include <vector>
 
-class AABBTree;
+#include "System.h"
+#include "BroadPhase.h"
 
 class BroadPhaseUpdateSystem : public System
 {
 public:
-	BroadPhaseUpdateSystem(AABBTree& tree) : m_aabbTree(tree) {}
+	BroadPhaseUpdateSystem(BroadPhase& broadPhase) : m_broadPhase(broadPhase) {}
 
 	void Update(ECSScene& scene, float dt) final override;
+	void DeclareAccess(SystemAccess& access) final override;
+	const char* GetName() const final override { return "BroadPhaseUpdateSystem"; }
 
 private:
-	AABBTree& m_aabbTree;
+	BroadPhase& m_broadPhase;
+	std::vector<LeafUpdate> m_leafUpdates; // Leaf boxes gathered each update, applied to the broad phase in one batch.
 };
 
@@ -0,0 +1,74 @@
+#pragma once
+#ifndef CHANGE_VERSION_H_
+#define CHANGE_VERSION_H_
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @struct ChangeContext
+ * @brief The change versions of the code running on a thread. Component data written by the thread is stamped with
+ * the write version, and Changed query terms match data stamped after the last run version.
+ */
+struct ChangeContext
+{
+	uint32_t writeVersion = 0; // Version stamped on written data, 0 to use the current global version.
+	uint32_t lastRunVersion = 0; // Write version of the running system's previous update, 0 to treat all data as changed.
+};
+
+/**
+ * @class ChangeVersion
+ * @brief Monotonic version counter used to track which component data has changed. Every system update takes the
+ * next version as its write version, so data written by a system is newer than the previous update of every system
+ * that started before it. Code running outside of a system stamps the current version, which is newer than the
+ * write version of every system that has already started.
+ */
+class ChangeVersion
+{
+public:
+	/**
+	 * @brief Gets the version to stamp on data written by the calling thread.
+	 */
+	static uint32_t GetWriteVersion()
+	{
+		return t_context.writeVersion != 0 ? t_context.writeVersion : s_version.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Gets the version data must be newer than to count as changed for the calling thread.
+	 */
+	static uint32_t GetLastRunVersion() { return t_context.lastRunVersion; }
+
+	static const ChangeContext& GetContext() { return t_context; }
+
+	/**
+	 * @brief Takes the next version, used as the write version of a system update.
+	 */
+	static uint32_t Next()
+	{
+		return s_version.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @class Scope
+	 * @brief Sets the change context of the calling thread until the scope ends. Scopes nest, as a thread waiting on
+	 * jobs may run another system's update.
+	 */
+	class Scope
+	{
+	public:
+		explicit Scope(const ChangeContext& context) : m_previous(t_context) { t_context = context; }
+		~Scope() { t_context = m_previous; }
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		ChangeContext m_previous; // Context restored when the scope ends.
+	};
+
+private:
+	inline static std::atomic<uint32_t> s_version = 1; // Current version, 0 is reserved for never changed.
+	inline static thread_local ChangeContext t_context; // Change context of the calling thread.
+};
+
+#endif // CHANGE_VERSION_H_
@@ -1,8 +1,15 @@
 #include "ColliderUpdateSystem.h"
 
+void ColliderUpdateSystem::DeclareAccess(SystemAccess& access)
+{
+    access.Read<Transform>();
+    access.Write<Collider>();
+}
+
 void ColliderUpdateSystem::Update(ECSScene& scene, float dt)
 {
-    scene.ForEach<Transform, Collider>([](Entity entity, Transform* transform, Collider* collider)
+    // only chunks with moved transforms are updated, and archetypes of static colliders such as the terrain are never visited
+    scene.ParallelForEach<Changed<const Transform>, Collider, Without<StaticCollider>>([](Entity entity, const Transform* transform, Collider* collider)
         {
             std::visit([transform, collider](auto& specificCollider) {
                 using T = std::decay_t<decltype(specificCollider)>;
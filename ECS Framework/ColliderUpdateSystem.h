@@ -6,4 +6,6 @@ class ColliderUpdateSystem : public System
 {
 public:
 	void Update(ECSScene& scene, float dt) final override;
+	void DeclareAccess(SystemAccess& access) final override;
+	const char* GetName() const final override { return "ColliderUpdateSystem"; }
 };
\ No newline at end of file
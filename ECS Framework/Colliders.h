@@ -142,7 +142,7 @@ public:
 		m_axes[2] = rotation * Vector3::Forward;
 	}
 
-	inline AABB ToAABB()
+	inline AABB ToAABB() const
 	{
 		Vector3 absExtent = Vector3(
 			fabsf(m_axes[0].x) * m_halfExtents.x + fabsf(m_axes[1].x) * m_halfExtents.y + fabsf(m_axes[2].x) * m_halfExtents.z,
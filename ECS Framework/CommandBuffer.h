@@ -0,0 +1,180 @@
+#pragma once
+#ifndef COMMAND_BUFFER_H_
+#define COMMAND_BUFFER_H_
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+#include "Definitions.h"
+#include "ComponentID.h"
+
+/**
+ * @struct PendingEntity
+ * @brief Handle to an entity created through a command buffer. The entity only exists once the buffer is played back,
+ * and is not created if the scene's entity limit is reached by then, in which case its commands are skipped.
+ */
+struct PendingEntity
+{
+	uint32_t index; // Index into the owning buffer's list of created entities.
+};
+
+enum class CommandType : uint8_t
+{
+	DESTROY_ENTITY,
+	ADD_COMPONENT,
+	REMOVE_COMPONENT
+};
+
+/**
+ * @struct Command
+ * @brief A single recorded structural change.
+ */
+struct Command
+{
+	CommandType type;
+	ComponentType componentType = INVALID_COMPONENT_TYPE; // Component added or removed. Component commands only.
+	Entity entity = INVALID_ENTITY; // Target entity, INVALID_ENTITY when targeting a pending entity.
+	uint32_t pendingIndex = 0; // Index of the pending entity when entity is INVALID_ENTITY.
+	size_t dataOffset = 0; // Offset of the component data in the buffer's data. Add commands only.
+};
+
+/**
+ * @class CommandBuffer
+ * @brief Records structural changes so they can be applied later in a single batch. Systems record into the
+ * command buffer of the thread they run on, and the scene plays every buffer back at a sync point, where no
+ * system is iterating the archetypes being changed. Buffers are cache line aligned as neighbouring
+ * buffers are recorded into by different threads.
+ */
+class alignas(64) CommandBuffer
+{
+public:
+	/**
+	 * @brief Records the creation of an entity.
+	 * @return A handle that can be used to add components to the entity in this buffer.
+	 */
+	PendingEntity CreateEntity()
+	{
+		return { m_pendingEntityCount++ };
+	}
+
+	/**
+	 * @brief Records the destruction of an entity. Destroying an entity more than once is allowed.
+	 * @param entity The identifier of the entity to destroy.
+	 */
+	void DestroyEntity(Entity entity)
+	{
+		Command command;
+		command.type = CommandType::DESTROY_ENTITY;
+		command.entity = entity;
+		m_commands.push_back(command);
+	}
+
+	/**
+	 * @brief Records adding a component to an entity. If the entity already has the component when the
+	 * buffer is played back, the component's data is overwritten instead.
+	 * @param entity The identifier of the entity.
+	 * @param component The component data, copied into the buffer.
+	 */
+	template <typename T>
+	void AddComponent(Entity entity, const T& component)
+	{
+		RecordAdd(entity, 0, GetComponentID<T>(), &component, sizeof(T));
+	}
+
+	template <typename T>
+	void AddComponent(PendingEntity entity, const T& component)
+	{
+		RecordAdd(INVALID_ENTITY, entity.index, GetComponentID<T>(), &component, sizeof(T));
+	}
+
+	/**
+	 * @brief Records removing a component from an entity. Removing a component the entity does not have
+	 * when the buffer is played back does nothing.
+	 * @param entity The identifier of the entity.
+	 */
+	template <typename T>
+	void RemoveComponent(Entity entity)
+	{
+		Command command;
+		command.type = CommandType::REMOVE_COMPONENT;
+		command.componentType = GetComponentID<T>();
+		command.entity = entity;
+		m_commands.push_back(command);
+	}
+
+	/**
+	 * @brief Checks if the buffer has anything to play back.
+	 */
+	bool IsEmpty() const { return m_commands.empty() && m_pendingEntityCount == 0; }
+
+	/**
+	 * @brief Clears the recorded commands, keeping the allocated memory for reuse.
+	 */
+	void Clear()
+	{
+		m_commands.clear();
+		m_data.clear();
+		m_createdEntities.clear();
+		m_pendingEntityCount = 0;
+	}
+
+	/**
+	 * @brief Frees the memory kept for reuse by Clear. Only frees memory once the buffer has been played back.
+	 */
+	void ShrinkToFit()
+	{
+		m_commands.shrink_to_fit();
+		m_data.shrink_to_fit();
+		m_createdEntities.shrink_to_fit();
+	}
+
+	const std::vector<Command>& GetCommands() const { return m_commands; }
+	const void* GetData(size_t offset) const { return m_data.data() + offset; }
+	uint32_t GetPendingEntityCount() const { return m_pendingEntityCount; }
+
+	/**
+	 * @brief Gets the entity a command targets, resolving pending entities once they have been created.
+	 */
+	Entity GetTarget(const Command& command) const
+	{
+		return command.entity != INVALID_ENTITY ? command.entity : m_createdEntities[command.pendingIndex];
+	}
+
+	/**
+	 * @brief Gets the real entities of the pending entities, in creation order. Filled in during play back.
+	 */
+	std::vector<Entity>& GetCreatedEntities() { return m_createdEntities; }
+
+	/**
+	 * @brief Gets the bytes allocated by the buffer, which keeps its capacity between frames.
+	 */
+	size_t GetAllocatedBytes() const
+	{
+		return m_commands.capacity() * sizeof(Command) + m_data.capacity() + m_createdEntities.capacity() * sizeof(Entity);
+	}
+
+private:
+	std::vector<Command> m_commands; // Recorded commands in recording order.
+	std::vector<char> m_data; // Component data of the add commands.
+	std::vector<Entity> m_createdEntities; // Real entities of the pending entities, filled in during play back.
+	uint32_t m_pendingEntityCount = 0; // Number of entities created through this buffer.
+
+	void RecordAdd(Entity entity, uint32_t pendingIndex, ComponentType componentType, const void* data, size_t size)
+	{
+		// keep every component aligned for the copy out of the buffer
+		size_t offset = (m_data.size() + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+		m_data.resize(offset + size);
+		std::memcpy(m_data.data() + offset, data, size);
+
+		Command command;
+		command.type = CommandType::ADD_COMPONENT;
+		command.componentType = componentType;
+		command.entity = entity;
+		command.pendingIndex = pendingIndex;
+		command.dataOffset = offset;
+		m_commands.push_back(command);
+	}
+};
+
+#endif // COMMAND_BUFFER_H_
@@ -0,0 +1,111 @@
+// Compile time component type IDs.
+//
+// Every component type is given a fixed ID with the ECS_COMPONENT macro next to its definition.
+// IDs are constants, so signatures of component sets are built at compile time and looking up a
+// component's column is a constant index.
+
+#pragma once
+#ifndef COMPONENT_ID_H_
+#define COMPONENT_ID_H_
+#include <type_traits>
+
+#include "Definitions.h"
+
+/**
+ * @struct ComponentID
+ * @brief Holds the ID of a component type, specialised for each component with ECS_COMPONENT.
+ */
+template <typename T>
+struct ComponentID
+{
+	static_assert(!std::is_same_v<T, T>, "Component type has no ID, declare it with ECS_COMPONENT.");
+};
+
+/**
+ * @brief Declares the ID of a component type. Must be used at global scope, and every component type
+ * registered in the same scene needs a different ID below MAX_COMPONENT_TYPES.
+ */
+#define ECS_COMPONENT(Type, ID) \
+	template <> \
+	struct ComponentID<Type> \
+	{ \
+		static_assert((ID) < MAX_COMPONENT_TYPES, "Component ID out of range."); \
+		static constexpr ComponentType value = (ID); \
+	}
+
+/**
+ * @struct ComponentLayout
+ * @brief Describes how archetypes store a component type. Components are stored whole, one after another, unless
+ * they opt into a split layout with ECS_SOA_COMPONENT.
+ */
+template <typename T>
+struct ComponentLayout
+{
+	static constexpr size_t STREAM_COUNT = 0; // Number of float streams the component is split into, 0 when stored whole.
+};
+
+/**
+ * @brief Declares that a component type made only of floats is split into one stream per float inside archetype
+ * chunks, such as separate x, y and z streams for a Vector3 member, so systems can run vector loops over a field
+ * without loading the rest of the component. Split components have no per row pointer, systems access them through
+ * the ComponentStreams passed to chunk callbacks, or copy them with ECSScene::ReadComponent and WriteComponent.
+ * Must be used at global scope.
+ */
+#define ECS_SOA_COMPONENT(Type) \
+	template <> \
+	struct ComponentLayout<Type> \
+	{ \
+		static_assert(std::is_trivially_copyable_v<Type> && sizeof(Type) % sizeof(float) == 0, "Split components must be made of floats."); \
+		static constexpr size_t STREAM_COUNT = sizeof(Type) / sizeof(float); \
+	}
+
+/**
+ * @brief Checks if a component type is split into float streams, see ECS_SOA_COMPONENT.
+ */
+template <typename T>
+constexpr bool IsSoAComponent = ComponentLayout<std::remove_cv_t<T>>::STREAM_COUNT > 0;
+
+/**
+ * @brief Gets the ID of a component type.
+ */
+template <typename T>
+constexpr ComponentType GetComponentID()
+{
+	return ComponentID<std::remove_cv_t<T>>::value;
+}
+
+/**
+ * @brief Builds the signature of a set of component types at compile time.
+ */
+template <typename... Components>
+constexpr Signature MakeSignature()
+{
+	Signature signature;
+	(signature.set(GetComponentID<Components>()), ...);
+	return signature;
+}
+
+/**
+ * @struct RelationTraits
+ * @brief Describes a relation component, a component linking its entity to two target entities, specialised for
+ * each relation with ECS_RELATION.
+ */
+template <typename T>
+struct RelationTraits
+{
+	static_assert(!std::is_same_v<T, T>, "Component type is not a relation, declare it with ECS_RELATION.");
+};
+
+/**
+ * @brief Declares a component type as a relation between the entities held in two of its members, so it can be
+ * iterated with a RelationCache. Must be used at global scope.
+ */
+#define ECS_RELATION(Type, TargetA, TargetB) \
+	template <> \
+	struct RelationTraits<Type> \
+	{ \
+		static Entity GetTargetA(const Type& relation) { return relation.TargetA; } \
+		static Entity GetTargetB(const Type& relation) { return relation.TargetB; } \
+	}
+
+#endif // COMPONENT_ID_H_
@@ -7,20 +7,49 @@
 #include <typeindex>
 #include <unordered_map>
 #include <array>
+#include <algorithm>
+#include <atomic>
 
 #include "SparseSet.h"
 #include "Definitions.h"
 #include "Archetype.h"
-#include "TypeIDGenerator.h"
+#include "MemoryReport.h"
+#include "Query.h"
+#include "ComponentID.h"
 
 struct SignatureHash
 {
 	std::size_t operator()(const Signature& sig) const
 	{
-		return sig.to_ullong();
+		return sig.Hash();
 	}
 };
 
+/**
+ * @struct ComponentWrite
+ * @brief Component data to copy into an entity's row after it has changed archetype.
+ */
+struct ComponentWrite
+{
+	ComponentType type;
+	const void* data;
+};
+
+/**
+ * @struct EntityChange
+ * @brief A change of an entity's component set, applied in a single move between archetypes.
+ */
+struct EntityChange
+{
+	Entity entity;
+	Signature oldSignature;
+	Signature newSignature;
+	size_t firstWrite; // First component write of the entity.
+	size_t lastWrite; // One past the last component write of the entity.
+	Archetype* source = nullptr;
+	Archetype* destination = nullptr;
+};
+
 /**
  * @class ComponentManager
  * @brief Manager class that manages all the components in the engine.
@@ -29,11 +58,15 @@ class ComponentManager
 {
 public:
 	/**
-	 * @brief Default constructor
+	 * @brief Constructor.
+	 * @param locations The location record of every entity, indexed by entity index. Archetypes keep the
+	 * records of their entities up to date.
 	 */
-	ComponentManager()
+	ComponentManager(std::vector<EntityLocation>& locations) : m_locations(locations)
 	{
 		m_componentSizes = { 0 };
+		m_componentStreamCounts = { 0 };
+		m_rootArchetype = std::make_unique<Archetype>(Signature(), m_componentSizes, m_componentStreamCounts, m_locations, m_snapshotEpoch);
 	}
 
 	/**
@@ -43,10 +76,11 @@ public:
 	template <typename T>
 	void RegisterComponent()
 	{
-		std::size_t typeIndex = GetTypeIndex<T>();
+		std::size_t typeIndex = GetComponentID<T>();
 		assert(m_componentSizes[typeIndex] == 0 && "Component has already been registered.");
 
 		m_componentSizes[typeIndex] = sizeof(T);
+		m_componentStreamCounts[typeIndex] = ComponentLayout<T>::STREAM_COUNT;
 	}
 
 	/**
@@ -54,137 +88,528 @@ public:
 	 * @return The ComponentType index of the provided component.
 	 */
 	template <typename T>
-	ComponentType GetComponentType()
+	constexpr ComponentType GetComponentType() const
 	{
-		return (ComponentType)GetTypeIndex<T>();
+		return GetComponentID<T>();
 	}
 
 	/**
-	 * @brief Adds a component to an entity. It does this by copying the entities component data from its
-	 * previous archetype (if applicable), adding on the new component data and inserting it into the new archetype.
+	 * @brief Adds a component to an entity. The entity is moved along the archetype graph edge for the
+	 * component type, copying its existing component data directly into the new archetype's columns.
 	 * @param entity The identifier of the entity to add the component to.
-	 * @param signature The current signature of the entity.
 	 * @param component The data of the component being added.
 	 * @return The new signature of the entity.
 	 */
 	template <typename T>
-	Signature AddComponent(Entity entity, Signature signature, T component)
+	Signature AddComponent(Entity entity, const T& component)
 	{
-		Signature oldSignature = signature;
+		m_structureVersion++;
 
-		// update signature with new component
 		ComponentType newComponentType = GetComponentType<T>();
-		signature.set(newComponentType);
-		
-		// check if the new signatures archetype already exists
-		// TODO: this check should be done using the "Archetype Graph (3/14)" suggested in the ECS #3 article
-		std::shared_ptr<Archetype> newArchetype;
-		if (m_archetypes.find(signature) != m_archetypes.end())
+
+		Archetype* oldArchetype = GetEntityArchetype(entity);
+		Archetype* newArchetype = GetArchetypeWith(oldArchetype, newComponentType);
+
+		// entities without any components are not stored, so there is nothing to move
+		size_t row = oldArchetype == m_rootArchetype.get() ? newArchetype->AddEntity(entity) : oldArchetype->MoveEntity(entity, *newArchetype);
+		newArchetype->SetComponent(newComponentType, row, &component);
+
+		return newArchetype->GetSignature();
+	}
+
+	/**
+	 * @brief Removes a component from an entity. The entity is moved along the archetype graph edge for the
+	 * component type, dropping the removed component's data.
+	 * @param entity The identifier of the entity to remove the component from.
+	 * @return The new signature of the entity.
+	 */
+	template <typename T>
+	Signature RemoveComponent(Entity entity)
+	{
+		m_structureVersion++;
+
+		ComponentType removedComponentType = GetComponentType<T>();
+
+		Archetype* oldArchetype = GetEntityArchetype(entity);
+		Archetype* newArchetype = GetArchetypeWithout(oldArchetype, removedComponentType);
+
+		// confirm the entity still has any components left
+		if (newArchetype == m_rootArchetype.get())
 		{
-			newArchetype = m_archetypes[signature];
+			oldArchetype->RemoveEntity(entity);
 		}
 		else
 		{
-			// create a new archetype with this signature
-			newArchetype = std::make_shared<Archetype>(signature, m_componentSizes);
-			m_archetypes[signature] = newArchetype;
+			oldArchetype->MoveEntity(entity, *newArchetype);
 		}
 
-		std::vector<ComponentData> componentData;
+		return newArchetype->GetSignature();
+	}
+
+	/**
+	 * @brief Adds new entities straight into the archetype of their full component set. The rows are
+	 * reserved once and each component array is copied into its column a chunk at a time.
+	 * @param signature The signature of the component set, which must match the given component types.
+	 * @param entities The identifiers of the entities, none of which may have components yet.
+	 * @param components One array per component type, holding the data of every entity in order.
+	 */
+	template <typename... Components>
+	void AddEntities(Signature signature, const std::vector<Entity>& entities, const std::vector<Components>&... components)
+	{
+		m_structureVersion++;
+
+		assert(((components.size() == entities.size()) && ...) && "Every component array needs one element per entity.");
+
+		Archetype* archetype = GetArchetype(signature);
+		size_t firstRow = archetype->AddEntities(entities.data(), entities.size());
+
+		(archetype->SetComponents(GetComponentType<Components>(), firstRow, components.data(), entities.size()), ...);
+	}
+
+	/**
+	 * @brief Adds new entities straight into the archetype of their full component set from raw component data.
+	 * @param signature The signature of the component set.
+	 * @param entities The identifiers of the entities, none of which may have components yet.
+	 * @param count The number of entities.
+	 * @param components One array per component type in the signature, in ascending component type order, each
+	 * holding the data of every entity in order.
+	 */
+	void AddEntities(Signature signature, const Entity* entities, size_t count, const void* const* components)
+	{
+		m_structureVersion++;
+
+		Archetype* archetype = GetArchetype(signature);
+		size_t firstRow = archetype->AddEntities(entities, count);
 
-		// check if the entity had a component before
-		// if they did, then their data needs to be transferred over
-		if (oldSignature.any())
+		const std::vector<ComponentType>& types = archetype->GetComponentTypes();
+		for (size_t i = 0; i < types.size(); i++)
 		{
-			std::shared_ptr<Archetype> oldArchetype = m_archetypes[oldSignature];
-			componentData = oldArchetype->GetComponentData(entity);
-			oldArchetype->RemoveEntity(entity);
+			archetype->SetComponents(types[i], firstRow, components[i], count);
 		}
+	}
+
+	/**
+	 * @brief Gets the size in bytes of a component type, 0 if it has not been registered.
+	 */
+	size_t GetComponentSize(ComponentType type) const { return m_componentSizes[type]; }
 
-		const ComponentData newComponentData = { newComponentType, &component };
-		componentData.push_back(newComponentData);
+	/**
+	 * @brief Gets every archetype other than the root, in creation order.
+	 */
+	const std::vector<std::unique_ptr<Archetype>>& GetArchetypes() const { return m_archetypeStorage; }
 
-		newArchetype->AddEntity(entity, componentData);
+	/**
+	 * @brief Gets a component of an entity directly from its location record.
+	 * @param entity The identifier of the entity, which must have the component.
+	 * @return A pointer to the component data.
+	 */
+	template <typename T>
+	T* GetComponent(Entity entity)
+	{
+		const EntityLocation& location = m_locations[GetEntityIndex(entity)];
+		return location.archetype->GetComponentAtRow<T>(location.row);
+	}
 
-		return signature;
+	/**
+	 * @brief Copies a component out of an entity, which works for split components as well.
+	 * @param entity The identifier of the entity, which must have the component.
+	 * @return A copy of the component data.
+	 */
+	template <typename T>
+	T ReadComponent(Entity entity) const
+	{
+		const EntityLocation& location = m_locations[GetEntityIndex(entity)];
+		return location.archetype->LoadComponentAtRow<T>(location.row);
 	}
 
+	/**
+	 * @brief Overwrites a component of an entity and marks it as changed, which works for split components as well.
+	 * @param entity The identifier of the entity, which must have the component.
+	 * @param component The new data of the component.
+	 */
 	template <typename T>
-	void RemoveComponent(Entity entity, Signature signature)
+	void WriteComponent(Entity entity, const T& component)
 	{
-		Signature oldSignature = signature;
+		const EntityLocation& location = m_locations[GetEntityIndex(entity)];
+		location.archetype->SetComponent(GetComponentID<T>(), location.row, &component);
+	}
 
-		// update signature with new component
-		ComponentType removedComponentType = GetComponentType<T>();
-		signature.set(removedComponentType, false);
+	/**
+	 * @brief Allocates storage in the archetype with the given signature so that it can hold the given
+	 * number of entities without allocating.
+	 * @param signature The signature of the archetype.
+	 * @param entityCount The number of entities the archetype should be able to hold.
+	 */
+	void Reserve(Signature signature, size_t entityCount)
+	{
+		GetArchetype(signature)->Reserve(entityCount);
+	}
 
-		// get component data and remove entity from old archetype
-		std::vector<ComponentData> componentData;
-		std::shared_ptr<Archetype> oldArchetype = m_archetypes[oldSignature];
-		componentData = oldArchetype->GetComponentData(entity);
-		oldArchetype->RemoveEntity(entity);
+	/**
+	 * @brief Creates a persistent query over every archetype containing the required components and none of the
+	 * excluded ones. The query is kept up to date as new archetypes are created and lives as long as the component
+	 * manager.
+	 * @param signature The components required by the query.
+	 * @param excluded The components excluded by the query.
+	 * @return A pointer to the query.
+	 */
+	Query* CreateQuery(Signature signature, Signature excluded = Signature())
+	{
+		std::unique_ptr<Query>& query = m_queries.emplace_back(std::make_unique<Query>(signature, excluded));
 
-		// confirm the entity still has any components left
-		if (signature.any())
+		for (const std::unique_ptr<Archetype>& archetype : m_archetypeStorage)
 		{
-			// check if the new signatures archetype already exists
-			std::shared_ptr<Archetype> newArchetype;
-			if (m_archetypes.find(signature) != m_archetypes.end())
+			if (query->Matches(archetype->GetSignature()))
 			{
-				newArchetype = m_archetypes[signature];
+				query->AddArchetype(archetype.get());
+			}
+		}
+
+		return query.get();
+	}
+
+	/**
+	 * @brief Applies a batch of component set changes. Each entity is moved straight from its old archetype
+	 * to its new one, however many components were added or removed, and the entities are grouped by
+	 * archetype so every destination archetype grows once for the whole batch.
+	 * @param changes The changes to apply, in ascending entity order, reordered by archetype.
+	 * @param writes The component data referenced by the changes.
+	 */
+	void ApplyChanges(std::vector<EntityChange>& changes, const std::vector<ComponentWrite>& writes)
+	{
+		m_structureVersion++;
+
+		for (EntityChange& change : changes)
+		{
+			change.source = GetArchetype(change.oldSignature);
+			change.destination = GetArchetype(change.newSignature);
+		}
+
+		// archetypes are grouped by signature rather than by address, and the stable sort keeps the entities of each
+		// group in entity order, so the rows they land in are the same on every run
+		std::stable_sort(changes.begin(), changes.end(), [](const EntityChange& a, const EntityChange& b) {
+			return a.newSignature != b.newSignature ? a.newSignature < b.newSignature : a.oldSignature < b.oldSignature;
+			});
+
+		for (size_t i = 0; i < changes.size(); i++)
+		{
+			EntityChange& change = changes[i];
+			Archetype* destination = change.destination;
+
+			// grow the destination once for every entity moving into it, entities left without components are not stored
+			if (destination != m_rootArchetype.get() && (i == 0 || changes[i - 1].destination != destination))
+			{
+				size_t incoming = 0;
+				for (size_t j = i; j < changes.size() && changes[j].destination == destination; j++)
+				{
+					incoming += changes[j].source != destination ? 1 : 0;
+				}
+				destination->Reserve(destination->GetEntityCount() + incoming);
+			}
+
+			if (destination == m_rootArchetype.get())
+			{
+				change.source->RemoveEntity(change.entity);
+				continue;
+			}
+
+			size_t row;
+			if (change.source == destination)
+			{
+				row = destination->GetRow(change.entity);
+			}
+			else if (change.source == m_rootArchetype.get())
+			{
+				row = destination->AddEntity(change.entity);
 			}
 			else
 			{
-				// create a new archetype with this signature
-				newArchetype = std::make_shared<Archetype>(signature, m_componentSizes);
-				m_archetypes[signature] = newArchetype;
+				row = change.source->MoveEntity(change.entity, *destination);
 			}
 
-			std::erase_if(componentData, [removedComponentType](ComponentData compData) { return compData.type == removedComponentType; });
+			for (size_t w = change.firstWrite; w < change.lastWrite; w++)
+			{
+				destination->SetComponent(writes[w].type, row, writes[w].data);
+			}
+		}
+	}
 
-			newArchetype->AddEntity(entity, componentData);
+	/**
+	 * @brief Takes a copy on write snapshot of every archetype. Nothing is copied until a column of a chunk is
+	 * first written, when the rows it held at the snapshot are backed up.
+	 * @return The identifier of the snapshot, newer snapshots have higher identifiers.
+	 */
+	SnapshotID TakeSnapshot()
+	{
+		SnapshotID snapshot = m_nextSnapshot++;
+		m_snapshots.push_back(snapshot);
+		m_snapshotEpoch.store(snapshot, std::memory_order_relaxed);
+		return snapshot;
+	}
+
+	/**
+	 * @brief Restores every archetype to a snapshot, copying back only the columns written since it was taken.
+	 * The snapshot and every newer snapshot are dropped, older snapshots can still be restored.
+	 * @param snapshot The identifier of a snapshot that has not been dropped.
+	 */
+	void RestoreSnapshot(SnapshotID snapshot)
+	{
+		m_structureVersion++;
+
+		assert(std::find(m_snapshots.begin(), m_snapshots.end(), snapshot) != m_snapshots.end() && "Snapshot does not exist.");
+
+		// nothing is backed up while the backups are copied back
+		m_snapshotEpoch.store(0, std::memory_order_relaxed);
+		for (const std::unique_ptr<Archetype>& archetype : m_archetypeStorage)
+		{
+			archetype->RestoreSnapshot(snapshot);
 		}
 
-		return signature;
+		m_snapshots.erase(std::find(m_snapshots.begin(), m_snapshots.end(), snapshot), m_snapshots.end());
+		m_snapshotEpoch.store(GetNewestSnapshot(), std::memory_order_relaxed);
 	}
 
-	template <typename T>
-	T* GetComponent(Entity entity, Signature signature)
+	/**
+	 * @brief Drops a snapshot and every older snapshot, freeing the columns only they needed.
+	 * @param snapshot The identifier of the newest snapshot to drop.
+	 */
+	void ReleaseSnapshot(SnapshotID snapshot)
 	{
-		std::shared_ptr<Archetype> archetype = m_archetypes[signature];
-		return archetype->GetComponent<T>(entity);
+		for (const std::unique_ptr<Archetype>& archetype : m_archetypeStorage)
+		{
+			archetype->ReleaseSnapshots(snapshot);
+		}
+
+		m_snapshots.erase(m_snapshots.begin(), std::upper_bound(m_snapshots.begin(), m_snapshots.end(), snapshot));
+		m_snapshotEpoch.store(GetNewestSnapshot(), std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Gets the newest snapshot that can be restored, INVALID_SNAPSHOT if there are none.
+	 */
+	SnapshotID GetNewestSnapshot() const
+	{
+		return m_snapshots.empty() ? INVALID_SNAPSHOT : m_snapshots.back();
 	}
 
-	std::vector<std::shared_ptr<Archetype>> GetArchetypes(Signature signature)
+	/**
+	 * @brief Gets a counter incremented by every change that adds, removes or moves rows, so code caching where
+	 * components are stored can tell when its cache is stale.
+	 */
+	uint32_t GetStructureVersion() const { return m_structureVersion; }
+
+	/**
+	 * @brief Reorders the rows of archetypes by a key computed from one of their components, so entities with close
+	 * keys are stored close together. Must not be called while entities are being iterated.
+	 * @tparam T The component the keys are computed from, every archetype must contain it.
+	 * @param archetypes The archetypes to sort.
+	 * @param key A callback method that takes a const T& and returns its uint64_t sort key.
+	 * @return The number of archetypes whose rows moved.
+	 */
+	template<typename T, typename KeyFunction>
+	size_t SortRows(const std::vector<Archetype*>& archetypes, KeyFunction&& key)
 	{
-		std::vector<std::shared_ptr<Archetype>> archetypes;
-		for (const auto& pair : m_archetypes)
+		size_t sortedCount = 0;
+		std::vector<uint64_t> keys;
+		for (Archetype* archetype : archetypes)
 		{
-			if ((pair.first & signature) == signature)
+			keys.clear();
+			keys.reserve(archetype->GetEntityCount());
+
+			const std::vector<Chunk>& chunks = archetype->GetChunks();
+			for (size_t chunkIndex = 0; chunkIndex < chunks.size() && chunks[chunkIndex].m_count > 0; chunkIndex++)
 			{
-				archetypes.push_back(pair.second);
+				const T* components = static_cast<const T*>(archetype->GetColumnData(chunkIndex, GetComponentID<T>()));
+				for (size_t i = 0; i < chunks[chunkIndex].m_count; i++)
+				{
+					keys.push_back(key(components[i]));
+				}
 			}
+
+			if (archetype->SortRows(keys)) { sortedCount++; }
 		}
 
-		return archetypes;
+		// rows cached by entity, such as by relation caches, have moved
+		if (sortedCount > 0) { m_structureVersion++; }
+		return sortedCount;
 	}
 
-	void EntityDestroyed(Entity entity)
+	/**
+	 * @brief Frees the empty chunks and unused metadata capacity of every archetype, then frees every archetype
+	 * without entities. Empty archetypes are kept while snapshots can be restored, as they hold the backups needed
+	 * to restore them. Must not be called while entities are being iterated.
+	 * @return The number of archetypes freed.
+	 */
+	size_t Compact()
 	{
-		for (const auto& pair : m_archetypes)
+		m_structureVersion++;
+
+		for (const std::unique_ptr<Archetype>& archetype : m_archetypeStorage)
+		{
+			archetype->Compact();
+		}
+
+		if (!m_snapshots.empty()) { return 0; }
+
+		std::vector<Archetype*> removed;
+		for (const std::unique_ptr<Archetype>& archetype : m_archetypeStorage)
+		{
+			if (archetype->GetEntityCount() == 0) { removed.push_back(archetype.get()); }
+		}
+
+		if (removed.empty()) { return 0; }
+
+		// unlink the archetypes from the map, the queries and the graph before freeing them
+		std::sort(removed.begin(), removed.end());
+		for (Archetype* archetype : removed)
+		{
+			m_archetypes.erase(archetype->GetSignature());
+			for (const std::unique_ptr<Query>& query : m_queries)
+			{
+				if (query->Matches(archetype->GetSignature())) { query->RemoveArchetype(archetype); }
+			}
+		}
+
+		m_rootArchetype->ClearEdgesTo(removed);
+		std::erase_if(m_archetypeStorage, [](const std::unique_ptr<Archetype>& archetype) { return archetype->GetEntityCount() == 0; });
+		for (const std::unique_ptr<Archetype>& archetype : m_archetypeStorage)
 		{
-			pair.second->RemoveEntity(entity);
+			archetype->ClearEdgesTo(removed);
 		}
+
+		m_archetypeStorage.shrink_to_fit();
+		return removed.size();
+	}
+
+	/**
+	 * @brief Adds the memory of the archetypes, the archetype map and the queries to a report.
+	 * @param report The report to fill in.
+	 */
+	void GetMemoryReport(SceneMemoryReport& report) const
+	{
+		for (const std::unique_ptr<Archetype>& archetype : m_archetypeStorage)
+		{
+			report.archetypes.push_back(archetype->GetMemoryReport());
+			if (archetype->GetEntityCount() == 0) { report.emptyArchetypeCount++; }
+		}
+
+		// each map node holds its element and a next pointer, and the cached hash on most implementations
+		report.archetypeMapBytes = m_archetypes.bucket_count() * sizeof(void*)
+			+ m_archetypes.size() * (sizeof(std::pair<const Signature, Archetype*>) + 2 * sizeof(void*))
+			+ m_archetypeStorage.capacity() * sizeof(std::unique_ptr<Archetype>) + m_rootArchetype->GetMemoryReport().GetTotalBytes();
+
+		report.queryBytes = m_queries.capacity() * sizeof(std::unique_ptr<Query>);
+		for (const std::unique_ptr<Query>& query : m_queries)
+		{
+			report.queryBytes += sizeof(Query) + query->GetArchetypes().capacity() * sizeof(Archetype*) + query->GetScratchBytes();
+		}
+	}
+
+	/**
+	 * @brief Removes an entity's components from the archetype it is stored in.
+	 * @param entity The identifier of the entity.
+	 */
+	void EntityDestroyed(Entity entity)
+	{
+		m_structureVersion++;
+		GetEntityArchetype(entity)->RemoveEntity(entity);
 	}
 
 private:
 	std::array<size_t, MAX_COMPONENT_TYPES> m_componentSizes;
-	std::unordered_map<Signature, std::shared_ptr<Archetype>, SignatureHash> m_archetypes;
+	std::array<size_t, MAX_COMPONENT_TYPES> m_componentStreamCounts; // Number of float streams of each split component type, 0 for types stored whole.
+	std::unordered_map<Signature, Archetype*, SignatureHash> m_archetypes;
+	std::vector<std::unique_ptr<Archetype>> m_archetypeStorage; // Owns every archetype in creation order.
+	std::unique_ptr<Archetype> m_rootArchetype; // Empty archetype at the root of the archetype graph, it never stores entities.
+	std::vector<std::unique_ptr<Query>> m_queries;
+	std::vector<EntityLocation>& m_locations; // Location record of every entity, owned by the entity manager.
+	std::atomic<uint32_t> m_snapshotEpoch = INVALID_SNAPSHOT; // Newest snapshot, read by the archetypes when backing up columns.
+	std::vector<SnapshotID> m_snapshots; // Snapshots that can be restored, oldest first.
+	SnapshotID m_nextSnapshot = 1;
+	uint32_t m_structureVersion = 0; // Incremented by every change that adds, removes or moves rows.
 
-	template <typename T>
-	size_t GetTypeIndex()
+	/**
+	 * @brief Gets the archetype an entity is stored in.
+	 * @return A pointer to the archetype, or the root archetype if the entity has no components.
+	 */
+	Archetype* GetEntityArchetype(Entity entity)
+	{
+		Archetype* archetype = m_locations[GetEntityIndex(entity)].archetype;
+		return archetype != nullptr ? archetype : m_rootArchetype.get();
+	}
+
+	/**
+	 * @brief Gets the archetype with the given signature, creating it if it does not exist yet.
+	 * @param signature The signature of the archetype.
+	 * @return A pointer to the archetype. The empty signature returns the root archetype.
+	 */
+	Archetype* GetArchetype(Signature signature)
+	{
+		if (signature.none())
+		{
+			return m_rootArchetype.get();
+		}
+
+		Archetype*& archetype = m_archetypes[signature];
+		if (archetype == nullptr)
+		{
+			archetype = m_archetypeStorage.emplace_back(std::make_unique<Archetype>(signature, m_componentSizes, m_componentStreamCounts, m_locations, m_snapshotEpoch)).get();
+
+			// register the new archetype with every query that matches it
+			for (const std::unique_ptr<Query>& query : m_queries)
+			{
+				if (query->Matches(signature))
+				{
+					query->AddArchetype(archetype);
+				}
+			}
+		}
+
+		return archetype;
+	}
+
+	/**
+	 * @brief Follows the add edge of an archetype, creating and caching the edge the first time it is used.
+	 * @param archetype The archetype to start from.
+	 * @param type The component type being added.
+	 * @return The archetype with the signature of the given archetype plus the component type.
+	 */
+	Archetype* GetArchetypeWith(Archetype* archetype, ComponentType type)
+	{
+		Archetype* next = archetype->GetAddEdge(type);
+		if (next == nullptr)
+		{
+			Signature signature = archetype->GetSignature();
+			signature.set(type);
+
+			next = GetArchetype(signature);
+			archetype->SetAddEdge(type, next);
+			next->SetRemoveEdge(type, archetype);
+		}
+
+		return next;
+	}
+
+	/**
+	 * @brief Follows the remove edge of an archetype, creating and caching the edge the first time it is used.
+	 * @param archetype The archetype to start from.
+	 * @param type The component type being removed.
+	 * @return The archetype with the signature of the given archetype minus the component type.
+	 */
+	Archetype* GetArchetypeWithout(Archetype* archetype, ComponentType type)
 	{
-		return TypeIndexGenerator::GetTypeIndex<T>();
+		Archetype* previous = archetype->GetRemoveEdge(type);
+		if (previous == nullptr)
+		{
+			Signature signature = archetype->GetSignature();
+			signature.reset(type);
+
+			previous = GetArchetype(signature);
+			archetype->SetRemoveEdge(type, previous);
+			previous->SetAddEdge(type, archetype);
+		}
+
+		return previous;
 	}
 };
 
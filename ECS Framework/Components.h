@@ -4,6 +4,7 @@
 #include "Matrix3.h"
 #include "Colliders.h"
 #include "Definitions.h"
+#include "ComponentID.h"
 #include <variant>
 
 struct Transform
@@ -90,4 +91,22 @@ struct Spring
 	Entity entityB;
 	float restLength;
 	float stiffness;
-};
\ No newline at end of file
+};
+
+// Tag of colliders that never move, such as the terrain triangles.
+struct StaticCollider {};
+
+ECS_COMPONENT(Transform, 0);
+ECS_COMPONENT(Particle, 1);
+ECS_COMPONENT(RigidBody, 2);
+ECS_COMPONENT(RenderMaterial, 3);
+ECS_COMPONENT(PhysicsMaterial, 4);
+ECS_COMPONENT(Mesh, 5);
+ECS_COMPONENT(Collider, 6);
+ECS_COMPONENT(Spring, 7);
+ECS_COMPONENT(StaticCollider, 8);
+
+// Rigid bodies are split into float streams for the vectorised angular integration.
+ECS_SOA_COMPONENT(RigidBody);
+
+ECS_RELATION(Spring, entityA, entityB);
@@ -19,10 +19,21 @@
 #include "NarrowPhaseSystem.h"
 #include "PhysicsHelper.h"
 #include "MaterialManager.h"
+#include "Benchmark.h"
+#include "SceneSnapshot.h"
 #include <chrono>
 
 #define ThrowIfFailed(x)  if (FAILED(x)) { throw new std::bad_exception;}
 
+constexpr const char* SCENE_SNAPSHOT_PATH = "scene.snapshot"; // Saved from the Benchmarks window and loaded on start up when present.
+constexpr const char* SYSTEM_TRACE_PATH = "systems.trace.json"; // Written from the Application Stats window, opened with Perfetto or chrome://tracing.
+constexpr double KILOBYTE = 1024.0;
+constexpr double MEGABYTE = 1024.0 * 1024.0;
+constexpr unsigned int ROW_SORT_INTERVAL = 60; // Physics steps between spatial sorts of the archetype rows, when enabled.
+constexpr float ROW_SORT_CELL_SIZE = 1.0f; // Grid cell size of the Morton codes rows are sorted by, about the size of a body.
+constexpr unsigned int TREE_QUALITY_SAMPLE_INTERVAL = 60; // Physics steps between samples of the AABB tree's quality.
+constexpr size_t TREE_QUALITY_HISTORY_SIZE = 300; // Samples of the AABB tree's quality charted, five minutes of physics steps.
+
 Ray DX11App::GetRayFromScreenPosition(int x, int y)
 {
     // get inverted camera matrices
@@ -289,28 +300,38 @@ HRESULT DX11App::Init()
     m_scene.RegisterComponent<Spring>();
     m_scene.RegisterComponent<PhysicsMaterial>();
     m_scene.RegisterComponent<RenderMaterial>();
+    m_scene.RegisterComponent<StaticCollider>();
     
     m_scene.RegisterSystem(std::move(std::make_unique<IntegratorSystem>()));
     m_scene.RegisterSystem(std::move(std::make_unique<ColliderUpdateSystem>()));
-    m_scene.RegisterSystem(std::move(std::make_unique<BroadPhaseUpdateSystem>(m_aabbTree)));
-    m_scene.RegisterSystem(std::move(std::make_unique<NarrowPhaseSystem>(m_aabbTree, m_debugPoints)));
+    m_scene.RegisterSystem(std::move(std::make_unique<BroadPhaseUpdateSystem>(m_broadPhase)));
+    m_scene.RegisterSystem(std::move(std::make_unique<NarrowPhaseSystem>(m_broadPhase, m_debugPoints)));
 
-    PhysicsHelper::CreateCube(m_scene, m_aabbTree, Vector3::Zero, Vector3(10.0f, 1.0f, 10.0f), Quaternion(), -1.0f);
+    // create terrain
+    m_terrain = new Terrain();
+    m_terrain->Init(m_device, m_immediateContext, "Textures/HeightMaps/TestHeightMap.raw", 100, 100, 150, 150, 10);
 
-    PhysicsHelper::CreateCube(m_scene, m_aabbTree, Vector3(0.0f, 3.1f, 5.6f), Vector3(10.0f, 5.0f, 1.0f), Quaternion(), -1.0f);
+    // start from the last saved snapshot if there is one, otherwise build the scene
+    if (!SceneSnapshot::Load(SCENE_SNAPSHOT_PATH, m_scene, m_broadPhase))
+    {
+        PhysicsHelper::CreateCube(m_scene, m_broadPhase, Vector3::Zero, Vector3(10.0f, 1.0f, 10.0f), Quaternion(), -1.0f);
 
-    PhysicsHelper::CreateCube(m_scene, m_aabbTree, Vector3(-5.6f, 3.1f, 0.0f), Vector3(1.0f, 5.0f, 10.0f), Quaternion(), -1.0f);
+        PhysicsHelper::CreateCube(m_scene, m_broadPhase, Vector3(0.0f, 3.1f, 5.6f), Vector3(10.0f, 5.0f, 1.0f), Quaternion(), -1.0f);
 
-    PhysicsHelper::CreateCube(m_scene, m_aabbTree, Vector3(5.6f, 3.1f, 0.0f), Vector3(1.0f, 5.0f, 10.0f), Quaternion(), -1.0f);
+        PhysicsHelper::CreateCube(m_scene, m_broadPhase, Vector3(-5.6f, 3.1f, 0.0f), Vector3(1.0f, 5.0f, 10.0f), Quaternion(), -1.0f);
 
-    PhysicsHelper::CreateCube(m_scene, m_aabbTree, Vector3(0.0f, 3.1f, -5.6f), Vector3(10.0f, 5.0f, 1.0f), Quaternion(), -1.0f);
+        PhysicsHelper::CreateCube(m_scene, m_broadPhase, Vector3(5.6f, 3.1f, 0.0f), Vector3(1.0f, 5.0f, 10.0f), Quaternion(), -1.0f);
 
-    //PhysicsHelper::CreateCloth(m_scene, m_aabbTree, Vector3(0.0f, 10.0f, 0.0f), 30, 30, 0.2f, 1.0f, true, true, true);
+        PhysicsHelper::CreateCube(m_scene, m_broadPhase, Vector3(0.0f, 3.1f, -5.6f), Vector3(10.0f, 5.0f, 1.0f), Quaternion(), -1.0f);
 
-    // create terrain
-    m_terrain = new Terrain();
-    m_terrain->Init(m_device, m_immediateContext, "Textures/HeightMaps/TestHeightMap.raw", 100, 100, 150, 150, 10);
-    m_terrain->BuildCollision(&m_scene, &m_aabbTree);
+        //PhysicsHelper::CreateCloth(m_scene, m_broadPhase, Vector3(0.0f, 10.0f, 0.0f), 30, 30, 0.2f, 1.0f, true, true, true);
+
+        m_terrain->BuildCollision(&m_scene, &m_broadPhase);
+    }
+
+    // startup benchmarks
+    m_terrainBenchmarkResult = Benchmark::BuildTerrainCollision(*m_terrain);
+    m_clothBenchmarkResult = Benchmark::SpawnCloth(100, 100);
 
     // initialise ImGui
     IMGUI_CHECKVERSION();
@@ -373,9 +394,31 @@ void DX11App::Update()
 
         auto start = std::chrono::high_resolution_clock::now();
         m_scene.UpdateSystems(FPS60);
+
+        // rows are sorted between steps, while no system is iterating them
+        if (m_sortRowsSpatially && ++m_stepsSinceRowSort >= ROW_SORT_INTERVAL)
+        {
+            m_scene.SortRows<Transform>([](const Transform& transform) { return PhysicsHelper::GetMortonCode(transform.position, ROW_SORT_CELL_SIZE); });
+            m_stepsSinceRowSort = 0;
+        }
         auto stop = std::chrono::high_resolution_clock::now();
 
         m_physicsDuration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000.0f;
+
+        // sample the tree's quality outside of the timed step, as it visits every node
+        if (++m_stepsSinceTreeSample >= TREE_QUALITY_SAMPLE_INTERVAL)
+        {
+            m_staticTreeQuality = m_broadPhase.GetStaticTree().GetQuality();
+            m_dynamicTreeQuality = m_broadPhase.GetDynamicTree().GetQuality();
+            if (m_treeCostHistory.size() >= TREE_QUALITY_HISTORY_SIZE)
+            {
+                m_treeCostHistory.erase(m_treeCostHistory.begin());
+                m_treeHeightHistory.erase(m_treeHeightHistory.begin());
+            }
+            m_treeCostHistory.push_back(m_dynamicTreeQuality.sahCost);
+            m_treeHeightHistory.push_back((float)m_dynamicTreeQuality.height);
+            m_stepsSinceTreeSample = 0;
+        }
     }
 
     // start imgui frame
@@ -405,7 +448,7 @@ void DX11App::Update()
 
     if (m_selectedEntity != INVALID_ENTITY)
     {
-        ImGui::Text(std::format("The current selected entity has ID: {}", m_selectedEntity).c_str());
+        ImGui::Text(std::format("The current selected entity has ID: {} (version {})", GetEntityIndex(m_selectedEntity), GetEntityVersion(m_selectedEntity)).c_str());
 
         if (m_scene.HasComponent<Transform>(m_selectedEntity))
         {
@@ -438,16 +481,21 @@ void DX11App::Update()
 
         if (m_scene.HasComponent<RigidBody>(m_selectedEntity))
         {
-            RigidBody* rigidBodyComponent = m_scene.GetComponent<RigidBody>(m_selectedEntity);
+            // rigid bodies are split into streams, so edits are made on a copy and written back
+            RigidBody rigidBodyComponent = m_scene.ReadComponent<RigidBody>(m_selectedEntity);
             ImGui::Text("RigidBody Component:");
-            ImGui::InputFloat3("AngularVelocity", &rigidBodyComponent->angularVelocity.x);
-            ImGui::InputFloat3("Torque", &rigidBodyComponent->torque.x);
+            bool edited = ImGui::InputFloat3("AngularVelocity", &rigidBodyComponent.angularVelocity.x);
+            edited |= ImGui::InputFloat3("Torque", &rigidBodyComponent.torque.x);
+            if (edited)
+            {
+                m_scene.WriteComponent(m_selectedEntity, rigidBodyComponent);
+            }
         }
 
         if (ImGui::Button("Remove Entity"))
         {
             m_scene.DestroyEntity(m_selectedEntity);
-            m_aabbTree.RemoveEntity(m_selectedEntity);
+            m_broadPhase.RemoveEntity(m_selectedEntity);
             m_selectedEntity = INVALID_ENTITY;
         }
     }
@@ -500,7 +548,7 @@ void DX11App::Update()
                 RenderMaterial{ m_possibleMaterialIDs[rand() % m_possibleMaterialIDs.size()]}
             );
 
-            m_aabbTree.InsertEntity(newEntity, AABB::FromPositionScale(Vector3(camPos.x, camPos.y, camPos.z), Vector3::One));
+            m_broadPhase.InsertEntity(newEntity, AABB::FromPositionScale(Vector3(camPos.x, camPos.y, camPos.z), Vector3::One));
 
             m_scene.GetComponent<Particle>(newEntity)->ApplyLinearImpulse(Vector3(camDirection.x, camDirection.y, camDirection.z) * 10.0f);
         }
@@ -546,7 +594,7 @@ void DX11App::Update()
                 Mesh{ MeshLoader::GetMeshID("Cube") }
             );
 
-            m_aabbTree.InsertEntity(newEntity, AABB::FromPositionScale(Vector3(camPos.x, camPos.y, camPos.z), Vector3::One));
+            m_broadPhase.InsertEntity(newEntity, AABB::FromPositionScale(Vector3(camPos.x, camPos.y, camPos.z), Vector3::One));
 
             m_scene.GetComponent<Particle>(newEntity)->ApplyLinearImpulse(Vector3(camDirection.x, camDirection.y, camDirection.z) * 10.0f);
         }
@@ -578,12 +626,143 @@ void DX11App::Update()
     }
     ImGui::SameLine();
     ImGui::Text(m_showBoundingVolumes ? "true" : "false");
+    if (ImGui::Button("Toggle Spatial Row Sorting"))
+    {
+        m_sortRowsSpatially = !m_sortRowsSpatially;
+        m_stepsSinceRowSort = 0;
+    }
+    ImGui::SameLine();
+    ImGui::Text(m_sortRowsSpatially ? "true" : "false");
     ImGui::End();
 
     ImGui::Begin("Application Stats");
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
-    ImGui::Text("Entity Count: %d of %d", m_scene.GetEntityCount(), MAX_ENTITIES);
+    ImGui::Text("Entity Count: %d of %d", m_scene.GetEntityCount(), m_scene.GetMaxEntities());
     ImGui::Text("Physics Computation Time: %.3f ms", m_physicsDuration);
+    for (const SystemTimingSummary& summary : m_scene.GetSystemProfiler().GetSummaries())
+    {
+        ImGui::Text("%s: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, %.0f entities", summary.name.c_str(), summary.p50Milliseconds, summary.p95Milliseconds, summary.p99Milliseconds, summary.meanEntities);
+    }
+    if (ImGui::Button("Export System Trace"))
+    {
+        m_scene.GetSystemProfiler().ExportChromeTrace(SYSTEM_TRACE_PATH);
+    }
+
+    ImGui::Text("Static AABB Tree: %d leaves, SAH cost %.1f, height %d, average leaf depth %.1f", m_staticTreeQuality.leafCount, m_staticTreeQuality.sahCost, m_staticTreeQuality.height, m_staticTreeQuality.averageLeafDepth);
+    ImGui::Text("Dynamic AABB Tree: %d leaves, SAH cost %.1f, height %d, average leaf depth %.1f", m_dynamicTreeQuality.leafCount, m_dynamicTreeQuality.sahCost, m_dynamicTreeQuality.height, m_dynamicTreeQuality.averageLeafDepth);
+    ImGui::PlotLines("SAH Cost", m_treeCostHistory.data(), (int)m_treeCostHistory.size(), 0, nullptr, FLT_MAX, FLT_MAX, ImVec2(0.0f, 60.0f));
+    ImGui::PlotLines("Height", m_treeHeightHistory.data(), (int)m_treeHeightHistory.size(), 0, nullptr, FLT_MAX, FLT_MAX, ImVec2(0.0f, 60.0f));
+    if (ImGui::Button("Rebuild AABB Trees"))
+    {
+        m_broadPhase.Rebuild();
+    }
+
+    SceneMemoryReport memoryReport = m_scene.GetMemoryReport();
+    ImGui::Text("ECS Memory: %.2f MB (%.2f MB wasted)", memoryReport.GetTotalBytes() / MEGABYTE, memoryReport.GetWastedBytes() / MEGABYTE);
+    ImGui::Text("Archetypes: %zu (%zu empty), entity table %.2f MB", memoryReport.archetypes.size(), memoryReport.emptyArchetypeCount, memoryReport.locationTableBytes / MEGABYTE);
+    if (ImGui::TreeNode("Archetype Memory"))
+    {
+        for (const ArchetypeMemoryReport& archetype : memoryReport.archetypes)
+        {
+            ImGui::Text("%u entities, %zu chunks: %.1f KB, %.1f KB wasted", archetype.entityCount, archetype.chunkCount, archetype.GetTotalBytes() / KILOBYTE, archetype.GetWastedBytes() / KILOBYTE);
+        }
+        ImGui::TreePop();
+    }
+    if (ImGui::Button("Compact ECS Memory"))
+    {
+        m_scene.Compact();
+    }
+    ImGui::End();
+
+    ImGui::Begin("Benchmarks");
+    if (ImGui::Button("Run Spawn Benchmark"))
+    {
+        m_spawnBenchmarkResult = Benchmark::SpawnCubes(40000);
+    }
+    ImGui::Text("Spawn 40k cubes: %.3f ms (%.0f entities/s)", m_spawnBenchmarkResult.totalMilliseconds, m_spawnBenchmarkResult.GetOperationsPerSecond());
+    if (ImGui::Button("Run Startup Benchmarks"))
+    {
+        m_terrainBenchmarkResult = Benchmark::BuildTerrainCollision(*m_terrain);
+        m_clothBenchmarkResult = Benchmark::SpawnCloth(100, 100);
+    }
+    ImGui::Text("Terrain collision (%u entities): %.3f ms", m_terrainBenchmarkResult.iterations, m_terrainBenchmarkResult.totalMilliseconds);
+    ImGui::Text("Cloth 100x100 (%u entities): %.3f ms", m_clothBenchmarkResult.iterations, m_clothBenchmarkResult.totalMilliseconds);
+    if (ImGui::Button("Run Lookup Benchmarks"))
+    {
+        m_getComponentBenchmarkResult = Benchmark::RandomGetComponent(40000, 1000000);
+        m_destroyBenchmarkResult = Benchmark::DestroyEntities(40000);
+    }
+    ImGui::Text("Random GetComponent x2: %.3f ms (%.0f lookups/s)", m_getComponentBenchmarkResult.totalMilliseconds, m_getComponentBenchmarkResult.GetOperationsPerSecond());
+    ImGui::Text("Destroy 40k entities: %.3f ms (%.0f entities/s)", m_destroyBenchmarkResult.totalMilliseconds, m_destroyBenchmarkResult.GetOperationsPerSecond());
+    if (ImGui::Button("Run Snapshot Benchmarks"))
+    {
+        m_buildSceneBenchmarkResult = Benchmark::BuildStartupScene(*m_terrain);
+        m_loadSnapshotBenchmarkResult = Benchmark::LoadStartupSnapshot(*m_terrain, "startup.snapshot");
+    }
+    ImGui::Text("Build start up scene (%u entities): %.3f ms", m_buildSceneBenchmarkResult.iterations, m_buildSceneBenchmarkResult.totalMilliseconds);
+    ImGui::Text("Load start up snapshot (%u entities): %.3f ms", m_loadSnapshotBenchmarkResult.iterations, m_loadSnapshotBenchmarkResult.totalMilliseconds);
+    if (ImGui::Button("Run Rollback Benchmark"))
+    {
+        m_stepBenchmarkResult = Benchmark::RollbackPhysics(20000, 60, 0);
+        m_rollbackBenchmarkResult = Benchmark::RollbackPhysics(20000, 60, 8);
+    }
+    ImGui::Text("Step 20k bodies: %.3f ms/frame", m_stepBenchmarkResult.iterations > 0 ? m_stepBenchmarkResult.totalMilliseconds / m_stepBenchmarkResult.iterations : 0.0);
+    ImGui::Text("Step 20k bodies, 8 frame rollback: %.3f ms/frame", m_rollbackBenchmarkResult.iterations > 0 ? m_rollbackBenchmarkResult.totalMilliseconds / m_rollbackBenchmarkResult.iterations : 0.0);
+    if (ImGui::Button("Run Spring Benchmarks"))
+    {
+        m_springLookupBenchmarkResult = Benchmark::SolveSprings(100, 100, 10, false);
+        m_springRelationBenchmarkResult = Benchmark::SolveSprings(100, 100, 10, true);
+    }
+    ImGui::Text("Solve cloth springs x10, lookups: %.3f ms (%.0f springs/s)", m_springLookupBenchmarkResult.totalMilliseconds, m_springLookupBenchmarkResult.GetOperationsPerSecond());
+    ImGui::Text("Solve cloth springs x10, relation cache: %.3f ms (%.0f springs/s)", m_springRelationBenchmarkResult.totalMilliseconds, m_springRelationBenchmarkResult.GetOperationsPerSecond());
+    if (ImGui::Button("Run Parallel Scheduling Benchmarks"))
+    {
+        m_stealingLoopBenchmarkResult = Benchmark::IntegrateParticles(100000, 10, false);
+        m_pinnedLoopBenchmarkResult = Benchmark::IntegrateParticles(100000, 10, true);
+    }
+    ImGui::Text("Move 100k particles x10, stolen ranges: %.3f ms (%.0f particles/s)", m_stealingLoopBenchmarkResult.totalMilliseconds, m_stealingLoopBenchmarkResult.GetOperationsPerSecond());
+    ImGui::Text("Move 100k particles x10, pinned ranges: %.3f ms (%.0f particles/s)", m_pinnedLoopBenchmarkResult.totalMilliseconds, m_pinnedLoopBenchmarkResult.GetOperationsPerSecond());
+    if (ImGui::Button("Run Profiled Physics Benchmark"))
+    {
+        m_profileBenchmarkResult = Benchmark::ProfilePhysics(20000, 300, "benchmark.trace.json");
+    }
+    ImGui::Text("Step 20k bodies, profiled: %.3f ms/frame", m_profileBenchmarkResult.iterations > 0 ? m_profileBenchmarkResult.totalMilliseconds / m_profileBenchmarkResult.iterations : 0.0);
+    if (ImGui::Button("Run Sphere Pile Benchmarks"))
+    {
+        m_unsortedPileBenchmarkResult = Benchmark::SpherePile(20000, 180, 0);
+        m_sortedPileBenchmarkResult = Benchmark::SpherePile(20000, 180, ROW_SORT_INTERVAL);
+    }
+    ImGui::Text("20k sphere pile narrow phase, spawn order: %.3f ms/frame", m_unsortedPileBenchmarkResult.iterations > 0 ? m_unsortedPileBenchmarkResult.totalMilliseconds / m_unsortedPileBenchmarkResult.iterations : 0.0);
+    ImGui::Text("20k sphere pile narrow phase, Morton sorted: %.3f ms/frame", m_sortedPileBenchmarkResult.iterations > 0 ? m_sortedPileBenchmarkResult.totalMilliseconds / m_sortedPileBenchmarkResult.iterations : 0.0);
+    if (ImGui::Button("Run Tree Churn Benchmarks"))
+    {
+        m_treeChurnBenchmarkResult = Benchmark::TreeChurn(40000, 60, false);
+        m_batchedTreeChurnBenchmarkResult = Benchmark::TreeChurn(40000, 60, true);
+    }
+    ImGui::Text("AABB tree churn 40k proxies x60: %.3f ms (%.0f operations/s)", m_treeChurnBenchmarkResult.totalMilliseconds, m_treeChurnBenchmarkResult.GetOperationsPerSecond());
+    ImGui::Text("AABB tree churn 40k proxies x60, batched: %.3f ms (%.0f operations/s)", m_batchedTreeChurnBenchmarkResult.totalMilliseconds, m_batchedTreeChurnBenchmarkResult.GetOperationsPerSecond());
+    if (ImGui::Button("Run Tree Build Benchmarks"))
+    {
+        m_incrementalBuildBenchmarkResult = Benchmark::BuildTree(20000, false);
+        m_bulkBuildBenchmarkResult = Benchmark::BuildTree(20000, true);
+        m_incrementalQueryBenchmarkResult = Benchmark::QueryTree(20000, 100000, false);
+        m_bulkQueryBenchmarkResult = Benchmark::QueryTree(20000, 100000, true);
+    }
+    ImGui::Text("Build tree of 20k triangles, incremental: %.3f ms", m_incrementalBuildBenchmarkResult.totalMilliseconds);
+    ImGui::Text("Build tree of 20k triangles, binned SAH: %.3f ms", m_bulkBuildBenchmarkResult.totalMilliseconds);
+    ImGui::Text("100k ray casts, incremental tree: %.3f ms (%.0f rays/s)", m_incrementalQueryBenchmarkResult.totalMilliseconds, m_incrementalQueryBenchmarkResult.GetOperationsPerSecond());
+    ImGui::Text("100k ray casts, binned SAH tree: %.3f ms (%.0f rays/s)", m_bulkQueryBenchmarkResult.totalMilliseconds, m_bulkQueryBenchmarkResult.GetOperationsPerSecond());
+    if (ImGui::Button("Run Pair Finding Benchmarks"))
+    {
+        m_singleTreePairsBenchmarkResult = Benchmark::FindPairs(20000, 2000, 60, false);
+        m_splitTreePairsBenchmarkResult = Benchmark::FindPairs(20000, 2000, 60, true);
+    }
+    ImGui::Text("Pairs of 2k boxes over 20k triangles x60, one tree: %.3f ms", m_singleTreePairsBenchmarkResult.totalMilliseconds);
+    ImGui::Text("Pairs of 2k boxes over 20k triangles x60, static and dynamic trees: %.3f ms", m_splitTreePairsBenchmarkResult.totalMilliseconds);
+    if (ImGui::Button("Save Scene Snapshot"))
+    {
+        SceneSnapshot::Save(SCENE_SNAPSHOT_PATH, m_scene, m_broadPhase);
+    }
     ImGui::End();
 
     ImGui::Begin("Click Options");
@@ -634,12 +813,12 @@ void DX11App::Draw()
     sm->SetActiveShader("SimpleShaders");
     ID3D11ShaderResourceView* crateSRV = MaterialManager::GetMaterialSRV("Crate");
 
-    m_scene.ForEach<Transform, Mesh>([&](Entity entity, Transform* transform, Mesh* mesh) {
+    m_scene.ForEach<const Transform, const Mesh>([&](Entity entity, const Transform* transform, const Mesh* mesh) {
         XMMATRIX matrixTransform = XMMatrixScaling(transform->scale.x, transform->scale.y, transform->scale.z) * XMMATRIX(transform->rotation.toRotationMatrix()) * XMMatrixTranslation(transform->position.x, transform->position.y, transform->position.z);
         transformData.World = XMMatrixTranspose(matrixTransform);
         sm->SetConstantBuffer<TransformBuffer>("TransformBuffer", transformData);
 
-        RenderMaterial* material = m_scene.GetComponent<RenderMaterial>(entity);
+        const RenderMaterial* material = m_scene.GetComponent<const RenderMaterial>(entity);
         if (material != nullptr)
         {
             ID3D11ShaderResourceView* materialSRV = MaterialManager::GetMaterialSRV(material->materialID);
@@ -675,11 +854,13 @@ void DX11App::Draw()
     {
         XMFLOAT3 camPosDX = m_camera->GetPosition();
         Vector3 camPos = Vector3(camPosDX.x, camPosDX.y, camPosDX.z);
-        for (const Node& node : m_aabbTree.GetNodes())
+        for (const AABBTree* tree : { &m_broadPhase.GetStaticTree(), &m_broadPhase.GetDynamicTree() })
         {
-            Vector3 boxPos = node.box.GetPosition();
-            if (node.isLeaf && (boxPos - camPos).magnitude() <= 10.0f)
+            for (const Node& node : tree->GetNodes())
             {
+                Vector3 boxPos = node.box.GetPosition();
+                if (!node.isLeaf || (boxPos - camPos).magnitude() > 10.0f) { continue; }
+
                 Vector3 boxSize = node.box.GetSize();
 
                 XMMATRIX transform = XMMatrixScaling(boxSize.x, boxSize.y, boxSize.z) * XMMatrixTranslation(boxPos.x, boxPos.y, boxPos.z);
@@ -722,10 +903,9 @@ void DX11App::Draw()
 
     std::vector<SimpleVertex> springVertices;
 
-    m_scene.ForEach<Spring>([&](Entity entity, Spring* spring) {
-
-        Vector3 start = m_scene.GetComponent<Transform>(spring->entityA)->position;
-        Vector3 end = m_scene.GetComponent<Transform>(spring->entityB)->position;
+    m_springLines.ForEach(m_scene, [&](Entity entity, const Spring* spring, const Transform* startTransform, const Transform* endTransform) {
+        Vector3 start = startTransform->position;
+        Vector3 end = endTransform->position;
 
         springVertices.push_back({ XMFLOAT3(start.x, start.y, start.z), XMFLOAT3(), XMFLOAT2(), XMFLOAT4() });
         springVertices.push_back({ XMFLOAT3(end.x, end.y, end.z), XMFLOAT3(), XMFLOAT2(), XMFLOAT4() });
@@ -811,7 +991,7 @@ void DX11App::OnMouseClick(WPARAM pressedBtn, int x, int y)
         Ray ray = GetRayFromScreenPosition(x, y);
 
         float intersectDistance;
-        Entity entity = m_aabbTree.Intersect(ray, intersectDistance);
+        Entity entity = m_broadPhase.Intersect(ray, intersectDistance);
         
         if (m_currentClickAction == ClickAction::SELECT)
         {
@@ -830,7 +1010,9 @@ void DX11App::OnMouseClick(WPARAM pressedBtn, int x, int y)
                 Vector3 localPosition = intersectionPosition - m_scene.GetComponent<Transform>(entity)->position;
                 Vector3 torque = Vector3::Cross(localPosition, force);
 
-                m_scene.GetComponent<RigidBody>(entity)->ApplyAngularImpuse(torque);
+                RigidBody rigidBody = m_scene.ReadComponent<RigidBody>(entity);
+                rigidBody.ApplyAngularImpuse(torque);
+                m_scene.WriteComponent(entity, rigidBody);
             }
         }
         else if (m_currentClickAction == ClickAction::DRAG)
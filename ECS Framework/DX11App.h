@@ -7,9 +7,12 @@
 #include "ECSScene.h"
 #include "Timer.h"
 #include "Vector3.h"
-#include "AABBTree.h"
+#include "BroadPhase.h"
 #include "Material.h"
 #include "Terrain.h"
+#include "Benchmark.h"
+#include "Components.h"
+#include "RelationCache.h"
 #include <vector>
 
 struct InstanceData
@@ -69,8 +72,9 @@ private:
 	XMINT2 m_lastMousePos;
 	Camera* m_camera;
 
-	AABBTree m_aabbTree;
+	BroadPhase m_broadPhase;
 	ECSScene m_scene;
+	RelationCache<Spring, const Transform> m_springLines; // Springs with the transforms of both ends, for drawing.
 	double m_physicsAccumulator = 0.0;
 	Timer m_timer;
 
@@ -91,8 +95,40 @@ private:
 	std::vector<Vector3> m_debugPoints;
 	bool m_showDebugPoints = false;
 	bool m_showBoundingVolumes = false;
+	bool m_sortRowsSpatially = false; // Sort the archetype rows by position every ROW_SORT_INTERVAL physics steps.
+	unsigned int m_stepsSinceRowSort = 0;
+
+	TreeQuality m_staticTreeQuality; // Quality of the static AABB tree when last sampled.
+	TreeQuality m_dynamicTreeQuality; // Quality of the dynamic AABB tree when last sampled.
+	std::vector<float> m_treeCostHistory; // SAH cost of the dynamic AABB tree every TREE_QUALITY_SAMPLE_INTERVAL physics steps, oldest first.
+	std::vector<float> m_treeHeightHistory; // Height of the dynamic AABB tree at the same samples.
+	unsigned int m_stepsSinceTreeSample = 0;
 
 	float m_physicsDuration = 0.0f;
+	BenchmarkResult m_spawnBenchmarkResult;
+	BenchmarkResult m_terrainBenchmarkResult;
+	BenchmarkResult m_clothBenchmarkResult;
+	BenchmarkResult m_getComponentBenchmarkResult;
+	BenchmarkResult m_destroyBenchmarkResult;
+	BenchmarkResult m_buildSceneBenchmarkResult;
+	BenchmarkResult m_loadSnapshotBenchmarkResult;
+	BenchmarkResult m_stepBenchmarkResult;
+	BenchmarkResult m_rollbackBenchmarkResult;
+	BenchmarkResult m_springLookupBenchmarkResult;
+	BenchmarkResult m_springRelationBenchmarkResult;
+	BenchmarkResult m_stealingLoopBenchmarkResult;
+	BenchmarkResult m_pinnedLoopBenchmarkResult;
+	BenchmarkResult m_profileBenchmarkResult;
+	BenchmarkResult m_unsortedPileBenchmarkResult;
+	BenchmarkResult m_sortedPileBenchmarkResult;
+	BenchmarkResult m_treeChurnBenchmarkResult;
+	BenchmarkResult m_batchedTreeChurnBenchmarkResult;
+	BenchmarkResult m_incrementalBuildBenchmarkResult;
+	BenchmarkResult m_bulkBuildBenchmarkResult;
+	BenchmarkResult m_incrementalQueryBenchmarkResult;
+	BenchmarkResult m_bulkQueryBenchmarkResult;
+	BenchmarkResult m_singleTreePairsBenchmarkResult;
+	BenchmarkResult m_splitTreePairsBenchmarkResult;
 
 	ClickAction m_currentClickAction;
 
@@ -1,17 +1,49 @@
 #pragma once
 #include <cstdint>
-#include <bitset>
+#include "Signature.h"
 
 // ECS
-using Entity = std::uint32_t;
-const Entity MAX_ENTITIES = 45000;
+
+// Entities are generational handles. The low 32 bits are the index of the entity's slot and the high 32 bits
+// are the version of the slot, which changes every time the slot is freed so stale handles can be detected.
+using Entity = std::uint64_t;
+using EntityVersion = std::uint32_t;
+constexpr std::uint32_t ENTITY_INDEX_BITS = 32;
+constexpr Entity ENTITY_INDEX_MASK = (Entity(1) << ENTITY_INDEX_BITS) - 1;
+// A slot freed at its last live version is retired at this version rather than wrapping back to 0, so an old
+// handle never becomes valid again. Retired slots are never reused and no handle is made with this version.
+constexpr EntityVersion RETIRED_ENTITY_VERSION = EntityVersion(-1);
 constexpr Entity INVALID_ENTITY = -1;
 
+// The default limit on living entities, the limit can be changed per scene up to MAX_ENTITY_LIMIT.
+const std::uint32_t DEFAULT_MAX_ENTITIES = 45000;
+// The highest index is never used, so INVALID_ENTITY is never a valid handle.
+constexpr std::uint32_t MAX_ENTITY_LIMIT = std::uint32_t(ENTITY_INDEX_MASK);
+
+constexpr std::uint32_t GetEntityIndex(Entity entity) { return std::uint32_t(entity & ENTITY_INDEX_MASK); }
+constexpr EntityVersion GetEntityVersion(Entity entity) { return EntityVersion(entity >> ENTITY_INDEX_BITS); }
+constexpr Entity MakeEntity(std::uint32_t index, EntityVersion version) { return (Entity(version) << ENTITY_INDEX_BITS) | index; }
+
+class Archetype;
+
+// Where an entity's components are stored, kept up to date by the archetypes as rows move.
+struct EntityLocation
+{
+	Archetype* archetype = nullptr; // Null while the entity has no components.
+	std::uint32_t row = 0;
+};
+
 using ComponentType = std::uint8_t;
-const std::size_t MAX_COMPONENT_TYPES = 32;
+const std::size_t MAX_COMPONENT_TYPES = 128;
 constexpr ComponentType INVALID_COMPONENT_TYPE = -1;
 
-using Signature = std::bitset<MAX_COMPONENT_TYPES>;
+const std::size_t MAX_QUERIES = 256;
+
+// Identifies a copy on write snapshot of a scene, 0 is never a valid snapshot.
+using SnapshotID = std::uint32_t;
+constexpr SnapshotID INVALID_SNAPSHOT = 0;
+
+using Signature = BitSignature<MAX_COMPONENT_TYPES>;
 
 // PHYSICS
 #define FPS60 1.0f / 60.0f
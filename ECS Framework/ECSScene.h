@@ -4,9 +4,14 @@
 #pragma once
 #ifndef ECS_SCENE_H_
 #define ECS_SCENE_H_
-#include <cmath>
-#include <cmath>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <deque>
 
+#include "CommandBuffer.h"
 #include "ComponentManager.h"
 #include "EntityManager.h"
 #include "SystemManager.h"
@@ -21,39 +26,80 @@ public:
 
 	/**
 	 * @brief Initialises the scene by creating instances of the engine managers.
+	 * @param maxEntities The maximum number of entities alive at once, at most MAX_ENTITY_LIMIT. Memory for
+	 * entities is allocated as they are created, so a high limit costs nothing until it is used.
 	 */
-	void Init()
+	void Init(uint32_t maxEntities = DEFAULT_MAX_ENTITIES)
 	{
-		m_componentManager = std::make_shared<ComponentManager>();
-		m_entityManager = std::make_shared<EntityManager>();
+		m_entityManager = std::make_shared<EntityManager>(maxEntities);
+		m_componentManager = std::make_shared<ComponentManager>(m_entityManager->GetLocations());
 		m_systemManager = std::make_shared<SystemManager>();
+		m_systemManager->SetSyncPointCallback([this]() { PlaybackCommandBuffers(); });
+		m_commandBuffers = std::vector<CommandBuffer>(JobSystem::GetInstance().GetThreadCount());
+		for (std::atomic<Query*>& query : m_queries)
+		{
+			query = nullptr;
+		}
 	}
 
 	// ENTITY METHODS
 
 	/**
 	 * @brief Creates a new entity in the scene.
-	 * @return The new entities identifier.
+	 * @return The new entities identifier, INVALID_ENTITY if the entity limit is reached.
 	 */
 	Entity CreateEntity()
 	{
+		BackupEntities();
 		return m_entityManager->CreateEntity();
 	}
 
 	/**
-	 * @brief Removes the given entity and all of its components from the scene.
+	 * @brief Creates a batch of entities that all have the same component set. The entities are written directly
+	 * into the archetype of the full component set instead of moving through one archetype per added component.
+	 * @tparam ...Components The component types of the entities, each must be registered.
+	 * @param count The number of entities to create.
+	 * @param components One array per component type, each holding the component of every new entity in order.
+	 * @return The identifiers of the new entities, in the same order as the component data. Empty if the batch
+	 * would reach the entity limit, in which case no entity is created.
+	 */
+	template <typename... Components>
+	std::vector<Entity> CreateEntities(size_t count, const std::vector<Components>&... components)
+	{
+		if (!m_entityManager->CanCreateEntities(count)) { return {}; }
+
+		Signature signature = BuildSignature<Components...>();
+		BackupEntities();
+
+		std::vector<Entity> entities(count);
+		for (Entity& entity : entities)
+		{
+			entity = m_entityManager->CreateEntity();
+			m_entityManager->SetSignature(entity, signature);
+		}
+
+		m_componentManager->AddEntities(signature, entities, components...);
+		return entities;
+	}
+
+	/**
+	 * @brief Removes the given entity and all of its components from the scene. Every handle to the entity
+	 * becomes stale, so it no longer exists even once its index is reused.
 	 * @param entity The identifier of the entity to remove.
 	 */
 	void DestroyEntity(Entity entity)
 	{
-		m_entityManager->DestroyEntity(entity);
+		assert(m_entityManager->DoesEntityExist(entity) && "Entity does not exist.");
+		BackupEntities();
+
 		m_componentManager->EntityDestroyed(entity);
+		m_entityManager->DestroyEntity(entity);
 	}
 
 	/**
 	 * @brief Checks if a given entity exists in this scene.
 	 * @param entity The identifier of the entity.
-	 * @return True if the entity exists, false otherwise.
+	 * @return True if the entity exists, false if it was never created or the handle is stale.
 	 */
 	bool DoesEntityExist(Entity entity)
 	{
@@ -69,12 +115,20 @@ public:
 	}
 
 	/**
-	 * @brief Check if the maximum amount of entities has been reached defined by MAX_ENTITIES
-	 * @return True if the current entity count is at the cap, false otherwise.
+	 * @brief Get the maximum number of entities this scene can hold, set when the scene is initialised.
+	 */
+	uint32_t GetMaxEntities()
+	{
+		return m_entityManager->GetMaxEntities();
+	}
+
+	/**
+	 * @brief Check if the maximum amount of entities has been reached.
+	 * @return True if no more entities can be created, false otherwise.
 	 */
 	bool ReachedEntityCap()
 	{
-		return m_entityManager->GetEntityCount() == MAX_ENTITIES;
+		return !m_entityManager->CanCreateEntities(1);
 	}
 
 	/**
@@ -89,19 +143,254 @@ public:
 		return m_entityManager->HasComponent(entity, GetComponentType<T>());
 	}
 
+	/**
+	 * @brief Gets where an entity's components are stored. The location stays valid until the structure version
+	 * changes.
+	 * @param entity The identifier of an existing entity.
+	 * @return The archetype and row of the entity, the archetype is null if the entity has no components.
+	 */
+	EntityLocation GetEntityLocation(Entity entity)
+	{
+		assert(m_entityManager->DoesEntityExist(entity) && "Entity does not exist.");
+		return m_entityManager->GetLocations()[GetEntityIndex(entity)];
+	}
+
+	/**
+	 * @brief Gets a counter incremented by every change that adds, removes or moves entities' components, so code
+	 * caching entity locations or component pointers can tell when they are stale.
+	 */
+	uint32_t GetStructureVersion() const
+	{
+		return m_componentManager->GetStructureVersion();
+	}
+
 	/**
 	 * @brief Iterate over entities in the scene given a component set filter.
-	 * @tparam ...Components The components required in an entity to be included in the loop.
-	 * @param callback A callback method that contains the parameters: Entity, Components...
+	 * @tparam ...Terms The components required in an entity to be included in the loop. A const component is read only
+	 * and is not marked as changed, and a component wrapped in Changed limits the loop to chunks where it changed since
+	 * the running system last updated. A component wrapped in Optional is passed as nullptr to entities without it,
+	 * With requires a component without passing it and Without skips entities that have the component.
+	 * @param callback A callback method that contains the parameters: Entity, Components... with a parameter for
+	 * every term except With and Without terms.
 	 */
-	template<typename... Components, typename Callback>
+	template<typename... Terms, typename Callback>
 	void ForEach(Callback&& callback)
 	{
-		Signature signature = BuildSignature<Components...>();
+		Query& query = GetQuery<TermKey<Terms>...>();
+		[&]<typename... Arguments>(TermList<Arguments...>) {
+			query.template ForEach<Arguments...>(callback);
+		}(ArgumentTerms<Terms...>());
+	}
+
+	/**
+	 * @brief Iterate over entities in the scene given a component set filter, splitting the rows across the
+	 * shared job system. Entities must not be created, destroyed or change components during the loop.
+	 * @tparam ...Terms The components required in an entity to be included in the loop, which may be const or
+	 * wrapped in Changed, Optional, With or Without as with ForEach.
+	 * @param callback A thread safe callback method that contains the parameters: Entity, Components...
+	 * @param options The grain size and scheduling mode used to split the rows.
+	 */
+	template<typename... Terms, typename Callback>
+	void ParallelForEach(Callback&& callback, const ParallelOptions& options = ParallelOptions())
+	{
+		Query& query = GetQuery<TermKey<Terms>...>();
+		[&]<typename... Arguments>(TermList<Arguments...>) {
+			query.template ParallelForEach<Arguments...>(callback, options);
+		}(ArgumentTerms<Terms...>());
+	}
+
+	/**
+	 * @brief Iterate over entities in the scene a chunk at a time. Every call gets the number of rows in the chunk
+	 * and contiguous spans of the entities and of each component, so hot systems can run tight, vectorisable loops
+	 * and do their own prefetching. Entities must not be created, destroyed or change components during the loop.
+	 * @tparam ...Terms The components required in an entity to be included in the loop, which may be const or
+	 * wrapped in Changed, Optional, With or Without as with ForEach. Optional components are passed as empty spans to
+	 * chunks without them.
+	 * @param callback A callback method that contains the parameters: size_t count, std::span<const Entity> entities,
+	 * std::span<Components> components..., with ComponentStreams in place of the span for split components.
+	 */
+	template<typename... Terms, typename Callback>
+	void ForEachChunk(Callback&& callback)
+	{
+		Query& query = GetQuery<TermKey<Terms>...>();
+		[&]<typename... Arguments>(TermList<Arguments...>) {
+			query.template ForEachChunk<Arguments...>(callback);
+		}(ArgumentTerms<Terms...>());
+	}
+
+	/**
+	 * @brief Iterate over entities in the scene in row ranges split across the shared job system, passing the callback
+	 * contiguous spans of each range's components so it can run tight, vectorisable loops. Entities must not be
+	 * created, destroyed or change components during the loop.
+	 * @tparam ...Terms The components required in an entity to be included in the loop, as with ParallelForEach.
+	 * @param callback A thread safe callback method that contains the parameters: size_t count,
+	 * std::span<const Entity> entities, std::span<Components> components..., with ComponentStreams in place of the
+	 * span for split components.
+	 * @param options The grain size and scheduling mode used to split the rows.
+	 */
+	template<typename... Terms, typename Callback>
+	void ParallelForEachChunk(Callback&& callback, const ParallelOptions& options = ParallelOptions())
+	{
+		Query& query = GetQuery<TermKey<Terms>...>();
+		[&]<typename... Arguments>(TermList<Arguments...>) {
+			query.template ParallelForEachChunk<Arguments...>(callback, options);
+		}(ArgumentTerms<Terms...>());
+	}
+
+	/**
+	 * @brief Gets the persistent query for a component set, creating it on first use. Each component set
+	 * is resolved to a query once per scene, after which the lookup is a single index into the query cache.
+	 * @tparam ...Terms The components required in an entity to be matched by the query, which may be wrapped in
+	 * With or Without, or in Optional which does not affect matching.
+	 * @return A reference to the query.
+	 */
+	template<typename... Terms>
+	Query& GetQuery()
+	{
+		static const size_t queryIndex = m_nextQueryIndex++;
+		assert(queryIndex < MAX_QUERIES && "Too many distinct component sets queried.");
 
-		for (auto& archetype : m_componentManager->GetArchetypes(signature))
+		Query* query = m_queries[queryIndex].load(std::memory_order_acquire);
+		if (query == nullptr)
 		{
-			archetype->ForEach<Components...>(callback);
+			// systems may run concurrently, so the first use of a component set is serialised
+			std::lock_guard<std::mutex> lock(m_queryMutex);
+
+			query = m_queries[queryIndex].load(std::memory_order_relaxed);
+			if (query == nullptr)
+			{
+				query = m_componentManager->CreateQuery(BuildTermSignature<Terms...>(TermPresence::Required), BuildTermSignature<Terms...>(TermPresence::Excluded));
+				m_queries[queryIndex].store(query, std::memory_order_release);
+			}
+		}
+
+		return *query;
+	}
+
+	// COMMAND BUFFER METHODS
+
+	/**
+	 * @brief Gets the command buffer of the calling thread, used to record structural changes while iterating.
+	 * Every job system thread has its own buffer, and threads outside of the job system share the buffer of
+	 * slot 0, so only one of them may record at a time.
+	 * @return A reference to the command buffer.
+	 */
+	CommandBuffer& GetCommandBuffer()
+	{
+		return m_commandBuffers[JobSystem::GetThreadIndex()];
+	}
+
+	/**
+	 * @brief Applies every recorded command buffer and clears them. Pending entities are created first, then each
+	 * entity's component changes are folded into a single move to its final archetype, applied in archetype order,
+	 * and finally destroyed entities are removed. Commands on an entity that is also destroyed, or that no longer
+	 * exists, are skipped.
+	 * Called automatically around systems making structural changes and at the end of UpdateSystems; it must not be
+	 * called while entities are being iterated.
+	 */
+	void PlaybackCommandBuffers()
+	{
+		bool hasCommands = false;
+		for (CommandBuffer& buffer : m_commandBuffers)
+		{
+			if (buffer.IsEmpty()) { continue; }
+			hasCommands = true;
+			BackupEntities();
+
+			// create the pending entities first so that commands can target them
+			std::vector<Entity>& createdEntities = buffer.GetCreatedEntities();
+			createdEntities.resize(buffer.GetPendingEntityCount());
+			for (Entity& entity : createdEntities)
+			{
+				entity = m_entityManager->CreateEntity();
+			}
+		}
+
+		if (!hasCommands) { return; }
+
+		m_playbackCommands.clear();
+		m_destroyedEntities.clear();
+		for (size_t bufferIndex = 0; bufferIndex < m_commandBuffers.size(); bufferIndex++)
+		{
+			const CommandBuffer& buffer = m_commandBuffers[bufferIndex];
+			const std::vector<Command>& commands = buffer.GetCommands();
+			for (size_t commandIndex = 0; commandIndex < commands.size(); commandIndex++)
+			{
+				Entity target = buffer.GetTarget(commands[commandIndex]);
+				if (commands[commandIndex].type == CommandType::DESTROY_ENTITY)
+				{
+					m_destroyedEntities.push_back(target);
+				}
+				else
+				{
+					m_playbackCommands.push_back({ target, bufferIndex, commandIndex });
+				}
+			}
+		}
+
+		std::sort(m_destroyedEntities.begin(), m_destroyedEntities.end());
+		m_destroyedEntities.erase(std::unique(m_destroyedEntities.begin(), m_destroyedEntities.end()), m_destroyedEntities.end());
+
+		// group the commands by entity, the stable sort keeps the recording order of each entity's commands
+		std::stable_sort(m_playbackCommands.begin(), m_playbackCommands.end(), [](const PlaybackCommand& a, const PlaybackCommand& b) {
+			return a.entity < b.entity;
+			});
+
+		m_entityChanges.clear();
+		m_componentWrites.clear();
+		for (size_t first = 0, last = 0; first < m_playbackCommands.size(); first = last)
+		{
+			Entity entity = m_playbackCommands[first].entity;
+			while (last < m_playbackCommands.size() && m_playbackCommands[last].entity == entity) { last++; }
+
+			if (!m_entityManager->DoesEntityExist(entity) || std::binary_search(m_destroyedEntities.begin(), m_destroyedEntities.end(), entity)) { continue; }
+
+			EntityChange change;
+			change.entity = entity;
+			change.oldSignature = m_entityManager->GetSignature(entity);
+			change.newSignature = change.oldSignature;
+			change.firstWrite = m_componentWrites.size();
+
+			for (size_t i = first; i < last; i++)
+			{
+				const CommandBuffer& buffer = m_commandBuffers[m_playbackCommands[i].bufferIndex];
+				const Command& command = buffer.GetCommands()[m_playbackCommands[i].commandIndex];
+
+				if (command.type == CommandType::ADD_COMPONENT)
+				{
+					change.newSignature.set(command.componentType);
+					m_componentWrites.push_back({ command.componentType, buffer.GetData(command.dataOffset) });
+				}
+				else
+				{
+					// a removal cancels any earlier write of the same component
+					change.newSignature.reset(command.componentType);
+					m_componentWrites.erase(std::remove_if(m_componentWrites.begin() + change.firstWrite, m_componentWrites.end(),
+						[&](const ComponentWrite& write) { return write.type == command.componentType; }), m_componentWrites.end());
+				}
+			}
+
+			change.lastWrite = m_componentWrites.size();
+			m_entityChanges.push_back(change);
+		}
+
+		m_componentManager->ApplyChanges(m_entityChanges, m_componentWrites);
+		for (const EntityChange& change : m_entityChanges)
+		{
+			m_entityManager->SetSignature(change.entity, change.newSignature);
+		}
+
+		for (Entity entity : m_destroyedEntities)
+		{
+			if (!m_entityManager->DoesEntityExist(entity)) { continue; }
+
+			m_componentManager->EntityDestroyed(entity);
+			m_entityManager->DestroyEntity(entity);
+		}
+
+		for (CommandBuffer& buffer : m_commandBuffers)
+		{
+			buffer.Clear();
 		}
 	}
 
@@ -128,8 +417,9 @@ public:
 		Signature oldSignature = m_entityManager->GetSignature(entity);
 
 		assert(!oldSignature.test(m_componentManager->GetComponentType<T>()) && "Component already added to entity");
+		BackupEntities();
 
-		Signature newSignature = m_componentManager->AddComponent<T>(entity, oldSignature, component);
+		Signature newSignature = m_componentManager->AddComponent<T>(entity, component);
 		m_entityManager->SetSignature(entity, newSignature);
 	}
 
@@ -143,23 +433,37 @@ public:
 	{
 		Signature oldSignature = m_entityManager->GetSignature(entity);
 		assert(oldSignature.test(m_componentManager->GetComponentType<T>()) && "Component does not exist on this entity");
+		BackupEntities();
 
-		Signature newSignature = m_componentManager->RemoveComponent<T>(entity, oldSignature);
+		Signature newSignature = m_componentManager->RemoveComponent<T>(entity);
 		m_entityManager->SetSignature(entity, newSignature);
 	}
 
 	/**
-	 * @brief Get a component from an entity.
-	 * @tparam T The type of the component.
+	 * @brief Reserves storage for entities with exactly the given component set, so spawning up to that
+	 * many of them allocates nothing further.
+	 * @tparam ...Components The full component set of the entities.
+	 * @param entityCount The number of entities to reserve storage for.
+	 */
+	template <typename... Components>
+	void Reserve(size_t entityCount)
+	{
+		m_componentManager->Reserve(BuildSignature<Components...>(), entityCount);
+	}
+
+	/**
+	 * @brief Get a component from an entity. The component is marked as changed unless T is const qualified.
+	 * @tparam T The type of the component, const qualified for read only access.
 	 * @param entity The identifier of the entity.
-	 * @return A pointer of the component data.
+	 * @return A pointer of the component data. The pointer is not invalidated by other entities being added,
+	 * but is invalidated when any entity with the same component set is removed or changes components.
 	 */
 	template <typename T>
 	T* GetComponent(Entity entity)
 	{
 		if (HasComponent<T>(entity))
 		{
-			return m_componentManager->GetComponent<T>(entity, m_entityManager->GetSignature(entity));
+			return m_componentManager->GetComponent<T>(entity);
 		}
 		else
 		{
@@ -167,15 +471,159 @@ public:
 		}
 	}
 
+	/**
+	 * @brief Copies a component out of an entity. Split components, see ECS_SOA_COMPONENT, have no pointer to their
+	 * data, so they are read this way outside chunk callbacks.
+	 * @tparam T The type of the component.
+	 * @param entity The identifier of the entity, which must have the component.
+	 * @return A copy of the component data.
+	 */
+	template <typename T>
+	T ReadComponent(Entity entity)
+	{
+		assert(HasComponent<T>(entity) && "Component does not exist on this entity");
+		return m_componentManager->ReadComponent<T>(entity);
+	}
+
+	/**
+	 * @brief Overwrites a component of an entity and marks it as changed, the way split components are written
+	 * outside chunk callbacks.
+	 * @tparam T The type of the component.
+	 * @param entity The identifier of the entity, which must have the component.
+	 * @param component The new data of the component.
+	 */
+	template <typename T>
+	void WriteComponent(Entity entity, const T& component)
+	{
+		assert(HasComponent<T>(entity) && "Component does not exist on this entity");
+		m_componentManager->WriteComponent<T>(entity, component);
+	}
+
 	/**
 	 * @brief Gets the engine registered type index of a component.
 	 * @tparam T The type of the component.
 	 * @return The ComponentType of the component.
 	 */
 	template <typename T>
-	ComponentType GetComponentType()
+	static constexpr ComponentType GetComponentType()
 	{
-		return m_componentManager->GetComponentType<T>();
+		return GetComponentID<T>();
+	}
+
+	// SNAPSHOT METHODS
+
+	/**
+	 * @brief Takes a copy on write snapshot of the scene's entities and components, used to roll the scene back for
+	 * rollback and speculative simulation. Taking a snapshot copies nothing: each column of each chunk is copied the
+	 * first time it is written afterwards, and the entity table the first time an entity is created, destroyed or
+	 * changes components. Must not be called while systems are updating.
+	 * @return The identifier of the snapshot.
+	 */
+	SnapshotID TakeSnapshot()
+	{
+		return m_componentManager->TakeSnapshot();
+	}
+
+	/**
+	 * @brief Rolls the scene back to a snapshot, copying back only the data written since it was taken. Restored
+	 * components are marked as changed, so systems filtering on changes, such as the broad phase refitting the AABB
+	 * tree, see the rolled back values. Entities added to or removed from an AABB tree since the snapshot are not
+	 * tracked and must be re-synced by the caller. The snapshot and every newer snapshot are dropped.
+	 * Must not be called while systems are updating.
+	 * @param snapshot The identifier of a snapshot that has not been dropped.
+	 */
+	void RestoreSnapshot(SnapshotID snapshot)
+	{
+		m_componentManager->RestoreSnapshot(snapshot);
+
+		// the oldest entity table backed up since the snapshot is the table at the snapshot
+		while (!m_entityBackups.empty() && m_entityBackups.back().snapshot >= snapshot)
+		{
+			*m_entityManager = m_entityBackups.back().entities;
+			m_entityBackups.pop_back();
+		}
+	}
+
+	/**
+	 * @brief Drops a snapshot and every older snapshot, freeing the data only they needed.
+	 * @param snapshot The identifier of the newest snapshot to drop.
+	 */
+	void ReleaseSnapshot(SnapshotID snapshot)
+	{
+		m_componentManager->ReleaseSnapshot(snapshot);
+
+		while (!m_entityBackups.empty() && m_entityBackups.front().snapshot <= snapshot)
+		{
+			m_entityBackups.pop_front();
+		}
+	}
+
+	// MEMORY METHODS
+
+	/**
+	 * @brief Reorders the rows of every archetype containing a component by a key computed from it, so that for
+	 * example entities close in space are close in memory. Entity identifiers and components are unchanged, and the
+	 * moved chunks are marked as changed. Must not be called while entities are being iterated or systems are updating.
+	 * @tparam T The component the keys are computed from.
+	 * @param key A callback method that takes a const T& and returns its uint64_t sort key, rows are sorted by
+	 * ascending key and rows with equal keys keep their order.
+	 * @return The number of archetypes whose rows moved.
+	 */
+	template<typename T, typename KeyFunction>
+	size_t SortRows(KeyFunction&& key)
+	{
+		BackupEntities();
+		return m_componentManager->SortRows<T>(GetQuery<T>().GetArchetypes(), key);
+	}
+
+	/**
+	 * @brief Reports the memory used by the scene's entity table, archetypes, queries, command buffers and snapshots.
+	 * Must not be called while systems are updating.
+	 * @return The report, see MemoryReport.h.
+	 */
+	SceneMemoryReport GetMemoryReport() const
+	{
+		SceneMemoryReport report;
+		m_entityManager->GetMemoryReport(report);
+		m_componentManager->GetMemoryReport(report);
+
+		for (const CommandBuffer& buffer : m_commandBuffers)
+		{
+			report.commandBufferBytes += buffer.GetAllocatedBytes();
+		}
+		report.commandBufferBytes += m_playbackCommands.capacity() * sizeof(PlaybackCommand) + m_destroyedEntities.capacity() * sizeof(Entity)
+			+ m_entityChanges.capacity() * sizeof(EntityChange) + m_componentWrites.capacity() * sizeof(ComponentWrite);
+
+		for (const EntityTableBackup& backup : m_entityBackups)
+		{
+			SceneMemoryReport backupReport;
+			backup.entities.GetMemoryReport(backupReport);
+			report.snapshotBytes += sizeof(EntityTableBackup) + backupReport.locationTableBytes + backupReport.freeListBytes;
+		}
+
+		return report;
+	}
+
+	/**
+	 * @brief Frees the memory the scene no longer needs: chunks without entities, unused capacity of the archetype
+	 * metadata, of the command buffers and of the play back scratch storage, and archetypes without entities unless a snapshot can still
+	 * be restored. Must not be called while entities are being iterated or systems are updating.
+	 * @return The number of archetypes freed.
+	 */
+	size_t Compact()
+	{
+		for (CommandBuffer& buffer : m_commandBuffers)
+		{
+			buffer.ShrinkToFit();
+		}
+
+		// the scratch storage is only used during play back, so its contents can be dropped
+		m_playbackCommands = std::vector<PlaybackCommand>();
+		m_destroyedEntities = std::vector<Entity>();
+		m_entityChanges = std::vector<EntityChange>();
+		m_componentWrites = std::vector<ComponentWrite>();
+
+		return m_componentManager->Compact();
 	}
 
 	// SYSTEM METHODS
@@ -188,33 +636,94 @@ public:
 	void UpdateSystems(float dt)
 	{
 		m_systemManager->Update(*this, dt);
+		PlaybackCommandBuffers();
+	}
+
+	/**
+	 * @brief Gets the profiler recording the wall time and work counters of every system update.
+	 */
+	SystemProfiler& GetSystemProfiler()
+	{
+		return m_systemManager->GetProfiler();
 	}
 
 private:
+	friend class SceneSnapshot; // Saves and restores the manager data directly.
+
+	/**
+	 * @struct PlaybackCommand
+	 * @brief A component command of a command buffer, resolved to its target entity during play back.
+	 */
+	struct PlaybackCommand
+	{
+		Entity entity;
+		size_t bufferIndex;
+		size_t commandIndex;
+	};
+
+	/**
+	 * @struct EntityTableBackup
+	 * @brief Copy of the entity table taken before its first change after a snapshot.
+	 */
+	struct EntityTableBackup
+	{
+		SnapshotID snapshot;
+		EntityManager entities;
+	};
+
+	/**
+	 * @brief Copies the entity table before its first change after the newest snapshot, called before every
+	 * structural change.
+	 */
+	void BackupEntities()
+	{
+		SnapshotID snapshot = m_componentManager->GetNewestSnapshot();
+		if (snapshot == INVALID_SNAPSHOT || (!m_entityBackups.empty() && m_entityBackups.back().snapshot == snapshot)) { return; }
+
+		m_entityBackups.push_back({ snapshot, *m_entityManager });
+	}
 
 	/**
 	 * @brief Build a signature given a typearray of component types.
 	 * @tparam ...Components The types of the components.
-	 * @return A signature which has true bits at the registered componented type indexes of the provided types.
+	 * @return A signature which has true bits at the component IDs of the provided types, built at compile time.
 	 */
 	template <typename... Components>
-	Signature BuildSignature()
+	static constexpr Signature BuildSignature()
 	{
-		static const Signature signature(sum((std::powf(2, (float)m_componentManager->GetComponentType<Components>()))...));
+		constexpr Signature signature = MakeSignature<Components...>();
 		return signature;
 	}
 
 	/**
-	 * @brief Sums a variable amount of integers.
+	 * @brief Build a signature of the query terms with a given presence.
+	 * @tparam ...Terms The query terms.
+	 * @param presence The presence of the terms to include.
+	 * @return A signature which has true bits at the component IDs of the matching terms.
 	 */
-	template<typename... Args>
-	static int sum(Args... args) {
-		return (args + ...);
+	template <typename... Terms>
+	static constexpr Signature BuildTermSignature(TermPresence presence)
+	{
+		Signature signature;
+		((QueryTermTraits<Terms>::PRESENCE == presence ? void(signature.set(GetComponentID<TermComponent<Terms>>())) : void()), ...);
+		return signature;
 	}
 
 	std::shared_ptr<ComponentManager> m_componentManager; // A pointer to the component manager.
 	std::shared_ptr<EntityManager> m_entityManager; // A pointer to the entity manager.
 	std::shared_ptr<SystemManager> m_systemManager; // A pointer to the system manager.
+
+	std::array<std::atomic<Query*>, MAX_QUERIES> m_queries; // Queries used by ForEach, indexed by the component set's query index.
+	std::mutex m_queryMutex; // Guards the creation of queries.
+	inline static std::atomic<size_t> m_nextQueryIndex = 0; // Shared counter for assigning each component set a query index.
+
+	std::vector<CommandBuffer> m_commandBuffers; // One command buffer per job system thread slot.
+	std::vector<PlaybackCommand> m_playbackCommands; // Scratch storage used while playing back the command buffers.
+	std::vector<Entity> m_destroyedEntities;
+	std::vector<EntityChange> m_entityChanges;
+	std::vector<ComponentWrite> m_componentWrites;
+
+	std::deque<EntityTableBackup> m_entityBackups; // Entity tables of the snapshots that can still be restored, oldest first.
 };
 
 #endif // ECS_SCENE_H_
\ No newline at end of file
@@ -1,54 +1,81 @@
 #include "EntityManager.h"
+#include <algorithm>
 #include <cassert>
 
-EntityManager::EntityManager()
+EntityManager::EntityManager(uint32_t maxEntities)
 {
-	m_livingEntityCount = 0;
+	assert(maxEntities <= MAX_ENTITY_LIMIT && "Entity limit too high.");
 
-	for (Entity entity = 0; entity < MAX_ENTITIES; ++entity)
-	{
-		m_availableEntities.push(entity);
-	}
+	m_livingEntityCount = 0;
+	m_maxEntities = maxEntities;
 }
 
 Entity EntityManager::CreateEntity()
 {
-	assert(m_livingEntityCount < MAX_ENTITIES && "Too many entities in existence.");
+	if (!CanCreateEntities(1)) { return INVALID_ENTITY; }
+
+	// Reuse the index of a destroyed entity, or take a new index once every index in use is alive
+	uint32_t index;
+	if (!m_availableIndices.empty())
+	{
+		index = m_availableIndices.front();
+		m_availableIndices.pop();
+	}
+	else
+	{
+		index = (uint32_t)m_versions.size();
+		m_versions.push_back(0);
+		m_signatures.emplace_back();
+		m_locations.emplace_back();
+	}
 
-	Entity id = m_availableEntities.front();
-	m_availableEntities.pop();
 	++m_livingEntityCount;
 
-	return id;
+	return MakeEntity(index, m_versions[index]);
+}
+
+bool EntityManager::CanCreateEntities(size_t count) const
+{
+	// new indices are taken up to MAX_ENTITY_LIMIT, so the handle of the highest index is never made
+	size_t freeIndexCount = m_availableIndices.size() + (MAX_ENTITY_LIMIT - m_versions.size());
+	return count <= m_maxEntities - m_livingEntityCount && count <= freeIndexCount;
 }
 
 void EntityManager::DestroyEntity(Entity entity)
 {
-	assert(entity < MAX_ENTITIES && "Entity out of range.");
+	assert(DoesEntityExist(entity) && "Entity does not exist.");
 
-	// Invalidate the destroyed entity's signature
-	m_signatures[entity].reset();
+	uint32_t index = GetEntityIndex(entity);
 
-	// Put the destroyed ID at the back of the queue
-	m_availableEntities.push(entity);
+	// Invalidate the destroyed entity's signature and every existing handle to it
+	m_signatures[index].reset();
+	m_locations[index] = EntityLocation();
+	m_versions[index]++;
 	--m_livingEntityCount;
 
+	// Put the destroyed index at the back of the queue, unless its versions have run out and reusing it would
+	// let the handles of its first entity through again
+	if (m_versions[index] != RETIRED_ENTITY_VERSION)
+	{
+		m_availableIndices.push(index);
+	}
+
 }
 
 void EntityManager::SetSignature(Entity entity, Signature signature)
 {
-	assert(entity < MAX_ENTITIES && "Entity out of range.");
+	assert(DoesEntityExist(entity) && "Entity does not exist.");
 
 	// Put this entity's signature into the array
-	m_signatures[entity] = signature;
+	m_signatures[GetEntityIndex(entity)] = signature;
 }
 
 Signature EntityManager::GetSignature(Entity entity)
 {
-	assert(entity < MAX_ENTITIES && "Entity out of range.");
+	assert(DoesEntityExist(entity) && "Entity does not exist.");
 
 	// Get this entity's signature from the array
-	return m_signatures[entity];
+	return m_signatures[GetEntityIndex(entity)];
 }
 
 uint32_t EntityManager::GetEntityCount()
@@ -58,10 +85,54 @@ uint32_t EntityManager::GetEntityCount()
 
 bool EntityManager::DoesEntityExist(Entity entity)
 {
-	return m_signatures[entity].any();
+	// Handles to destroyed entities have an older version than their index
+	uint32_t index = GetEntityIndex(entity);
+	return index < m_versions.size() && m_versions[index] == GetEntityVersion(entity);
 }
 
 bool EntityManager::HasComponent(Entity entity, ComponentType componentType)
 {
-	return m_signatures[entity].test(componentType);
+	return DoesEntityExist(entity) && m_signatures[GetEntityIndex(entity)].test(componentType);
+}
+
+std::vector<uint32_t> EntityManager::GetAvailableIndices() const
+{
+	std::vector<uint32_t> indices;
+	indices.reserve(m_availableIndices.size());
+
+	std::queue<uint32_t> available = m_availableIndices;
+	while (!available.empty())
+	{
+		indices.push_back(available.front());
+		available.pop();
+	}
+
+	return indices;
+}
+
+void EntityManager::Restore(const EntityVersion* versions, uint32_t indexCount, const uint32_t* availableIndices, uint32_t availableCount)
+{
+	assert(m_versions.empty() && "Entities can only be restored into an empty entity manager.");
+
+	m_versions.assign(versions, versions + indexCount);
+	uint32_t retiredCount = (uint32_t)std::count(m_versions.begin(), m_versions.end(), RETIRED_ENTITY_VERSION);
+	assert(indexCount - availableCount - retiredCount <= m_maxEntities && "Too many entities in existence.");
+
+	m_signatures.resize(indexCount);
+	m_locations.resize(indexCount);
+
+	for (uint32_t i = 0; i < availableCount; i++)
+	{
+		m_availableIndices.push(availableIndices[i]);
+	}
+
+	m_livingEntityCount = indexCount - availableCount - retiredCount;
+}
+
+void EntityManager::GetMemoryReport(SceneMemoryReport& report) const
+{
+	report.locationTableBytes += m_signatures.capacity() * sizeof(Signature) + m_versions.capacity() * sizeof(EntityVersion) + m_locations.capacity() * sizeof(EntityLocation);
+
+	// the queue's deque allocates in blocks, so this counts the indices rather than the blocks
+	report.freeListBytes += m_availableIndices.size() * sizeof(uint32_t);
 }
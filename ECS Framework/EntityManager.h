@@ -1,30 +1,75 @@
 #pragma once
 #include "Definitions.h"
+#include "MemoryReport.h"
 #include <queue>
-#include <array>
+#include <vector>
 
 class EntityManager
 {
 public:
-	EntityManager();
+	EntityManager(uint32_t maxEntities = DEFAULT_MAX_ENTITIES);
 
+	/**
+	 * @brief Creates an entity, reusing the oldest free index if there is one.
+	 * @return The new entity, INVALID_ENTITY if the entity limit is reached or every index is in use or retired.
+	 */
 	Entity CreateEntity();
 
+	/**
+	 * @brief Checks that a number of entities can be created without reaching the entity limit or running out of indices.
+	 */
+	bool CanCreateEntities(size_t count) const;
+
 	void DestroyEntity(Entity entity);
 
 	void SetSignature(Entity entity, Signature signature);
 	Signature GetSignature(Entity entity);
 
 	uint32_t GetEntityCount();
+	uint32_t GetMaxEntities() const { return m_maxEntities; }
 
 	bool DoesEntityExist(Entity entity);
 
 	bool HasComponent(Entity entity, ComponentType componentType);
 
+	/**
+	 * @brief Gets the location records of every entity index, the archetypes update them as rows move.
+	 */
+	std::vector<EntityLocation>& GetLocations() { return m_locations; }
+
+	/**
+	 * @brief Gets the current version of every entity index that has been used.
+	 */
+	const std::vector<EntityVersion>& GetVersions() const { return m_versions; }
+
+	/**
+	 * @brief Gets the indices of destroyed entities, in the order they will be reused.
+	 */
+	std::vector<uint32_t> GetAvailableIndices() const;
+
+	/**
+	 * @brief Restores the entity table of a saved scene into an empty entity manager. Every index that is neither
+	 * available nor retired is alive with the given version and no components, signatures are set as components
+	 * are restored.
+	 * @param versions The version of every used entity index.
+	 * @param indexCount The number of used entity indices.
+	 * @param availableIndices The indices of destroyed entities, in reuse order.
+	 * @param availableCount The number of available indices.
+	 */
+	void Restore(const EntityVersion* versions, uint32_t indexCount, const uint32_t* availableIndices, uint32_t availableCount);
+
+	/**
+	 * @brief Adds the memory of the entity table and the free list of entity indices to a report.
+	 * @param report The report to fill in.
+	 */
+	void GetMemoryReport(SceneMemoryReport& report) const;
+
 private:
-	std::queue<Entity> m_availableEntities;
-	std::array<Signature, MAX_ENTITIES> m_signatures;
+	std::queue<uint32_t> m_availableIndices; // Indices of destroyed entities, reused oldest first.
+	std::vector<Signature> m_signatures; // Signature of each entity index, grows as new indices are used.
+	std::vector<EntityVersion> m_versions; // Current version of each entity index, RETIRED_ENTITY_VERSION once retired.
+	std::vector<EntityLocation> m_locations; // Archetype and row of each entity index.
 	uint32_t m_livingEntityCount;
+	uint32_t m_maxEntities;
 
 };
-
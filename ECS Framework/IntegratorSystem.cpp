@@ -1,6 +1,209 @@
 #include "IntegratorSystem.h"
+#include <immintrin.h>
+#include <cstddef>
 
 const float DAMPING_FACTOR = 0.99f;
+
+namespace
+{
+	/**
+	 * @struct AngularStreams
+	 * @brief The rigid body streams used by the angular step, one per float, starting at the first row of a range.
+	 */
+	struct AngularStreams
+	{
+		float* velocity[3]; // Angular velocity.
+		const float* torque[3];
+		const float* inertia[3]; // Local inverse inertia.
+		float* tensor[9]; // World space inverse inertia tensor, row major.
+
+		AngularStreams(const ComponentStreams<RigidBody>& rigidBodies)
+		{
+			for (size_t axis = 0; axis < 3; axis++)
+			{
+				velocity[axis] = rigidBodies.GetStream(offsetof(RigidBody, angularVelocity), axis).data();
+				torque[axis] = rigidBodies.GetStream(offsetof(RigidBody, torque), axis).data();
+				inertia[axis] = rigidBodies.GetStream(offsetof(RigidBody, inverseInertia), axis).data();
+			}
+
+			for (size_t element = 0; element < 9; element++)
+			{
+				tensor[element] = rigidBodies.GetStream(offsetof(RigidBody, inverseInertiaTensor), element).data();
+			}
+		}
+	};
+
+#if defined(__AVX2__)
+	/**
+	 * @struct Float8
+	 * @brief Eight floats in an AVX2 register, one per entity. Only used by builds that enable AVX2, such as with
+	 * /arch:AVX2, as the default build has to run on processors without it.
+	 */
+	struct Float8
+	{
+		__m256 values;
+
+		Float8(__m256 values) : values(values) {}
+		Float8(float value) : values(_mm256_set1_ps(value)) {}
+	};
+
+	Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.values, b.values); }
+	Float8 operator-(Float8 a, Float8 b) { return _mm256_sub_ps(a.values, b.values); }
+	Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.values, b.values); }
+	Float8 operator/(Float8 a, Float8 b) { return _mm256_div_ps(a.values, b.values); }
+
+	Float8 LoadLanes(const float* source, Float8) { return _mm256_loadu_ps(source); }
+	void StoreLanes(float* destination, Float8 value) { _mm256_storeu_ps(destination, value.values); }
+	Float8 SqrtLanes(Float8 value) { return _mm256_sqrt_ps(value.values); }
+	Float8 SelectIfZero(Float8 value, Float8 ifZero, Float8 otherwise)
+	{
+		return _mm256_blendv_ps(otherwise.values, ifZero.values, _mm256_cmp_ps(value.values, _mm256_setzero_ps(), _CMP_EQ_OQ));
+	}
+	Float8 SelectIfPositive(Float8 value, Float8 ifPositive, Float8 otherwise)
+	{
+		return _mm256_blendv_ps(otherwise.values, ifPositive.values, _mm256_cmp_ps(value.values, _mm256_setzero_ps(), _CMP_GT_OQ));
+	}
+
+	using AngularLanes = Float8;
+#elif defined(__SSE2__) || defined(_M_X64)
+	/**
+	 * @struct Float8
+	 * @brief Eight floats in two SSE registers, every x64 processor supports these so the default build still steps
+	 * eight entities at a time, which keeps the gathering per block as low as with AVX2.
+	 */
+	struct Float8
+	{
+		__m128 low, high;
+
+		Float8(__m128 low, __m128 high) : low(low), high(high) {}
+		Float8(float value) : low(_mm_set1_ps(value)), high(low) {}
+	};
+
+	Float8 operator+(Float8 a, Float8 b) { return { _mm_add_ps(a.low, b.low), _mm_add_ps(a.high, b.high) }; }
+	Float8 operator-(Float8 a, Float8 b) { return { _mm_sub_ps(a.low, b.low), _mm_sub_ps(a.high, b.high) }; }
+	Float8 operator*(Float8 a, Float8 b) { return { _mm_mul_ps(a.low, b.low), _mm_mul_ps(a.high, b.high) }; }
+	Float8 operator/(Float8 a, Float8 b) { return { _mm_div_ps(a.low, b.low), _mm_div_ps(a.high, b.high) }; }
+
+	Float8 LoadLanes(const float* source, Float8) { return { _mm_loadu_ps(source), _mm_loadu_ps(source + 4) }; }
+	void StoreLanes(float* destination, Float8 value) { _mm_storeu_ps(destination, value.low); _mm_storeu_ps(destination + 4, value.high); }
+	Float8 SqrtLanes(Float8 value) { return { _mm_sqrt_ps(value.low), _mm_sqrt_ps(value.high) }; }
+
+	__m128 Select(__m128 mask, __m128 ifSet, __m128 otherwise) { return _mm_or_ps(_mm_and_ps(mask, ifSet), _mm_andnot_ps(mask, otherwise)); }
+	Float8 SelectIfZero(Float8 value, Float8 ifZero, Float8 otherwise)
+	{
+		return { Select(_mm_cmpeq_ps(value.low, _mm_setzero_ps()), ifZero.low, otherwise.low), Select(_mm_cmpeq_ps(value.high, _mm_setzero_ps()), ifZero.high, otherwise.high) };
+	}
+	Float8 SelectIfPositive(Float8 value, Float8 ifPositive, Float8 otherwise)
+	{
+		return { Select(_mm_cmpgt_ps(value.low, _mm_setzero_ps()), ifPositive.low, otherwise.low), Select(_mm_cmpgt_ps(value.high, _mm_setzero_ps()), ifPositive.high, otherwise.high) };
+	}
+
+	using AngularLanes = Float8;
+#else
+	using AngularLanes = float;
+#endif
+
+	// lane operations for a single entity, used for the rows left over after the last full block
+	float LoadLanes(const float* source, float) { return *source; }
+	void StoreLanes(float* destination, float value) { *destination = value; }
+	float SqrtLanes(float value) { return sqrtf(value); }
+	float SelectIfZero(float value, float ifZero, float otherwise) { return value == 0.0f ? ifZero : otherwise; }
+	float SelectIfPositive(float value, float ifPositive, float otherwise) { return value > 0.0f ? ifPositive : otherwise; }
+
+	/**
+	 * @brief Integrates the angular movement of as many consecutive entities as T holds, starting at a row of the
+	 * streams. Written once for both a single float and a full block of lanes, so the rows left over give the same results.
+	 * The rigid body fields are loaded straight from their streams, only the orientation and the mass, which belong
+	 * to components stored whole, are gathered. Things with infinite mass are left untouched.
+	 */
+	template <typename T>
+	void IntegrateAngularLanes(const AngularStreams& streams, size_t row, const Particle* particles, Transform* transforms, float dt, float frameDamping)
+	{
+		constexpr size_t LANE_COUNT = sizeof(T) / sizeof(float);
+
+		alignas(32) float gathered[5][LANE_COUNT];
+		bool allMovable = true;
+		for (size_t lane = 0; lane < LANE_COUNT; lane++)
+		{
+			const Quaternion& rotation = transforms[lane].rotation;
+			gathered[0][lane] = rotation.r; gathered[1][lane] = rotation.i; gathered[2][lane] = rotation.j; gathered[3][lane] = rotation.k;
+			gathered[4][lane] = particles[lane].inverseMass;
+			allMovable = allMovable && particles[lane].inverseMass > 0.0f;
+		}
+
+		T r = LoadLanes(gathered[0], T(0.0f)), i = LoadLanes(gathered[1], T(0.0f)), j = LoadLanes(gathered[2], T(0.0f)), k = LoadLanes(gathered[3], T(0.0f));
+		T inverseMass = LoadLanes(gathered[4], T(0.0f));
+		T inertiaX = LoadLanes(streams.inertia[0] + row, T(0.0f)), inertiaY = LoadLanes(streams.inertia[1] + row, T(0.0f)), inertiaZ = LoadLanes(streams.inertia[2] + row, T(0.0f));
+		T torqueX = LoadLanes(streams.torque[0] + row, T(0.0f)), torqueY = LoadLanes(streams.torque[1] + row, T(0.0f)), torqueZ = LoadLanes(streams.torque[2] + row, T(0.0f));
+		T velocityX = LoadLanes(streams.velocity[0] + row, T(0.0f)), velocityY = LoadLanes(streams.velocity[1] + row, T(0.0f)), velocityZ = LoadLanes(streams.velocity[2] + row, T(0.0f));
+		T one = 1.0f, two = 2.0f, halfDt = 0.5f * dt, timeStep = dt, damping = frameDamping;
+
+		// world space inverse inertia tensor, R * diag(inverseInertia) * R^T with R the rotation matrix of the orientation
+		T xx = i * i, yy = j * j, zz = k * k;
+		T xy = i * j, xz = i * k, yz = j * k;
+		T xw = i * r, yw = j * r, zw = k * r;
+
+		T m00 = one - two * (yy + zz), m01 = two * (xy + zw), m02 = two * (xz - yw);
+		T m10 = two * (xy - zw), m11 = one - two * (xx + zz), m12 = two * (yz + xw);
+		T m20 = two * (xz + yw), m21 = two * (yz - xw), m22 = one - two * (xx + yy);
+
+		T s00 = m00 * inertiaX, s01 = m01 * inertiaY, s02 = m02 * inertiaZ;
+		T s10 = m10 * inertiaX, s11 = m11 * inertiaY, s12 = m12 * inertiaZ;
+		T s20 = m20 * inertiaX, s21 = m21 * inertiaY, s22 = m22 * inertiaZ;
+
+		T t00 = s00 * m00 + s01 * m01 + s02 * m02, t01 = s00 * m10 + s01 * m11 + s02 * m12, t02 = s00 * m20 + s01 * m21 + s02 * m22;
+		T t10 = s10 * m00 + s11 * m01 + s12 * m02, t11 = s10 * m10 + s11 * m11 + s12 * m12, t12 = s10 * m20 + s11 * m21 + s12 * m22;
+		T t20 = s20 * m00 + s21 * m01 + s22 * m02, t21 = s20 * m10 + s21 * m11 + s22 * m12, t22 = s20 * m20 + s21 * m21 + s22 * m22;
+
+		// angular acceleration from the torque
+		velocityX = velocityX + (t00 * torqueX + t01 * torqueY + t02 * torqueZ) * timeStep;
+		velocityY = velocityY + (t10 * torqueX + t11 * torqueY + t12 * torqueZ) * timeStep;
+		velocityZ = velocityZ + (t20 * torqueX + t21 * torqueY + t22 * torqueZ) * timeStep;
+
+		// rotation += (0, angularVelocity * dt / 2) * rotation, then renormalise
+		T wx = velocityX * halfDt, wy = velocityY * halfDt, wz = velocityZ * halfDt;
+		T newR = r - wx * i - wy * j - wz * k;
+		T newI = i + wx * r + wy * k - wz * j;
+		T newJ = j + wy * r + wz * i - wx * k;
+		T newK = k + wz * r + wx * j - wy * i;
+
+		T magnitude = SqrtLanes(newR * newR + newI * newI + newJ * newJ + newK * newK);
+		T inverseMagnitude = one / SelectIfZero(magnitude, one, magnitude);
+		StoreLanes(gathered[0], SelectIfZero(magnitude, one, newR * inverseMagnitude));
+		StoreLanes(gathered[1], SelectIfZero(magnitude, T(0.0f), newI * inverseMagnitude));
+		StoreLanes(gathered[2], SelectIfZero(magnitude, T(0.0f), newJ * inverseMagnitude));
+		StoreLanes(gathered[3], SelectIfZero(magnitude, T(0.0f), newK * inverseMagnitude));
+
+		// streams of static entities keep their values, which only needs the old values when a block mixes both
+		auto storeMovable = [&](float* destination, T value) {
+			StoreLanes(destination, allMovable ? value : SelectIfPositive(inverseMass, value, LoadLanes(destination, T(0.0f))));
+			};
+
+		storeMovable(streams.velocity[0] + row, velocityX * damping);
+		storeMovable(streams.velocity[1] + row, velocityY * damping);
+		storeMovable(streams.velocity[2] + row, velocityZ * damping);
+
+		T tensor[9] = { t00, t01, t02, t10, t11, t12, t20, t21, t22 };
+		for (size_t element = 0; element < 9; element++)
+		{
+			storeMovable(streams.tensor[element] + row, tensor[element]);
+		}
+
+		for (size_t lane = 0; lane < LANE_COUNT; lane++)
+		{
+			if (particles[lane].inverseMass <= 0.0f) continue;
+			transforms[lane].rotation = Quaternion(gathered[0][lane], gathered[1][lane], gathered[2][lane], gathered[3][lane]);
+		}
+	}
+}
+
+void IntegratorSystem::DeclareAccess(SystemAccess& access)
+{
+	access.Write<Particle>();
+	access.Write<RigidBody>();
+	access.Write<Transform>();
+}
+
 void IntegratorSystem::Update(ECSScene& scene, float dt)
 {
 	assert(dt > 0.0);
@@ -8,7 +211,7 @@ void IntegratorSystem::Update(ECSScene& scene, float dt)
 	float frameDamping = std::powf(DAMPING_FACTOR, dt);
 
 	// integrate linear movement
-	scene.ForEach<Particle, Transform>([dt, frameDamping](Entity entity, Particle* particle, Transform* transform)
+	scene.ParallelForEach<Particle, Transform>([dt, frameDamping](Entity entity, Particle* particle, Transform* transform)
 		{
 			// dont integrate things with infinite mass
 			if (particle->inverseMass <= 0.0f) return;
@@ -26,25 +229,20 @@ void IntegratorSystem::Update(ECSScene& scene, float dt)
 			particle->force = Vector3::Zero;
 		});
 
-	// integrate angular movement
-	scene.ForEach<Particle, RigidBody, Transform>([dt, frameDamping](Entity entity, Particle* particle, RigidBody* rigidBody, Transform* transform)
+	// integrate angular movement a register of entities at a time, straight over the rigid body streams
+	scene.ParallelForEachChunk<const Particle, RigidBody, Transform>([dt, frameDamping](size_t count, std::span<const Entity> entities, std::span<const Particle> particles, ComponentStreams<RigidBody> rigidBodies, std::span<Transform> transforms)
 		{
-			// dont integrate things with infinite mass
-			if (particle->inverseMass <= 0.0f) return;
-
-			// update inertia tensor
-			Quaternion q = transform->rotation;
-			Matrix3 invOrientation = q.conjugate().toMatrix3();
-			Matrix3 orientation = q.toMatrix3();
-
-			rigidBody->inverseInertiaTensor = orientation * Matrix3(rigidBody->inverseInertia) * invOrientation;
-
-			Vector3 angAccel = rigidBody->inverseInertiaTensor * rigidBody->torque;
-			rigidBody->angularVelocity += angAccel * dt;
-
-			transform->rotation += Quaternion(0.0f, rigidBody->angularVelocity * dt * 0.5f) * q;
-			transform->rotation.normalize();
+			constexpr size_t LANE_COUNT = sizeof(AngularLanes) / sizeof(float);
+			AngularStreams streams(rigidBodies);
 
-			rigidBody->angularVelocity *= frameDamping;
+			size_t row = 0;
+			for (; row + LANE_COUNT <= count; row += LANE_COUNT)
+			{
+				IntegrateAngularLanes<AngularLanes>(streams, row, &particles[row], &transforms[row], dt, frameDamping);
+			}
+			for (; row < count; row++)
+			{
+				IntegrateAngularLanes<float>(streams, row, &particles[row], &transforms[row], dt, frameDamping);
+			}
 		});
 }
@@ -6,4 +6,6 @@ class IntegratorSystem : public System
 {
 public:
 	void Update(ECSScene& scene, float dt) final override;
-};
\ No newline at end of file
+	void DeclareAccess(SystemAccess& access) final override;
+	const char* GetName() const final override { return "IntegratorSystem"; }
+};
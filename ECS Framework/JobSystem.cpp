@@ -0,0 +1,176 @@
+#include "JobSystem.h"
+
+namespace
+{
+	thread_local size_t t_threadIndex = 0; // Queue slot of the current thread, 0 for threads outside the pool.
+}
+
+JobSystem& JobSystem::GetInstance()
+{
+	static JobSystem instance;
+	return instance;
+}
+
+JobSystem::JobSystem()
+{
+	// leave a hardware thread for the thread that waits on the jobs
+	size_t hardwareThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+	for (size_t i = 0; i < hardwareThreads; i++)
+	{
+		m_queues.push_back(std::make_unique<WorkQueue>());
+	}
+
+	for (size_t i = 1; i < hardwareThreads; i++)
+	{
+		m_workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_running = false;
+	}
+	m_sleepCondition.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+size_t JobSystem::GetThreadIndex()
+{
+	return t_threadIndex;
+}
+
+void JobSystem::Submit(const Job& job, size_t threadIndex)
+{
+	WorkQueue& queue = *m_queues[threadIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+		queue.size++;
+	}
+
+	if (!job.pinned)
+	{
+		m_stealableJobCount++;
+	}
+
+	// take the lock so a worker can not miss the notification between checking for work and sleeping
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	m_sleepCondition.notify_all();
+}
+
+void JobSystem::Wait(const std::atomic<size_t>& counter)
+{
+	size_t threadIndex = GetThreadIndex();
+
+	while (counter.load() > 0)
+	{
+		if (!TryExecuteJob(threadIndex))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::WorkerLoop(size_t threadIndex)
+{
+	t_threadIndex = threadIndex;
+	WorkQueue& ownQueue = *m_queues[threadIndex];
+
+	while (m_running)
+	{
+		if (TryExecuteJob(threadIndex))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_sleepCondition.wait(lock, [&]() {
+			return !m_running || ownQueue.size.load() > 0 || m_stealableJobCount.load() > 0;
+			});
+	}
+}
+
+bool JobSystem::TryExecuteJob(size_t threadIndex)
+{
+	Job job;
+	if (!PopJob(threadIndex, job) && !StealJob(threadIndex, job))
+	{
+		return false;
+	}
+
+	job.function(job.data, job.begin, job.end);
+	job.counter->fetch_sub(1);
+
+	return true;
+}
+
+bool JobSystem::PopJob(size_t threadIndex, Job& job)
+{
+	WorkQueue& queue = *m_queues[threadIndex];
+	if (queue.size.load() == 0)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty())
+	{
+		return false;
+	}
+
+	// the owner takes the most recently pushed job, which is the most likely to be in cache
+	job = queue.jobs.back();
+	queue.jobs.pop_back();
+	queue.size--;
+
+	if (!job.pinned)
+	{
+		m_stealableJobCount--;
+	}
+
+	return true;
+}
+
+bool JobSystem::StealJob(size_t threadIndex, Job& job)
+{
+	if (m_stealableJobCount.load() == 0)
+	{
+		return false;
+	}
+
+	for (size_t offset = 1; offset < m_queues.size(); offset++)
+	{
+		WorkQueue& queue = *m_queues[(threadIndex + offset) % m_queues.size()];
+		if (queue.size.load() == 0)
+		{
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		// thieves take the oldest job that is not pinned to the queue's owner
+		auto it = std::find_if(queue.jobs.begin(), queue.jobs.end(), [](const Job& queued) { return !queued.pinned; });
+		if (it == queue.jobs.end())
+		{
+			continue;
+		}
+
+		job = *it;
+		queue.jobs.erase(it);
+		queue.size--;
+		m_stealableJobCount--;
+
+		return true;
+	}
+
+	return false;
+}
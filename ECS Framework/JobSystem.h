@@ -0,0 +1,179 @@
+// Work-stealing job system shared by the engine.
+//
+// Every worker thread owns a queue of jobs. A thread pops jobs from the back of its own
+// queue and, when that is empty, steals from the front of the other queues. Threads that
+// wait for jobs to finish keep executing jobs while they wait, so jobs may safely submit
+// and wait on further jobs.
+
+#pragma once
+#ifndef JOB_SYSTEM_H_
+#define JOB_SYSTEM_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @struct ParallelOptions
+ * @brief Controls how a parallel loop is split into jobs.
+ */
+struct ParallelOptions
+{
+	size_t grainSize = 256; // Maximum number of items processed by a single job.
+
+	// When true, work is split independently of thread timing: each range is pinned to a fixed lane and
+	// ranges are never stolen, so a given item is always processed by the same lane, in the same order
+	// relative to the other items of that lane. Lane 0 is the calling thread and every other lane is the
+	// worker with that slot, so the loop never relies on another thread outside the pool to make progress.
+	bool deterministic = false;
+};
+
+/**
+ * @struct Job
+ * @brief A unit of work processing the items [begin, end) of a task.
+ */
+struct Job
+{
+	void (*function)(void* data, size_t begin, size_t end) = nullptr; // Function executing the job.
+	void* data = nullptr; // User data passed to the function.
+	size_t begin = 0; // First item processed by the job.
+	size_t end = 0; // One past the last item processed by the job.
+	std::atomic<size_t>* counter = nullptr; // Decremented once the job has finished.
+	bool pinned = false; // Pinned jobs are only executed by the thread owning the queue they were pushed to.
+};
+
+/**
+ * @class JobSystem
+ * @brief Thread pool executing jobs with per-thread queues and work stealing.
+ */
+class JobSystem
+{
+public:
+	JobSystem(const JobSystem&) = delete;
+	void operator=(const JobSystem&) = delete;
+
+	/**
+	 * @brief Gets the job system shared by the engine, creating it on first use.
+	 */
+	static JobSystem& GetInstance();
+
+	/**
+	 * @brief Gets the number of threads that execute jobs, including the thread that waits for them.
+	 */
+	size_t GetThreadCount() const { return m_queues.size(); }
+
+	/**
+	 * @brief Gets the queue slot of the calling thread. Worker threads have slots 1 and above, and every
+	 * thread not owned by the job system uses slot 0.
+	 */
+	static size_t GetThreadIndex();
+
+	/**
+	 * @brief Pushes a job onto a queue.
+	 * @param job The job to push. Its counter must already account for it.
+	 * @param threadIndex The queue slot to push to.
+	 */
+	void Submit(const Job& job, size_t threadIndex);
+
+	/**
+	 * @brief Executes jobs on the calling thread until the counter reaches zero.
+	 * @param counter The counter of the jobs to wait for.
+	 */
+	void Wait(const std::atomic<size_t>& counter);
+
+	/**
+	 * @brief Calls a function for every range of a loop, splitting the ranges across all threads and
+	 * returning once every range has been processed.
+	 * @param count The number of items in the loop.
+	 * @param options The grain size and scheduling mode of the loop.
+	 * @param function A callable with the parameters: size_t begin, size_t end.
+	 */
+	template<typename Function>
+	void ParallelFor(size_t count, const ParallelOptions& options, Function&& function)
+	{
+		if (count == 0) { return; }
+
+		size_t grainSize = options.grainSize > 0 ? options.grainSize : 1;
+		size_t jobCount = (count + grainSize - 1) / grainSize;
+
+		// small loops run on the calling thread
+		if (jobCount == 1 || GetThreadCount() == 1)
+		{
+			for (size_t begin = 0; begin < count; begin += grainSize)
+			{
+				function(begin, std::min(begin + grainSize, count));
+			}
+			return;
+		}
+
+		std::atomic<size_t> counter = jobCount;
+
+		Job job;
+		job.function = [](void* data, size_t begin, size_t end) { (*static_cast<std::remove_reference_t<Function>*>(data))(begin, end); };
+		job.data = const_cast<void*>(static_cast<const void*>(&function));
+		job.counter = &counter;
+		job.pinned = options.deterministic;
+
+		// deterministic loops always map a range to the same lane, other loops start on the calling thread's
+		// queue and let idle threads steal
+		size_t laneCount = GetThreadCount();
+		for (size_t i = 0; i < jobCount; i++)
+		{
+			if (options.deterministic && i % laneCount == 0) { continue; }
+
+			job.begin = i * grainSize;
+			job.end = std::min(job.begin + grainSize, count);
+			Submit(job, options.deterministic ? i % laneCount : GetThreadIndex());
+		}
+
+		// slot 0 is shared by every thread outside the pool, so the calling thread runs lane 0 itself rather than
+		// queueing it. A worker calling the loop runs its own lane from its queue while it waits
+		if (options.deterministic)
+		{
+			for (size_t i = 0; i < jobCount; i += laneCount)
+			{
+				function(i * grainSize, std::min(i * grainSize + grainSize, count));
+				counter.fetch_sub(1);
+			}
+		}
+
+		Wait(counter);
+	}
+
+private:
+	/**
+	 * @struct WorkQueue
+	 * @brief The jobs owned by a single thread.
+	 */
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+		std::atomic<size_t> size = 0; // Number of jobs in the queue, readable without the lock.
+	};
+
+	JobSystem();
+	~JobSystem();
+
+	void WorkerLoop(size_t threadIndex);
+	bool TryExecuteJob(size_t threadIndex);
+	bool PopJob(size_t threadIndex, Job& job);
+	bool StealJob(size_t threadIndex, Job& job);
+
+	std::vector<std::unique_ptr<WorkQueue>> m_queues; // One queue per thread slot, slot 0 is for threads outside the pool.
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_sleepCondition;
+	std::atomic<size_t> m_stealableJobCount = 0; // Number of queued jobs that are not pinned.
+	std::atomic<bool> m_running = true;
+};
+
+#endif // JOB_SYSTEM_H_
@@ -0,0 +1,50 @@
+// Read only memory mapped file, used to load binary data without copying
+// it through a stream first.
+
+#pragma once
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+#include <cstddef>
+#include <string>
+
+/**
+ * @class MappedFile
+ * @brief Maps the whole of a file into memory as read only data. Pages are read from disk as they are first
+ * touched, so opening a file costs nothing until its data is used.
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	 * @brief Maps a file, unmapping any file that is already mapped.
+	 * @param path The path of the file.
+	 * @return True if the file was mapped, false if it could not be opened or is empty.
+	 */
+	bool Open(const std::string& path);
+
+	/**
+	 * @brief Unmaps the file. Pointers into the file's data are invalidated.
+	 */
+	void Close();
+
+	bool IsOpen() const { return m_data != nullptr; }
+	const char* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+
+private:
+	const char* m_data = nullptr; // Start of the mapped view, null when no file is mapped.
+	size_t m_size = 0; // Size of the file in bytes.
+
+#ifdef _WIN32
+	void* m_fileHandle = nullptr; // Handle of the open file.
+	void* m_mappingHandle = nullptr; // Handle of the file mapping object.
+#endif
+};
+
+#endif // MAPPED_FILE_H_
@@ -0,0 +1,100 @@
+// Memory accounting of a scene's ECS storage.
+//
+// Every figure is in bytes and counts allocated capacity, not just the elements in use, so the difference between
+// the two is memory that compaction or a smaller reservation could give back. Node based containers such as the
+// archetype map are estimated from their element and bucket counts.
+
+#pragma once
+#ifndef MEMORY_REPORT_H_
+#define MEMORY_REPORT_H_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Definitions.h"
+
+/**
+ * @struct ColumnMemoryReport
+ * @brief Memory of one component type's column, summed over every chunk of an archetype.
+ */
+struct ColumnMemoryReport
+{
+	ComponentType type = INVALID_COMPONENT_TYPE;
+	size_t elementSize = 0;
+	size_t usedBytes = 0; // Rows holding an entity.
+	size_t capacityBytes = 0; // Every row of every allocated chunk.
+};
+
+/**
+ * @struct ArchetypeMemoryReport
+ * @brief Memory of one archetype. The chunk bytes are split into the rows in use, free rows and the padding left
+ * after the columns are aligned to cache lines.
+ */
+struct ArchetypeMemoryReport
+{
+	Signature signature;
+	uint32_t entityCount = 0;
+	size_t chunkCount = 0;
+	size_t emptyChunkCount = 0; // Allocated chunks without rows, freed by compaction.
+	size_t chunkBytes = 0; // Every chunk allocation.
+	size_t usedRowBytes = 0; // Entity identifiers and components of the rows in use.
+	size_t freeRowBytes = 0; // Entity identifiers and components of the rows not in use.
+	size_t paddingBytes = 0; // Chunk bytes outside of any row.
+	size_t metadataBytes = 0; // Chunk list, change versions, backup epochs, column table and graph edges.
+	size_t snapshotBytes = 0; // Column backups kept for snapshots, including recycled backups.
+	size_t spareBytes = 0; // Part of the metadata bytes allocated beyond the size of its vectors.
+	std::vector<ColumnMemoryReport> columns; // One per component type, in ascending type order.
+
+	size_t GetTotalBytes() const { return chunkBytes + metadataBytes + snapshotBytes; }
+	size_t GetWastedBytes() const { return freeRowBytes + paddingBytes + spareBytes; }
+};
+
+/**
+ * @struct SceneMemoryReport
+ * @brief Memory of a scene's entity table, archetypes and the structures around them.
+ */
+struct SceneMemoryReport
+{
+	std::vector<ArchetypeMemoryReport> archetypes; // Every archetype except the empty root, in creation order.
+	size_t emptyArchetypeCount = 0; // Archetypes without entities, freed by compaction.
+
+	size_t locationTableBytes = 0; // Location, version and signature of every used entity index.
+	size_t freeListBytes = 0; // Indices of destroyed entities waiting to be reused.
+	size_t archetypeMapBytes = 0; // Signature to archetype map and the empty root archetype, estimated.
+	size_t queryBytes = 0; // Queries, their matched archetype lists and parallel loop scratch ranges.
+	size_t commandBufferBytes = 0; // Capacity of the command buffers and play back scratch storage.
+	size_t snapshotBytes = 0; // Entity tables kept for snapshots.
+
+	/**
+	 * @brief Gets the total bytes of every archetype.
+	 */
+	size_t GetArchetypeBytes() const
+	{
+		size_t bytes = 0;
+		for (const ArchetypeMemoryReport& archetype : archetypes)
+		{
+			bytes += archetype.GetTotalBytes();
+		}
+		return bytes;
+	}
+
+	/**
+	 * @brief Gets the bytes of every archetype that hold no data, see ArchetypeMemoryReport::GetWastedBytes.
+	 */
+	size_t GetWastedBytes() const
+	{
+		size_t bytes = 0;
+		for (const ArchetypeMemoryReport& archetype : archetypes)
+		{
+			bytes += archetype.GetWastedBytes();
+		}
+		return bytes;
+	}
+
+	size_t GetTotalBytes() const
+	{
+		return GetArchetypeBytes() + locationTableBytes + freeListBytes + archetypeMapBytes + queryBytes + commandBufferBytes + snapshotBytes;
+	}
+};
+
+#endif // MEMORY_REPORT_H_
@@ -1,14 +1,27 @@
 #include "NarrowPhaseSystem.h"
 #include "Components.h"
 #include "ECSScene.h"
-#include "AABBTree.h"
+#include "BroadPhase.h"
 #include "Collision.h"
+#include <algorithm>
+
+void NarrowPhaseSystem::DeclareAccess(SystemAccess& access)
+{
+    access.Read<Collider>();
+    access.Read<PhysicsMaterial>();
+    access.Read<Spring>();
+    access.Write<Transform>();
+    access.Write<Particle>();
+    access.Write<RigidBody>();
+    access.WriteResource(&m_broadPhase); // Finding pairs updates the broad phase's pair cache.
+    access.WriteResource(&m_debugPoints);
+}
 
 void NarrowPhaseSystem::Update(ECSScene& scene, float dt)
 {
     // broad phase to get collisions that could be intersecting
     std::vector<CollisionInfo> collisions;
-    std::vector<std::pair<Entity, Entity>> potential = m_aabbTree.GetPotentialIntersections();
+    const std::vector<std::pair<Entity, Entity>>& potential = m_broadPhase.GetPotentialIntersections();
     m_debugPoints.clear();
 
     // narrow phase to confirm each collision
@@ -33,72 +46,68 @@ void NarrowPhaseSystem::Update(ECSScene& scene, float dt)
         collisions.push_back({ entity1, entity2, manifold });
     }
 
-    // resolve velocities
+    // resolve velocities and positions on solver bodies gathered once for the frame, instead of looking up and
+    // checking every component of both entities for every collision on every iteration
+    m_collisionBodies.clear();
+    for (const CollisionInfo& info : collisions)
+    {
+        m_collisionBodies.emplace_back(AddSolverBody(scene, info.entityA), AddSolverBody(scene, info.entityB));
+    }
+
     for (int i = 0; i < VELOCITY_ITERATIONS; i++)
     {
-        for (const CollisionInfo& info : collisions)
+        for (size_t c = 0; c < collisions.size(); c++)
         {
-            // get components for entities
-            Transform* e1Transform = scene.GetComponent<Transform>(info.entityA);
-            Particle* e1Particle = scene.GetComponent<Particle>(info.entityA);
-            RigidBody* e1RigidBody = scene.GetComponent<RigidBody>(info.entityA);
-            PhysicsMaterial* e1Material = scene.GetComponent<PhysicsMaterial>(info.entityA);
-            Transform* e2Transform = scene.GetComponent<Transform>(info.entityB);
-            Particle* e2Particle = scene.GetComponent<Particle>(info.entityB);
-            RigidBody* e2RigidBody = scene.GetComponent<RigidBody>(info.entityB);
-            PhysicsMaterial* e2Material = scene.GetComponent<PhysicsMaterial>(info.entityB);
-
-            float totalInverseMass = (e1Particle != nullptr ? e1Particle->inverseMass : 0.0f) + (e2Particle != nullptr ? e2Particle->inverseMass : 0.0f);
-
-            float e1Restitution = e1Material != nullptr ? e1Material->restitution : 0.5f;
-            float e2Restitution = e2Material != nullptr ? e2Material->restitution : 0.5f;
-            float collisionRestitution = e1Restitution * e2Restitution;
-
-            float e1Friction = e1Material != nullptr ? e1Material->dynamicFriction : 0.5f;
-            float e2Friction = e2Material != nullptr ? e2Material->dynamicFriction : 0.5f;
-            float collisionFriction = (e1Friction + e2Friction) / 2.0f;
+            const CollisionInfo& info = collisions[c];
+            SolverBody& e1 = m_bodies[m_collisionBodies[c].first];
+            SolverBody& e2 = m_bodies[m_collisionBodies[c].second];
+
+            float totalInverseMass = e1.inverseMass + e2.inverseMass;
+            float collisionRestitution = e1.restitution * e2.restitution;
+            float collisionFriction = (e1.friction + e2.friction) / 2.0f;
 
             for (const Vector3& contactPoint : info.manifold.contactPoints)
             {
-                Vector3 relativeA = contactPoint - e1Transform->position;
-                Vector3 relativeB = contactPoint - e2Transform->position;
+                Vector3 relativeA = contactPoint - e1.position;
+                Vector3 relativeB = contactPoint - e2.position;
 
-                Vector3 angVelocityA = Vector3::Cross(e1RigidBody != nullptr ? e1RigidBody->angularVelocity : Vector3::Zero, relativeA);
-                Vector3 angVelocityB = Vector3::Cross(e2RigidBody != nullptr ? e2RigidBody->angularVelocity : Vector3::Zero, relativeB);
+                Vector3 angVelocityA = Vector3::Cross(e1.angularVelocity, relativeA);
+                Vector3 angVelocityB = Vector3::Cross(e2.angularVelocity, relativeB);
 
-                Vector3 fullVelocityA = (e1Particle != nullptr ? e1Particle->linearVelocity : Vector3::Zero) + angVelocityA;
-                Vector3 fullVelocityB = (e2Particle != nullptr ? e2Particle->linearVelocity : Vector3::Zero) + angVelocityB;
+                Vector3 fullVelocityA = e1.linearVelocity + angVelocityA;
+                Vector3 fullVelocityB = e2.linearVelocity + angVelocityB;
                 Vector3 contactVelocity = fullVelocityB - fullVelocityA;
 
                 float impulseForce = Vector3::Dot(contactVelocity, info.manifold.normal);
                 if (impulseForce > 0.0f) continue;
 
-                Vector3 inertiaA = Vector3::Cross((e1RigidBody != nullptr ? e1RigidBody->inverseInertiaTensor : Matrix3(Vector3::Zero)) * Vector3::Cross(relativeA, info.manifold.normal), relativeA);
-                Vector3 inertiaB = Vector3::Cross((e2RigidBody != nullptr ? e2RigidBody->inverseInertiaTensor : Matrix3(Vector3::Zero)) * Vector3::Cross(relativeB, info.manifold.normal), relativeB);
+                Vector3 inertiaA = Vector3::Cross(e1.inverseInertiaTensor * Vector3::Cross(relativeA, info.manifold.normal), relativeA);
+                Vector3 inertiaB = Vector3::Cross(e2.inverseInertiaTensor * Vector3::Cross(relativeB, info.manifold.normal), relativeB);
                 float angularEffect = Vector3::Dot(inertiaA + inertiaB, info.manifold.normal);
 
                 float j = (-(1.0f + collisionRestitution) * impulseForce) / (totalInverseMass + angularEffect);
 
                 Vector3 fullImpulse = info.manifold.normal * j;
 
-                if (e1Particle != nullptr) e1Particle->ApplyLinearImpulse(-fullImpulse);
-                if (e2Particle != nullptr) e2Particle->ApplyLinearImpulse(fullImpulse);
+                // bodies without a particle or rigid body have zero inverse mass and inertia, so they are unaffected
+                e1.linearVelocity += -fullImpulse * e1.inverseMass;
+                e2.linearVelocity += fullImpulse * e2.inverseMass;
 
-                if (e1RigidBody != nullptr) e1RigidBody->ApplyAngularImpuse(Vector3::Cross(relativeA, -fullImpulse));
-                if (e2RigidBody != nullptr) e2RigidBody->ApplyAngularImpuse(Vector3::Cross(relativeB, fullImpulse));
+                e1.angularVelocity += e1.inverseInertiaTensor * Vector3::Cross(relativeA, -fullImpulse);
+                e2.angularVelocity += e2.inverseInertiaTensor * Vector3::Cross(relativeB, fullImpulse);
             }
 
             // friction
             for (const Vector3& contactPoint : info.manifold.contactPoints)
             {
-                Vector3 relativeA = contactPoint - e1Transform->position;
-                Vector3 relativeB = contactPoint - e2Transform->position;
+                Vector3 relativeA = contactPoint - e1.position;
+                Vector3 relativeB = contactPoint - e2.position;
 
-                Vector3 angVelocityA = Vector3::Cross(e1RigidBody != nullptr ? e1RigidBody->angularVelocity : Vector3::Zero, relativeA);
-                Vector3 angVelocityB = Vector3::Cross(e2RigidBody != nullptr ? e2RigidBody->angularVelocity : Vector3::Zero, relativeB);
+                Vector3 angVelocityA = Vector3::Cross(e1.angularVelocity, relativeA);
+                Vector3 angVelocityB = Vector3::Cross(e2.angularVelocity, relativeB);
 
-                Vector3 fullVelocityA = (e1Particle != nullptr ? e1Particle->linearVelocity : Vector3::Zero) + angVelocityA;
-                Vector3 fullVelocityB = (e2Particle != nullptr ? e2Particle->linearVelocity : Vector3::Zero) + angVelocityB;
+                Vector3 fullVelocityA = e1.linearVelocity + angVelocityA;
+                Vector3 fullVelocityB = e2.linearVelocity + angVelocityB;
                 Vector3 contactVelocity = fullVelocityB - fullVelocityA;
 
                 // calculate tangent velocity
@@ -113,8 +122,8 @@ void NarrowPhaseSystem::Update(ECSScene& scene, float dt)
 
                 Vector3 rAct = Vector3::Cross(relativeA, tangent);
                 Vector3 rBct = Vector3::Cross(relativeB, tangent);
-                Vector3 angInertiaA = Vector3::Cross((e1RigidBody != nullptr ? e1RigidBody->inverseInertiaTensor : Matrix3(Vector3::Zero)) * rAct, relativeA);
-                Vector3 angInertiaB = Vector3::Cross((e2RigidBody != nullptr ? e2RigidBody->inverseInertiaTensor : Matrix3(Vector3::Zero)) * rBct, relativeB);
+                Vector3 angInertiaA = Vector3::Cross(e1.inverseInertiaTensor * rAct, relativeA);
+                Vector3 angInertiaB = Vector3::Cross(e2.inverseInertiaTensor * rBct, relativeB);
                 float angularEffect = Vector3::Dot(angInertiaA + angInertiaB, tangent);
 
                 jt = jt / (totalInverseMass + angularEffect);
@@ -122,11 +131,11 @@ void NarrowPhaseSystem::Update(ECSScene& scene, float dt)
                 // TODO: compare jt and j from other loop to decide if static or dynamic friction should be used.
                 Vector3 frictionImpulse = tangent * jt * collisionFriction;
 
-                if (e1Particle != nullptr) e1Particle->ApplyLinearImpulse(-frictionImpulse);
-                if (e2Particle != nullptr) e2Particle->ApplyLinearImpulse(frictionImpulse);
+                e1.linearVelocity += -frictionImpulse * e1.inverseMass;
+                e2.linearVelocity += frictionImpulse * e2.inverseMass;
 
-                if (e1RigidBody != nullptr) e1RigidBody->ApplyAngularImpuse(Vector3::Cross(relativeA, -frictionImpulse));
-                if (e2RigidBody != nullptr) e2RigidBody->ApplyAngularImpuse(Vector3::Cross(relativeB, frictionImpulse));
+                e1.angularVelocity += e1.inverseInertiaTensor * Vector3::Cross(relativeA, -frictionImpulse);
+                e2.angularVelocity += e2.inverseInertiaTensor * Vector3::Cross(relativeB, frictionImpulse);
             }
         }
     }
@@ -134,42 +143,47 @@ void NarrowPhaseSystem::Update(ECSScene& scene, float dt)
     // resolve positions
     for (int i = 0; i < POSITION_ITERATIONS; i++)
     {
-        for (const CollisionInfo& info : collisions)
+        for (size_t c = 0; c < collisions.size(); c++)
         {
-            Transform* e1Transform = scene.GetComponent<Transform>(info.entityA);
-            Particle* e1Particle = scene.GetComponent<Particle>(info.entityA);
-            Transform* e2Transform = scene.GetComponent<Transform>(info.entityB);
-            Particle* e2Particle = scene.GetComponent<Particle>(info.entityB);
+            const CollisionInfo& info = collisions[c];
+            SolverBody& e1 = m_bodies[m_collisionBodies[c].first];
+            SolverBody& e2 = m_bodies[m_collisionBodies[c].second];
 
-            float e1InverseMass = e1Particle != nullptr ? e1Particle->inverseMass : 0.0f;
-            float e2InverseMass = e2Particle != nullptr ? e2Particle->inverseMass : 0.0f;
-
-            float totalInverseMass = e1InverseMass + e2InverseMass;
+            float totalInverseMass = e1.inverseMass + e2.inverseMass;
             if (totalInverseMass == 0)
                 continue;
 
             float penetration = (info.manifold.penetration - POSITION_PENETRATION_THRESHOLD) > 0.0f ? (info.manifold.penetration - POSITION_PENETRATION_THRESHOLD) : 0.0f;
             Vector3 correction = info.manifold.normal * (penetration * POSITION_CORRECTION_PERCENT / totalInverseMass);
 
-            e1Transform->position -= correction * e1InverseMass;
-            e2Transform->position += correction * e2InverseMass;
+            e1.positionCorrection -= correction * e1.inverseMass;
+            e2.positionCorrection += correction * e2.inverseMass;
         }
     }
 
-    // resolve springs
+    WriteSolverBodies(scene);
+
+    // over-stretched springs are queued for destruction once, before resolving, and skipped by every iteration.
+    // positions do not change while springs are resolved, so a spring that is intact now stays intact this frame.
+    // springs attached to a destroyed entity are destroyed by the cache, and springs between entities without
+    // particle physics are skipped
+    CommandBuffer& commands = scene.GetCommandBuffer();
+    m_brokenSprings.clear();
+    m_springs.ForEach(scene, [&](Entity entity, const Spring* spring, const Transform* e1Transform, const Particle* e1Particle, const Transform* e2Transform, const Particle* e2Particle) {
+        if (e1Particle->inverseMass + e2Particle->inverseMass == 0.0f) return;
+
+        if ((e2Transform->position - e1Transform->position).magnitude() > 5.0f * spring->restLength)
+        {
+            commands.DestroyEntity(entity);
+            m_brokenSprings.push_back(entity);
+        }
+        });
+    std::sort(m_brokenSprings.begin(), m_brokenSprings.end());
+
     for (int i = 0; i < SPRING_ITERATIONS; i++)
     {
-        scene.ForEach<Spring>([&](Entity entity, Spring* spring) {
-            Transform* e1Transform = scene.GetComponent<Transform>(spring->entityA);
-            Particle* e1Particle = scene.GetComponent<Particle>(spring->entityA);
-            Transform* e2Transform = scene.GetComponent<Transform>(spring->entityB);
-            Particle* e2Particle = scene.GetComponent<Particle>(spring->entityB);
-
-            // confirm that both entities have the components required for spring physics
-            if (e1Transform == nullptr || e1Particle == nullptr || e2Transform == nullptr || e2Particle == nullptr)
-            {
-                return;
-            }
+        m_springs.ForEach(scene, [&](Entity entity, const Spring* spring, const Transform* e1Transform, Particle* e1Particle, const Transform* e2Transform, Particle* e2Particle) {
+            if (!m_brokenSprings.empty() && std::binary_search(m_brokenSprings.begin(), m_brokenSprings.end(), entity)) return;
 
             float totalMass = e1Particle->inverseMass + e2Particle->inverseMass;
             if (totalMass == 0.0f) return;
@@ -178,12 +192,6 @@ void NarrowPhaseSystem::Update(ECSScene& scene, float dt)
             float currentLength = delta.magnitude();
             if (currentLength < EPSILON) return;
 
-            if (currentLength > 5.0f * spring->restLength)
-            {
-                scene.DestroyEntity(entity);
-                return;
-            }
-
             Vector3 normal = delta / currentLength;
 
             Vector3 relativeVelocity = e2Particle->linearVelocity - e1Particle->linearVelocity;
@@ -200,3 +208,80 @@ void NarrowPhaseSystem::Update(ECSScene& scene, float dt)
             });
     }
 }
+
+uint32_t NarrowPhaseSystem::AddSolverBody(ECSScene& scene, Entity entity)
+{
+    uint32_t index = GetEntityIndex(entity);
+    if (index >= m_bodyIndices.size())
+    {
+        m_bodyIndices.resize(index + 1, NO_BODY);
+    }
+
+    if (m_bodyIndices[index] != NO_BODY)
+    {
+        return m_bodyIndices[index];
+    }
+
+    m_bodyIndices[index] = (uint32_t)m_bodies.size();
+    SolverBody& body = m_bodies.emplace_back();
+    body.entity = entity;
+
+    // components are read without marking them as changed, bodies without a particle or rigid body keep the
+    // static defaults
+    EntityLocation location = scene.GetEntityLocation(entity);
+    Archetype& archetype = *location.archetype;
+    body.archetype = location.archetype;
+    body.row = location.row;
+    body.position = archetype.GetComponentAtRowUnmarked<const Transform>(location.row)->position;
+
+    if (archetype.HasComponent(GetComponentID<Particle>()))
+    {
+        const Particle* particle = archetype.GetComponentAtRowUnmarked<const Particle>(location.row);
+        body.hasParticle = true;
+        body.linearVelocity = particle->linearVelocity;
+        body.inverseMass = particle->inverseMass;
+    }
+
+    if (archetype.HasComponent(GetComponentID<RigidBody>()))
+    {
+        // rigid bodies are split into streams, so they are copied out rather than pointed to
+        RigidBody rigidBody = archetype.LoadComponentAtRow<RigidBody>(location.row);
+        body.hasRigidBody = true;
+        body.angularVelocity = rigidBody.angularVelocity;
+        body.inverseInertiaTensor = rigidBody.inverseInertiaTensor;
+    }
+
+    if (archetype.HasComponent(GetComponentID<PhysicsMaterial>()))
+    {
+        const PhysicsMaterial* material = archetype.GetComponentAtRowUnmarked<const PhysicsMaterial>(location.row);
+        body.restitution = material->restitution;
+        body.friction = material->dynamicFriction;
+    }
+
+    return m_bodyIndices[index];
+}
+
+void NarrowPhaseSystem::WriteSolverBodies(ECSScene& scene)
+{
+    for (const SolverBody& body : m_bodies)
+    {
+        // only the columns of the colliding bodies' chunks are marked as changed
+        if (body.hasParticle) body.archetype->GetComponentAtRow<Particle>(body.row)->linearVelocity = body.linearVelocity;
+        if (body.hasRigidBody)
+        {
+            RigidBody rigidBody = body.archetype->LoadComponentAtRow<RigidBody>(body.row);
+            rigidBody.angularVelocity = body.angularVelocity;
+            body.archetype->SetComponent(GetComponentID<RigidBody>(), body.row, &rigidBody);
+        }
+
+        // only bodies with mass are moved, so the transforms of static bodies are not marked as changed
+        if (body.positionCorrection != Vector3::Zero)
+        {
+            body.archetype->GetComponentAtRow<Transform>(body.row)->position += body.positionCorrection;
+        }
+
+        m_bodyIndices[GetEntityIndex(body.entity)] = NO_BODY;
+    }
+
+    m_bodies.clear();
+}
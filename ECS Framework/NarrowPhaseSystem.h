@@ -1,19 +1,68 @@
 #pragma once
 #include <vector>
+#include <cstdint>
+#include <utility>
 #include "System.h"
 #include "Vector3.h"
+#include "Components.h"
+#include "RelationCache.h"
 
-class AABBTree;
+class BroadPhase;
 
 class NarrowPhaseSystem : public System
 {
 public:
-	NarrowPhaseSystem(AABBTree& tree, std::vector<Vector3>& debugPoints) : m_aabbTree(tree), m_debugPoints(debugPoints) {}
+	NarrowPhaseSystem(BroadPhase& broadPhase, std::vector<Vector3>& debugPoints) : m_broadPhase(broadPhase), m_debugPoints(debugPoints) {}
 
 	void Update(ECSScene& scene, float dt) final override;
+	void DeclareAccess(SystemAccess& access) final override;
+	const char* GetName() const final override { return "NarrowPhaseSystem"; }
 
 private:
-	AABBTree& m_aabbTree;
+	static constexpr uint32_t NO_BODY = UINT32_MAX; // Body index of entities without a collision this frame.
+
+	/**
+	 * @struct SolverBody
+	 * @brief The state of a colliding entity used while resolving collisions. Missing physics components are replaced
+	 * by values that leave the body unaffected, so the solver loops do not check for them.
+	 */
+	struct SolverBody
+	{
+		Entity entity = INVALID_ENTITY;
+		Archetype* archetype = nullptr; // Archetype holding the entity's components, the body is written back through it.
+		uint32_t row = 0; // Row of the entity in its archetype.
+		bool hasParticle = false; // Whether the linear velocity is written back to a particle.
+		bool hasRigidBody = false; // Whether the angular velocity is written back to a rigid body.
+		Vector3 position = Vector3::Zero;
+		Vector3 linearVelocity = Vector3::Zero;
+		Vector3 angularVelocity = Vector3::Zero;
+		Vector3 positionCorrection = Vector3::Zero;
+		Matrix3 inverseInertiaTensor = Matrix3(Vector3::Zero);
+		float inverseMass = 0.0f;
+		float restitution = 0.5f;
+		float friction = 0.5f;
+	};
+
+	/**
+	 * @brief Gets the solver body of an entity, adding it and filling it from the entity's components if the entity
+	 * has none yet. The entity's location is looked up once, and which optional components it has is decided by its
+	 * archetype. Nothing is marked as changed until the body is written back.
+	 * @return The index of the body.
+	 */
+	uint32_t AddSolverBody(ECSScene& scene, Entity entity);
+
+	/**
+	 * @brief Writes the velocities and position corrections of the solver bodies back to their entities and clears them.
+	 */
+	void WriteSolverBodies(ECSScene& scene);
+
+	BroadPhase& m_broadPhase;
 	std::vector<Vector3>& m_debugPoints;
+	RelationCache<Spring, const Transform, Particle> m_springs; // Springs with the transform and particle of both ends, only particles are written.
+	std::vector<Entity> m_brokenSprings; // Springs queued for destruction this frame, in ascending order.
+
+	std::vector<SolverBody> m_bodies; // Bodies of the entities colliding this frame.
+	std::vector<uint32_t> m_bodyIndices; // Body index of each entity index, NO_BODY if the entity is not colliding.
+	std::vector<std::pair<uint32_t, uint32_t>> m_collisionBodies; // Body indices of each collision's entities.
 };
 
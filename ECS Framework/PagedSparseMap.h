@@ -0,0 +1,109 @@
+#pragma once
+#ifndef PAGED_SPARSE_MAP_H_
+#define PAGED_SPARSE_MAP_H_
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "Definitions.h"
+
+/**
+ * @class PagedSparseMap
+ * @brief Maps entities to values using fixed size pages indexed by the entity's index, so lookups are two
+ * array accesses while memory is only allocated for the index ranges that are actually in use. Entries that
+ * were never set read as the empty value.
+ * @tparam T The type of the values.
+ * @tparam EmptyValue The value of entries that are not set.
+ */
+template <typename T, T EmptyValue>
+class PagedSparseMap
+{
+public:
+	static constexpr size_t PAGE_SHIFT = 12;
+	static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_SHIFT; // Number of entries in each page.
+	static constexpr size_t PAGE_MASK = PAGE_SIZE - 1;
+
+	/**
+	 * @brief Gets the value of an entity.
+	 * @param entity The entity, only its index is used.
+	 * @return The value of the entity, or the empty value if it has not been set.
+	 */
+	T Get(Entity entity) const
+	{
+		uint32_t index = GetEntityIndex(entity);
+		size_t page = index >> PAGE_SHIFT;
+		if (page >= m_pages.size() || m_pages[page] == nullptr)
+		{
+			return EmptyValue;
+		}
+
+		return m_pages[page][index & PAGE_MASK];
+	}
+
+	/**
+	 * @brief Sets the value of an entity, allocating its page if needed.
+	 * @param entity The entity, only its index is used.
+	 * @param value The new value.
+	 */
+	void Set(Entity entity, T value)
+	{
+		uint32_t index = GetEntityIndex(entity);
+		GetOrAllocatePage(index >> PAGE_SHIFT)[index & PAGE_MASK] = value;
+	}
+
+	/**
+	 * @brief Resets the value of an entity to the empty value. Never allocates.
+	 * @param entity The entity, only its index is used.
+	 */
+	void Erase(Entity entity)
+	{
+		uint32_t index = GetEntityIndex(entity);
+		size_t page = index >> PAGE_SHIFT;
+		if (page < m_pages.size() && m_pages[page] != nullptr)
+		{
+			m_pages[page][index & PAGE_MASK] = EmptyValue;
+		}
+	}
+
+	bool Contains(Entity entity) const { return Get(entity) != EmptyValue; }
+
+	/**
+	 * @brief Frees every page.
+	 */
+	void Clear()
+	{
+		m_pages.clear();
+	}
+
+	/**
+	 * @brief Gets the number of bytes allocated for pages and the page table.
+	 */
+	size_t GetMemoryUsage() const
+	{
+		size_t allocatedPages = std::count_if(m_pages.begin(), m_pages.end(), [](const std::unique_ptr<T[]>& page) { return page != nullptr; });
+		return allocatedPages * PAGE_SIZE * sizeof(T) + m_pages.capacity() * sizeof(std::unique_ptr<T[]>);
+	}
+
+private:
+	std::vector<std::unique_ptr<T[]>> m_pages; // Page table, pages are null until an entry in them is set.
+
+	T* GetOrAllocatePage(size_t page)
+	{
+		if (page >= m_pages.size())
+		{
+			m_pages.resize(page + 1);
+		}
+
+		if (m_pages[page] == nullptr)
+		{
+			m_pages[page] = std::make_unique<T[]>(PAGE_SIZE);
+			std::fill_n(m_pages[page].get(), PAGE_SIZE, EmptyValue);
+		}
+
+		return m_pages[page].get();
+	}
+};
+
+#endif // PAGED_SPARSE_MAP_H_
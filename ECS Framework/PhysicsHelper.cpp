@@ -2,14 +2,17 @@
 #include "ECSScene.h"
 #include "Components.h"
 #include "MeshLoader.h"
-#include "AABBTree.h"
+#include "BroadPhase.h"
 #include "Vector3.h"
 #include "Quaternion.h"
 #include <vector>
+#include <algorithm>
+#include <cmath>
 
-void PhysicsHelper::CreateCube(ECSScene& scene, AABBTree& tree, Vector3 center, Vector3 size, Quaternion rotation, float mass)
+void PhysicsHelper::CreateCube(ECSScene& scene, BroadPhase& broadPhase, Vector3 center, Vector3 size, Quaternion rotation, float mass)
 {
     Entity entity = scene.CreateEntity();
+    if (entity == INVALID_ENTITY) { return; }
 
     Vector3 inverseInertia = Vector3::Zero;
     if (mass > 0)
@@ -42,19 +45,62 @@ void PhysicsHelper::CreateCube(ECSScene& scene, AABBTree& tree, Vector3 center,
         Mesh{ MeshLoader::GetMeshID("Cube") }
     );
 
-    tree.InsertEntity(entity, AABB::FromPositionScale(Vector3::Zero, Vector3(10.0f, 1.0f, 10.0f)), mass <= 0);
+    broadPhase.InsertEntity(entity, OBB(center, size, rotation).ToAABB(), mass <= 0);
 }
 
-void PhysicsHelper::CreateCloth(ECSScene& scene, AABBTree& tree, Vector3 center, unsigned int rows, unsigned int cols, float spacing, float stiffness, bool hasStructureSprings, bool hasShearingSprings, bool hasBendingSrings)
+void PhysicsHelper::CreateSphere(ECSScene& scene, BroadPhase& broadPhase, Vector3 center, float radius, float mass)
 {
-    float startEntity = scene.GetEntityCount() - 1;
-    Entity currentEntityNum = 0;
+    Entity entity = scene.CreateEntity();
+    if (entity == INVALID_ENTITY) { return; }
 
-    std::vector<Entity> clothEntities;
-    clothEntities.resize(rows * cols);
+    Vector3 inverseInertia = Vector3::Zero;
+    if (mass > 0)
+    {
+        float inertia = (2.0f / 5.0f) * mass * (radius * radius);
+        inverseInertia = Vector3(inertia, inertia, inertia).reciprocal();
+    }
+
+    scene.AddComponent(
+        entity,
+        Transform(center, Quaternion(), Vector3::One * radius)
+    );
+    scene.AddComponent(
+        entity,
+        Particle(mass)
+    );
+    scene.AddComponent(
+        entity,
+        RigidBody(inverseInertia)
+    );
+    scene.AddComponent(
+        entity,
+        Collider{ Sphere(center, radius) }
+    );
+    scene.AddComponent(
+        entity,
+        Mesh{ MeshLoader::GetMeshID("Sphere") }
+    );
+
+    broadPhase.InsertEntity(entity, AABB::FromPositionScale(center, Vector3::One * 2.0f * radius), mass <= 0);
+}
+
+void PhysicsHelper::CreateCloth(ECSScene& scene, BroadPhase& broadPhase, Vector3 center, unsigned int rows, unsigned int cols, float spacing, float stiffness, bool hasStructureSprings, bool hasShearingSprings, bool hasBendingSrings)
+{
+    size_t pointCount = rows * cols;
+
+    std::vector<Particle> particles;
+    std::vector<Transform> transforms;
+    std::vector<RigidBody> rigidBodies;
+    std::vector<Collider> colliders;
+    std::vector<Mesh> meshes(pointCount, Mesh{ MeshLoader::GetMeshID("Sphere") });
+    particles.reserve(pointCount);
+    transforms.reserve(pointCount);
+    rigidBodies.reserve(pointCount);
+    colliders.reserve(pointCount);
 
     Vector3 startPosition = center + Vector3::Left * (rows / 2) * spacing + Vector3::Back * (cols / 2) * spacing;
 
+    // every point of the cloth shares a component set, so they are spawned as one batch
     for (int y = 0; y < rows; y++)
     {
         for (int x = 0; x < cols; x++)
@@ -63,30 +109,24 @@ void PhysicsHelper::CreateCloth(ECSScene& scene, AABBTree& tree, Vector3 center,
             float anchored = y == 0 || y == rows - 1 || x == 0 || x == cols - 1;
             float mass = anchored ? -1.0f : 0.05f;
 
-            currentEntityNum = scene.CreateEntity();
-            scene.AddComponent(
-                currentEntityNum,
-                Particle(mass)
-            );
-            scene.AddComponent(
-                currentEntityNum,
-                Transform(pointPosition, Quaternion(), Vector3(0.05f, 0.05f, 0.05f))
-            );
-            scene.AddComponent(
-                currentEntityNum,
-                RigidBody(Vector3::Zero)
-            );
-            scene.AddComponent(
-                currentEntityNum,
-                Collider{ Point(pointPosition) }
-            );
-            scene.AddComponent(
-                currentEntityNum,
-                Mesh{ MeshLoader::GetMeshID("Sphere") }
-            );
-
-            tree.InsertEntity(currentEntityNum, AABB::FromPositionScale(pointPosition, Vector3(0.1f, 0.1f, 0.1f)), anchored);
-            clothEntities[x + y * cols] = currentEntityNum;
+            particles.push_back(Particle(mass));
+            transforms.push_back(Transform(pointPosition, Quaternion(), Vector3(0.05f, 0.05f, 0.05f)));
+            rigidBodies.push_back(RigidBody(Vector3::Zero));
+            colliders.push_back(Collider{ Point(pointPosition) });
+        }
+    }
+
+    std::vector<Entity> clothEntities = scene.CreateEntities(pointCount, particles, transforms, rigidBodies, colliders, meshes);
+    if (clothEntities.empty()) { return; }
+
+    std::vector<Spring> springs;
+    for (int y = 0; y < rows; y++)
+    {
+        for (int x = 0; x < cols; x++)
+        {
+            Entity entity = clothEntities[x + y * cols];
+            bool anchored = y == 0 || y == rows - 1 || x == 0 || x == cols - 1;
+            broadPhase.InsertEntity(entity, AABB::FromPositionScale(transforms[x + y * cols].position, Vector3(0.1f, 0.1f, 0.1f)), anchored);
 
             // structural springs
             if (hasStructureSprings)
@@ -97,39 +137,22 @@ void PhysicsHelper::CreateCloth(ECSScene& scene, AABBTree& tree, Vector3 center,
                     Entity b = clothEntities[(x - 1) + y * cols];
                     Entity c = clothEntities[x + (y - 1) * cols];
 
-                    Entity spring1 = scene.CreateEntity();
-                    scene.AddComponent(
-                        spring1,
-                        Spring{ a, b, spacing, stiffness }
-                    );
-
-                    Entity spring2 = scene.CreateEntity();
-                    scene.AddComponent(
-                        spring2,
-                        Spring{ a, c, spacing, stiffness }
-                    );
+                    springs.push_back(Spring{ a, b, spacing, stiffness });
+                    springs.push_back(Spring{ a, c, spacing, stiffness });
                 }
                 if (x == 0 && y > 0)
                 {
                     Entity a = clothEntities[x + y * cols];
                     Entity b = clothEntities[x + (y - 1) * cols];
 
-                    Entity spring1 = scene.CreateEntity();
-                    scene.AddComponent(
-                        spring1,
-                        Spring{ a, b, spacing, stiffness }
-                    );
+                    springs.push_back(Spring{ a, b, spacing, stiffness });
                 }
                 if (x > 0 && y == 0)
                 {
                     Entity a = clothEntities[x + y * cols];
                     Entity b = clothEntities[(x - 1) + y * cols];
 
-                    Entity spring1 = scene.CreateEntity();
-                    scene.AddComponent(
-                        spring1,
-                        Spring{ a, b, spacing, stiffness }
-                    );
+                    springs.push_back(Spring{ a, b, spacing, stiffness });
                 }
             }
 
@@ -141,11 +164,7 @@ void PhysicsHelper::CreateCloth(ECSScene& scene, AABBTree& tree, Vector3 center,
                     Entity a = clothEntities[x + y * cols];
                     Entity b = clothEntities[(x + 1) + (y - 1) * cols];
 
-                    Entity spring1 = scene.CreateEntity();
-                    scene.AddComponent(
-                        spring1,
-                        Spring{ a, b, spacing, stiffness }
-                    );
+                    springs.push_back(Spring{ a, b, spacing, stiffness });
                 }
 
                 if (y > 0 && x > 0)
@@ -153,11 +172,7 @@ void PhysicsHelper::CreateCloth(ECSScene& scene, AABBTree& tree, Vector3 center,
                     Entity a = clothEntities[x + y * cols];
                     Entity b = clothEntities[(x - 1) + (y - 1) * cols];
 
-                    Entity spring1 = scene.CreateEntity();
-                    scene.AddComponent(
-                        spring1,
-                        Spring{ a, b, spacing, stiffness }
-                    );
+                    springs.push_back(Spring{ a, b, spacing, stiffness });
                 }
             }
 
@@ -169,24 +184,41 @@ void PhysicsHelper::CreateCloth(ECSScene& scene, AABBTree& tree, Vector3 center,
                     Entity a = clothEntities[x + y * cols];
                     Entity b = clothEntities[(x - 2) + y * cols];
 
-                    Entity spring1 = scene.CreateEntity();
-                    scene.AddComponent(
-                        spring1,
-                        Spring{ a, b, spacing, stiffness }
-                    );
+                    springs.push_back(Spring{ a, b, spacing, stiffness });
                 }
                 if (y > 0 && y % 2 == 0)
                 {
                     Entity a = clothEntities[x + y * cols];
                     Entity b = clothEntities[x + (y - 2) * cols];
 
-                    Entity spring1 = scene.CreateEntity();
-                    scene.AddComponent(
-                        spring1,
-                        Spring{ a, b, spacing, stiffness }
-                    );
+                    springs.push_back(Spring{ a, b, spacing, stiffness });
                 }
             }
         }
     }
+
+    scene.CreateEntities(springs.size(), springs);
+}
+
+uint64_t PhysicsHelper::GetMortonCode(const Vector3& position, float cellSize)
+{
+    constexpr uint64_t AXIS_BITS = 21;
+    constexpr float AXIS_OFFSET = (float)(1 << (AXIS_BITS - 1));
+    constexpr float AXIS_MAX = (float)((1 << AXIS_BITS) - 1);
+
+    // spreads the 21 bits of a cell index out to every third bit
+    auto spread = [](uint64_t bits) {
+        bits &= 0x1fffff;
+        bits = (bits | bits << 32) & 0x1f00000000ffff;
+        bits = (bits | bits << 16) & 0x1f0000ff0000ff;
+        bits = (bits | bits << 8) & 0x100f00f00f00f00f;
+        bits = (bits | bits << 4) & 0x10c30c30c30c30c3;
+        bits = (bits | bits << 2) & 0x1249249249249249;
+        return bits;
+    };
+    auto cell = [cellSize, AXIS_OFFSET, AXIS_MAX](float value) {
+        return (uint64_t)std::clamp(std::floor(value / cellSize) + AXIS_OFFSET, 0.0f, AXIS_MAX);
+    };
+
+    return spread(cell(position.x)) | (spread(cell(position.y)) << 1) | (spread(cell(position.z)) << 2);
 }
@@ -1,14 +1,26 @@
 #pragma once
+#include <cstdint>
 
 class ECSScene;
-class AABBTree;
+class BroadPhase;
 class Vector3;
 class Quaternion;
 
 class PhysicsHelper
 {
 public:
-	static void CreateCube(ECSScene& scene, AABBTree& tree, Vector3 center, Vector3 size, Quaternion rotation, float mass);
+	static void CreateCube(ECSScene& scene, BroadPhase& broadPhase, Vector3 center, Vector3 size, Quaternion rotation, float mass);
 
-	static void CreateCloth(ECSScene& scene, AABBTree& tree, Vector3 center, unsigned int rows, unsigned int cols, float spacing, float stiffness, bool hasStructureSprings = true, bool hasShearingSprings = true, bool hasBendingSrings = true);
+	static void CreateSphere(ECSScene& scene, BroadPhase& broadPhase, Vector3 center, float radius, float mass);
+
+	static void CreateCloth(ECSScene& scene, BroadPhase& broadPhase, Vector3 center, unsigned int rows, unsigned int cols, float spacing, float stiffness, bool hasStructureSprings = true, bool hasShearingSprings = true, bool hasBendingSrings = true);
+
+	/**
+	 * @brief Gets the Morton code of a position, interleaving the bits of its grid cell on each axis so positions
+	 * close in space get close codes. Cells are quantised to 21 bits per axis around the origin and clamped outside it.
+	 * @param position The position to encode.
+	 * @param cellSize The size of a grid cell, positions in the same cell get the same code.
+	 * @return The 63 bit Morton code.
+	 */
+	static uint64_t GetMortonCode(const Vector3& position, float cellSize);
 };
\ No newline at end of file
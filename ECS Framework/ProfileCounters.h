@@ -0,0 +1,69 @@
+#pragma once
+#ifndef PROFILE_COUNTERS_H_
+#define PROFILE_COUNTERS_H_
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @struct ProfileCounters
+ * @brief Work done by one system update, counted by the ECS as it iterates and allocates. Counting only happens on
+ * threads that have a scope active, so it costs a single branch when profiling is off.
+ */
+struct ProfileCounters
+{
+	uint64_t entities = 0; // Rows passed to iteration callbacks.
+	uint64_t allocatedBytes = 0; // Bytes of chunk storage allocated.
+	uint32_t archetypes = 0; // Archetypes iterated, counted once per loop over an archetype.
+	uint32_t allocations = 0; // Chunks allocated.
+
+	/**
+	 * @brief Counts rows about to be iterated by the calling thread.
+	 */
+	static void CountEntities(size_t count)
+	{
+		if (t_current != nullptr) { t_current->entities += count; }
+	}
+
+	/**
+	 * @brief Counts an archetype about to be iterated by the calling thread.
+	 */
+	static void CountArchetype()
+	{
+		if (t_current != nullptr) { t_current->archetypes++; }
+	}
+
+	/**
+	 * @brief Counts a chunk allocated by the calling thread.
+	 */
+	static void CountAllocation(size_t bytes)
+	{
+		if (t_current != nullptr)
+		{
+			t_current->allocations++;
+			t_current->allocatedBytes += bytes;
+		}
+	}
+
+	/**
+	 * @class Scope
+	 * @brief Counts the work of the calling thread into a set of counters until the scope ends. Scopes nest, as a
+	 * thread waiting on jobs may run another system's update.
+	 */
+	class Scope
+	{
+	public:
+		explicit Scope(ProfileCounters& counters) : m_previous(t_current) { t_current = &counters; }
+		~Scope() { t_current = m_previous; }
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		ProfileCounters* m_previous; // Counters restored when the scope ends.
+	};
+
+private:
+	inline static thread_local ProfileCounters* t_current = nullptr; // Counters of the calling thread, null if none.
+};
+
+#endif // PROFILE_COUNTERS_H_
@@ -0,0 +1,210 @@
+#pragma once
+#ifndef QUERY_H_
+#define QUERY_H_
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+#include "Definitions.h"
+#include "Archetype.h"
+#include "JobSystem.h"
+
+/**
+ * @class Query
+ * @brief A persistent set of archetypes that contain a set of required components and none of a set of excluded
+ * components. Queries are owned by the
+ * ComponentManager, which registers newly created archetypes with every matching query, so iterating
+ * a query never has to search the archetype map.
+ */
+class Query
+{
+public:
+	/**
+	 * @brief Creates an empty query.
+	 * @param signature The components an archetype must contain to be matched by the query.
+	 * @param excluded The components an archetype must not contain to be matched by the query.
+	 */
+	Query(Signature signature, Signature excluded = Signature()) : m_signature(signature), m_excluded(excluded) {}
+
+	/**
+	 * @brief Checks if an archetype signature satisfies this query.
+	 * @param signature The signature of the archetype.
+	 * @return True if the signature contains every required component and no excluded component, false otherwise.
+	 */
+	bool Matches(Signature signature) const
+	{
+		return signature.ContainsAll(m_signature) && !signature.Intersects(m_excluded);
+	}
+
+	/**
+	 * @brief Adds an archetype to the matched set. Called by the ComponentManager when a matching archetype is created.
+	 * @param archetype The archetype to add.
+	 */
+	void AddArchetype(Archetype* archetype)
+	{
+		m_archetypes.push_back(archetype);
+	}
+
+	/**
+	 * @brief Removes an archetype from the matched set. Called by the ComponentManager before an empty archetype is freed.
+	 * @param archetype The archetype to remove.
+	 */
+	void RemoveArchetype(Archetype* archetype)
+	{
+		m_archetypes.erase(std::remove(m_archetypes.begin(), m_archetypes.end(), archetype), m_archetypes.end());
+	}
+
+	/**
+	 * @brief Iterate over every entity in the matched archetypes.
+	 * @tparam ...Terms The components to pass to the callback, these must be part of the query signature. Terms may be
+	 * const qualified for read only access, wrapped in Changed to skip unchanged chunks or wrapped in Optional when
+	 * the query does not require them, see QueryTerm.h. With and Without terms are not accepted here.
+	 * @param callback A callback method that contains the parameters: Entity, Components...
+	 */
+	template<typename... Terms, typename Callback>
+	void ForEach(Callback&& callback)
+	{
+		for (Archetype* archetype : m_archetypes)
+		{
+			archetype->ForEach<Terms...>(callback);
+		}
+	}
+
+	/**
+	 * @brief Iterate over the matched archetypes one chunk at a time, passing contiguous spans instead of single
+	 * entities. Entities of the matched archetypes must not be created, destroyed or change components until the
+	 * call returns.
+	 * @tparam ...Terms The components to pass to the callback, as with ForEach.
+	 * @param callback A callback method that contains the parameters: size_t count, std::span<const Entity> entities,
+	 * std::span<Components> components..., with ComponentStreams in place of the span for split components.
+	 */
+	template<typename... Terms, typename Callback>
+	void ForEachChunk(Callback&& callback)
+	{
+		for (Archetype* archetype : m_archetypes)
+		{
+			archetype->ForEachChunk<Terms...>(callback);
+		}
+	}
+
+	/**
+	 * @brief Iterate over every entity in the matched archetypes using the shared job system. Every chunk
+	 * is split into row ranges of at most the grain size, and the ranges are processed concurrently.
+	 * Entities must not be created, destroyed or change components until the call returns.
+	 * @tparam ...Terms The components to pass to the callback, these must be part of the query signature. Terms may be
+	 * const qualified for read only access, wrapped in Changed to skip unchanged chunks or wrapped in Optional when
+	 * the query does not require them, see QueryTerm.h. With and Without terms are not accepted here.
+	 * @param callback A thread safe callback method that contains the parameters: Entity, Components...
+	 * @param options The grain size and scheduling mode used to split the rows.
+	 */
+	template<typename... Terms, typename Callback>
+	void ParallelForEach(Callback&& callback, const ParallelOptions& options = ParallelOptions())
+	{
+		ParallelForEachRange<Terms...>(options, [&](const RowRange& range) {
+			range.archetype->template ForEachInChunk<Terms...>(range.chunkIndex, range.begin, range.end, callback);
+			});
+	}
+
+	/**
+	 * @brief Like ParallelForEach, but the callback is called once per row range with contiguous spans instead of
+	 * once per entity, so it can run tight loops over the component arrays. Ranges never cross a chunk.
+	 * @tparam ...Terms The components to pass to the callback, as with ParallelForEach.
+	 * @param callback A thread safe callback method that contains the parameters: size_t count,
+	 * std::span<const Entity> entities, std::span<Components> components..., with ComponentStreams in place of the
+	 * span for split components.
+	 * @param options The grain size and scheduling mode used to split the rows.
+	 */
+	template<typename... Terms, typename Callback>
+	void ParallelForEachChunk(Callback&& callback, const ParallelOptions& options = ParallelOptions())
+	{
+		ParallelForEachRange<Terms...>(options, [&](const RowRange& range) {
+			range.archetype->template ForEachChunkRange<Terms...>(range.chunkIndex, range.begin, range.end, callback);
+			});
+	}
+
+	Signature GetSignature() const { return m_signature; }
+	Signature GetExcludedSignature() const { return m_excluded; }
+	const std::vector<Archetype*>& GetArchetypes() const { return m_archetypes; }
+
+	/**
+	 * @brief Gets the memory held by the row ranges kept between parallel loops.
+	 */
+	size_t GetScratchBytes() const { return m_ranges.capacity() * sizeof(RowRange); }
+
+private:
+	/**
+	 * @struct RowRange
+	 * @brief A range of rows inside a single chunk, the unit of work of the parallel loops.
+	 */
+	struct RowRange
+	{
+		Archetype* archetype;
+		size_t chunkIndex;
+		size_t begin;
+		size_t end;
+	};
+
+	Signature m_signature; // The components required by the query.
+	Signature m_excluded; // The components no matched archetype contains.
+	std::vector<Archetype*> m_archetypes; // Every archetype currently matching the signature.
+	std::vector<RowRange> m_ranges; // Scratch row ranges reused by every parallel loop, cleared rather than reallocated.
+	std::atomic<bool> m_rangesInUse = false; // True while a parallel loop is processing m_ranges.
+
+	/**
+	 * @brief Splits every chunk into row ranges of at most the grain size and processes the ranges concurrently.
+	 */
+	template<typename... Terms, typename RangeFunction>
+	void ParallelForEachRange(const ParallelOptions& options, RangeFunction&& rangeFunction)
+	{
+		// ranges never cross a chunk, so each one is a contiguous block of every component array.
+		// change filters and versions are handled here, once per chunk, before any range runs
+		// a loop nested inside another loop over this query, or started from another thread while one runs,
+		// builds its ranges in a local vector rather than clearing the scratch ranges in use
+		bool ownsScratch = !m_rangesInUse.exchange(true, std::memory_order_acquire);
+		std::vector<RowRange> localRanges;
+		std::vector<RowRange>& ranges = ownsScratch ? m_ranges : localRanges;
+		ranges.clear();
+
+		size_t grainSize = std::max<size_t>(options.grainSize, 1);
+		ChangeContext changeContext = ChangeVersion::GetContext();
+		uint32_t writeVersion = ChangeVersion::GetWriteVersion();
+		for (Archetype* archetype : m_archetypes)
+		{
+			if (archetype->GetEntityCount() == 0) { continue; }
+			ProfileCounters::CountArchetype();
+
+			const std::vector<Chunk>& chunks = archetype->GetChunks();
+			for (size_t chunkIndex = 0; chunkIndex < chunks.size() && chunks[chunkIndex].m_count > 0; chunkIndex++)
+			{
+				if (!archetype->template AcquireChunk<Terms...>(chunkIndex, changeContext.lastRunVersion, writeVersion)) { continue; }
+				ProfileCounters::CountEntities(chunks[chunkIndex].m_count);
+
+				size_t rowCount = chunks[chunkIndex].m_count;
+				for (size_t begin = 0; begin < rowCount; begin += grainSize)
+				{
+					ranges.push_back({ archetype, chunkIndex, begin, std::min(begin + grainSize, rowCount) });
+				}
+			}
+		}
+
+		// each job processes exactly one range
+		ParallelOptions rangeOptions = options;
+		rangeOptions.grainSize = 1;
+
+		// ranges run with the caller's change context, so components written through GetComponent are stamped as the caller's
+		JobSystem::GetInstance().ParallelFor(ranges.size(), rangeOptions, [&](size_t first, size_t last) {
+			ChangeVersion::Scope changeScope(changeContext);
+			for (size_t i = first; i < last; i++)
+			{
+				rangeFunction(ranges[i]);
+			}
+			});
+
+		if (ownsScratch)
+		{
+			m_rangesInUse.store(false, std::memory_order_release);
+		}
+	}
+};
+
+#endif // QUERY_H_
@@ -0,0 +1,148 @@
+#pragma once
+#ifndef QUERY_TERM_H_
+#define QUERY_TERM_H_
+#include <type_traits>
+
+/**
+ * @struct Changed
+ * @brief Query term that passes a component to the callback like a plain component, but only visits chunks where
+ * the component has changed since the running system last updated. When a query has several Changed terms, chunks
+ * where any of them changed are visited.
+ * @tparam T The component type, const qualified for read only access.
+ */
+template <typename T>
+struct Changed {};
+
+/**
+ * @struct Optional
+ * @brief Query term that passes a pointer to a component when the entity has it and nullptr otherwise, without
+ * requiring it for a match. Presence is decided once per archetype, so the row loop does not branch on it.
+ * @tparam T The component type, const qualified for read only access.
+ */
+template <typename T>
+struct Optional {};
+
+/**
+ * @struct With
+ * @brief Query term that requires a component without passing it to the callback or accessing its data.
+ * @tparam T The component type.
+ */
+template <typename T>
+struct With {};
+
+/**
+ * @struct Without
+ * @brief Query term that excludes every archetype containing a component. Nothing is passed to the callback.
+ * @tparam T The component type.
+ */
+template <typename T>
+struct Without {};
+
+/**
+ * @enum TermPresence
+ * @brief How a query term affects which archetypes a query matches.
+ */
+enum class TermPresence
+{
+	Required, // The archetype must contain the component.
+	Optional, // The archetype may contain the component.
+	Excluded, // The archetype must not contain the component.
+};
+
+/**
+ * @struct QueryTermTraits
+ * @brief Describes a term of a query. A plain component type T gives write access and a const T read only access,
+ * only components accessed through a non-const term are marked as changed.
+ */
+template <typename Term>
+struct QueryTermTraits
+{
+	using Component = Term; // The component type passed to the callback, including its const qualifier.
+	using Key = std::remove_cv_t<Term>; // The term as it affects matching, terms with the same key share a query.
+	static constexpr bool CHANGE_FILTER = false; // True if the term only matches changed chunks.
+	static constexpr bool ARGUMENT = true; // True if the term is passed to the callback.
+	static constexpr TermPresence PRESENCE = TermPresence::Required;
+};
+
+template <typename T>
+struct QueryTermTraits<Changed<T>>
+{
+	using Component = T;
+	using Key = std::remove_cv_t<T>;
+	static constexpr bool CHANGE_FILTER = true;
+	static constexpr bool ARGUMENT = true;
+	static constexpr TermPresence PRESENCE = TermPresence::Required;
+};
+
+template <typename T>
+struct QueryTermTraits<Optional<T>>
+{
+	using Component = T;
+	using Key = Optional<std::remove_cv_t<T>>;
+	static constexpr bool CHANGE_FILTER = false;
+	static constexpr bool ARGUMENT = true;
+	static constexpr TermPresence PRESENCE = TermPresence::Optional;
+};
+
+template <typename T>
+struct QueryTermTraits<With<T>>
+{
+	using Component = T;
+	using Key = std::remove_cv_t<T>;
+	static constexpr bool CHANGE_FILTER = false;
+	static constexpr bool ARGUMENT = false;
+	static constexpr TermPresence PRESENCE = TermPresence::Required;
+};
+
+template <typename T>
+struct QueryTermTraits<Without<T>>
+{
+	using Component = T;
+	using Key = Without<std::remove_cv_t<T>>;
+	static constexpr bool CHANGE_FILTER = false;
+	static constexpr bool ARGUMENT = false;
+	static constexpr TermPresence PRESENCE = TermPresence::Excluded;
+};
+
+template <typename Term>
+using TermComponent = typename QueryTermTraits<Term>::Component;
+
+template <typename Term>
+using TermKey = typename QueryTermTraits<Term>::Key;
+
+template <typename Term>
+constexpr bool IsWriteTerm = QueryTermTraits<Term>::ARGUMENT && !std::is_const_v<TermComponent<Term>>;
+
+template <typename Term>
+constexpr bool IsOptionalTerm = QueryTermTraits<Term>::PRESENCE == TermPresence::Optional;
+
+/**
+ * @struct TermList
+ * @brief A list of query terms.
+ */
+template <typename... Terms>
+struct TermList {};
+
+template <typename List, typename... Terms>
+struct ArgumentTermFilter;
+
+template <typename... Arguments>
+struct ArgumentTermFilter<TermList<Arguments...>>
+{
+	using Type = TermList<Arguments...>;
+};
+
+template <typename... Arguments, typename Term, typename... Terms>
+struct ArgumentTermFilter<TermList<Arguments...>, Term, Terms...>
+{
+	using Type = typename ArgumentTermFilter<std::conditional_t<QueryTermTraits<Term>::ARGUMENT,
+		TermList<Arguments..., Term>, TermList<Arguments...>>, Terms...>::Type;
+};
+
+/**
+ * @brief The terms of a query that are passed to the callback, in order. With and Without terms only affect matching.
+ */
+template <typename... Terms>
+using ArgumentTerms = typename ArgumentTermFilter<TermList<>, Terms...>::Type;
+
+#endif // QUERY_TERM_H_
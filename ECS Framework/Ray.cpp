@@ -26,3 +26,18 @@ bool Ray::Intersect(const AABB& aabb, float& distance) const
 	distance = tmin > 0 ? tmin : tmax;
 	return distance >= 0;
 }
+
+bool Ray::IntersectEntry(const AABB& aabb, float& entryDistance) const
+{
+	Vector3 t1 = Vector3::Scale(aabb.GetLowerBound() - m_origin, m_inverseDirection);
+	Vector3 t2 = Vector3::Scale(aabb.GetUpperBound() - m_origin, m_inverseDirection);
+
+	float tmin = max(min(t1.x, t2.x), max(min(t1.y, t2.y), min(t1.z, t2.z)));
+	float tmax = min(max(t1.x, t2.x), min(max(t1.y, t2.y), max(t1.z, t2.z)));
+
+	if (tmax < 0 || tmin > tmax)
+		return false;
+
+	entryDistance = max(tmin, 0.0f);
+	return true;
+}
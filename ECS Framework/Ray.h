@@ -10,6 +10,9 @@ public:
 	Ray(Vector3 origin, Vector3 direction);
 
 	bool Intersect(const AABB& aabb, float& distance) const;
+	// Distance along the ray where it enters the box, 0 when it starts inside. Never more than the distance of a hit
+	// on any box inside this one, so it can cull boxes nested in it.
+	bool IntersectEntry(const AABB& aabb, float& entryDistance) const;
 	Vector3 GetOrigin() const { return m_origin; }
 	Vector3 GetDirection() const { return m_direction; }
 
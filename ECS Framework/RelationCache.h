@@ -0,0 +1,227 @@
+// Cached storage locations of relation targets.
+//
+// A relation is a component linking its entity to two target entities, such as a spring joining two particles.
+// Looking the targets up by handle costs two random lookups per component per relation, so a RelationCache
+// resolves every relation once into pointers at both targets' component data and reuses them until they go
+// stale. Any change that moves rows bumps the scene's structure version and rebuilds the whole cache, and a
+// relation whose targets were changed since it was resolved is resolved again on its own.
+
+#pragma once
+#ifndef RELATION_CACHE_H_
+#define RELATION_CACHE_H_
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <type_traits>
+
+#include "ECSScene.h"
+
+/**
+ * @class RelationCache
+ * @brief Iterates over the relations of a scene with direct pointers to the components of both targets. Relations
+ * whose targets have been destroyed are destroyed through the scene's command buffer, and relations whose targets
+ * are missing a component are skipped.
+ * @tparam Relation The relation component, declared with ECS_RELATION.
+ * @tparam ...Components The components of each target to pass to the callback, const qualified for read only access.
+ */
+template <typename Relation, typename... Components>
+class RelationCache
+{
+public:
+	/**
+	 * @brief Iterates over every relation whose targets both have the components, resolving the relations first
+	 * if they are stale. Every chunk holding a target's non const components is marked as changed before the
+	 * callback is called. Entities must not be created, destroyed or change components until the call returns.
+	 * @param scene The scene holding the relations.
+	 * @param callback A callback method that contains the parameters: Entity, const Relation*, Components* of the
+	 * first target..., Components* of the second target...
+	 */
+	template <typename Callback>
+	void ForEach(ECSScene& scene, Callback&& callback)
+	{
+		Refresh(scene);
+		ProfileCounters::CountEntities(m_entries.size());
+
+		for (const TargetChunk& chunk : m_targetChunks)
+		{
+			MarkChunk(chunk.archetype, chunk.chunkIndex);
+		}
+
+		// the targets are compared instead of tracking changes to the relation column, as that is as cheap as
+		// reading the relation and catches writes made at any change version
+		bool retargeted = false;
+		for (Entry& entry : m_entries)
+		{
+			if (RelationTraits<Relation>::GetTargetA(*entry.relation) != entry.targetA || RelationTraits<Relation>::GetTargetB(*entry.relation) != entry.targetB)
+			{
+				ResolveEntry(scene, entry);
+				MarkTargets(entry);
+				retargeted = true;
+			}
+
+			if (!entry.valid) { continue; }
+
+			std::apply(callback, std::tuple_cat(std::tuple<Entity, const Relation*>(entry.entity, entry.relation), entry.a.components, entry.b.components));
+		}
+
+		if (retargeted)
+		{
+			CollectTargetChunks();
+		}
+	}
+
+private:
+	/**
+	 * @struct Target
+	 * @brief The cached location of one target of a relation.
+	 */
+	struct Target
+	{
+		Archetype* archetype = nullptr;
+		size_t chunkIndex = 0;
+		std::tuple<Components*...> components;
+	};
+
+	/**
+	 * @struct Entry
+	 * @brief One relation and its resolved targets, in the order the relations are stored.
+	 */
+	struct Entry
+	{
+		Entity entity = INVALID_ENTITY;
+		const Relation* relation = nullptr;
+		Entity targetA = INVALID_ENTITY; // Targets of the relation when it was resolved.
+		Entity targetB = INVALID_ENTITY;
+		Target a;
+		Target b;
+		bool valid = false; // False if a target is destroyed or missing a component.
+	};
+
+	/**
+	 * @struct TargetChunk
+	 * @brief A chunk holding at least one target, marked as changed once per iteration instead of once per relation.
+	 */
+	struct TargetChunk
+	{
+		Archetype* archetype;
+		size_t chunkIndex;
+
+		bool operator<(const TargetChunk& other) const
+		{
+			return archetype != other.archetype ? std::less<Archetype*>()(archetype, other.archetype) : chunkIndex < other.chunkIndex;
+		}
+
+		bool operator==(const TargetChunk& other) const = default;
+	};
+
+	std::vector<Entry> m_entries; // Every relation of the scene, in the order they are stored.
+	std::vector<TargetChunk> m_targetChunks; // Sorted chunks holding the targets of valid entries.
+	uint32_t m_structureVersion = 0; // Structure version of the scene when the cache was built.
+	bool m_built = false;
+
+	/**
+	 * @brief Rebuilds the cache if the scene's structure changed since it was built.
+	 */
+	void Refresh(ECSScene& scene)
+	{
+		if (m_built && m_structureVersion == scene.GetStructureVersion()) { return; }
+
+		m_entries.clear();
+		for (Archetype* archetype : scene.GetQuery<Relation>().GetArchetypes())
+		{
+			const std::vector<Chunk>& chunks = archetype->GetChunks();
+			for (size_t chunkIndex = 0; chunkIndex < chunks.size() && chunks[chunkIndex].m_count > 0; chunkIndex++)
+			{
+				const Entity* entities = chunks[chunkIndex].GetEntities();
+				const Relation* relations = static_cast<const Relation*>(archetype->GetColumnData(chunkIndex, GetComponentID<Relation>()));
+				for (size_t row = 0; row < chunks[chunkIndex].m_count; row++)
+				{
+					Entry& entry = m_entries.emplace_back();
+					entry.entity = entities[row];
+					entry.relation = &relations[row];
+					ResolveEntry(scene, entry);
+				}
+			}
+		}
+
+		CollectTargetChunks();
+		m_structureVersion = scene.GetStructureVersion();
+		m_built = true;
+	}
+
+	/**
+	 * @brief Resolves the targets of a relation, queueing the relation for destruction if a target was destroyed.
+	 */
+	static void ResolveEntry(ECSScene& scene, Entry& entry)
+	{
+		entry.targetA = RelationTraits<Relation>::GetTargetA(*entry.relation);
+		entry.targetB = RelationTraits<Relation>::GetTargetB(*entry.relation);
+		if (!scene.DoesEntityExist(entry.targetA) || !scene.DoesEntityExist(entry.targetB))
+		{
+			// the relation holds a stale handle and is removed with its target
+			scene.GetCommandBuffer().DestroyEntity(entry.entity);
+			entry.valid = false;
+			return;
+		}
+
+		entry.valid = ResolveTarget(scene, entry.targetA, entry.a) && ResolveTarget(scene, entry.targetB, entry.b);
+	}
+
+	/**
+	 * @brief Caches the location of a target's components.
+	 * @return False if the target is missing one of the components.
+	 */
+	static bool ResolveTarget(ECSScene& scene, Entity entity, Target& target)
+	{
+		EntityLocation location = scene.GetEntityLocation(entity);
+		if (location.archetype == nullptr || !(location.archetype->HasComponent(GetComponentID<Components>()) && ...))
+		{
+			return false;
+		}
+
+		target.archetype = location.archetype;
+		target.chunkIndex = location.archetype->GetChunkIndex(location.row);
+		target.components = { location.archetype->template GetComponentAtRowUnmarked<Components>(location.row)... };
+		return true;
+	}
+
+	/**
+	 * @brief Marks the non const components of a chunk holding targets as changed.
+	 */
+	static void MarkChunk(Archetype* archetype, size_t chunkIndex)
+	{
+		((!std::is_const_v<Components> ? archetype->MarkComponentChanged(chunkIndex, GetComponentID<Components>()) : void()), ...);
+	}
+
+	/**
+	 * @brief Marks the chunks holding the targets of a relation resolved during an iteration, as they may not have
+	 * been marked with the rest.
+	 */
+	static void MarkTargets(const Entry& entry)
+	{
+		if (!entry.valid) { return; }
+
+		MarkChunk(entry.a.archetype, entry.a.chunkIndex);
+		MarkChunk(entry.b.archetype, entry.b.chunkIndex);
+	}
+
+	/**
+	 * @brief Lists the distinct chunks holding the targets of valid entries.
+	 */
+	void CollectTargetChunks()
+	{
+		m_targetChunks.clear();
+		for (const Entry& entry : m_entries)
+		{
+			if (!entry.valid) { continue; }
+
+			m_targetChunks.push_back({ entry.a.archetype, entry.a.chunkIndex });
+			m_targetChunks.push_back({ entry.b.archetype, entry.b.chunkIndex });
+		}
+
+		std::sort(m_targetChunks.begin(), m_targetChunks.end());
+		m_targetChunks.erase(std::unique(m_targetChunks.begin(), m_targetChunks.end()), m_targetChunks.end());
+	}
+};
+
+#endif // RELATION_CACHE_H_
@@ -0,0 +1,440 @@
+#include "SceneSnapshot.h"
+#include "ECSScene.h"
+#include "Components.h"
+#include "AABBTree.h"
+#include "BroadPhase.h"
+#include "MappedFile.h"
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<Node> && std::is_trivially_copyable_v<AABB>, "AABB tree nodes are stored as raw bytes.");
+static_assert(std::is_trivially_copyable_v<SnapshotHeader> && std::is_trivially_copyable_v<SnapshotArchetype>, "Snapshot records are stored as raw bytes.");
+
+namespace
+{
+	uint64_t AlignOffset(uint64_t offset)
+	{
+		return (offset + SNAPSHOT_ALIGNMENT - 1) & ~(SNAPSHOT_ALIGNMENT - 1);
+	}
+
+	/**
+	 * @class SnapshotWriter
+	 * @brief Writes arrays to a file, padding between them so each starts at the offset chosen for it.
+	 */
+	class SnapshotWriter
+	{
+	public:
+		explicit SnapshotWriter(const std::string& path) : m_file(path, std::ios::binary | std::ios::trunc) {}
+
+		bool IsGood() const { return m_file.good(); }
+		uint64_t GetOffset() const { return m_offset; }
+
+		void Write(const void* data, uint64_t size)
+		{
+			m_file.write(static_cast<const char*>(data), (std::streamsize)size);
+			m_offset += size;
+		}
+
+		void PadTo(uint64_t offset)
+		{
+			static const char zeros[SNAPSHOT_ALIGNMENT] = {};
+			while (m_offset < offset)
+			{
+				Write(zeros, std::min<uint64_t>(offset - m_offset, SNAPSHOT_ALIGNMENT));
+			}
+		}
+
+	private:
+		std::ofstream m_file;
+		uint64_t m_offset = 0; // Number of bytes written so far.
+	};
+
+	/**
+	 * @brief Checks that an array lies inside a file.
+	 */
+	bool IsInFile(uint64_t fileSize, uint64_t offset, uint64_t count, uint64_t elementSize)
+	{
+		return offset <= fileSize && (elementSize == 0 || count <= (fileSize - offset) / elementSize);
+	}
+}
+
+bool SceneSnapshot::Save(const std::string& path, const ECSScene& scene, const BroadPhase& broadPhase)
+{
+	const EntityManager& entityManager = *scene.m_entityManager;
+	const ComponentManager& componentManager = *scene.m_componentManager;
+
+	const std::vector<EntityVersion>& versions = entityManager.GetVersions();
+	std::vector<uint32_t> availableIndices = entityManager.GetAvailableIndices();
+
+	SnapshotHeader header;
+	header.nodeSize = sizeof(Node);
+	for (size_t type = 0; type < MAX_COMPONENT_TYPES; type++)
+	{
+		header.componentSizes[type] = (uint32_t)componentManager.GetComponentSize((ComponentType)type);
+	}
+
+	// lay out every array before writing, so the header and archetype records can be written first
+	uint64_t offset = AlignOffset(sizeof(SnapshotHeader));
+
+	header.entityIndexCount = (uint32_t)versions.size();
+	header.availableIndexCount = (uint32_t)availableIndices.size();
+	header.versionsOffset = offset;
+	offset = AlignOffset(offset + versions.size() * sizeof(EntityVersion));
+	header.availableIndicesOffset = offset;
+	offset = AlignOffset(offset + availableIndices.size() * sizeof(uint32_t));
+
+	std::vector<const Archetype*> archetypes;
+	for (const std::unique_ptr<Archetype>& archetype : componentManager.GetArchetypes())
+	{
+		if (archetype->GetEntityCount() > 0)
+		{
+			archetypes.push_back(archetype.get());
+		}
+	}
+
+	header.archetypeCount = (uint32_t)archetypes.size();
+	header.archetypesOffset = offset;
+	offset = AlignOffset(offset + archetypes.size() * sizeof(SnapshotArchetype));
+
+	std::vector<SnapshotArchetype> records(archetypes.size());
+	for (size_t i = 0; i < archetypes.size(); i++)
+	{
+		records[i].signature = archetypes[i]->GetSignature();
+		records[i].entityCount = archetypes[i]->GetEntityCount();
+		records[i].dataOffset = offset;
+
+		offset = AlignOffset(offset + records[i].entityCount * sizeof(Entity));
+		for (ComponentType type : archetypes[i]->GetComponentTypes())
+		{
+			offset = AlignOffset(offset + records[i].entityCount * archetypes[i]->GetComponentSize(type));
+		}
+	}
+
+	offset = LayOutTree(header.staticTree, broadPhase.m_staticTree, offset);
+	offset = LayOutTree(header.dynamicTree, broadPhase.m_dynamicTree, offset);
+
+	header.fileSize = offset;
+
+	SnapshotWriter writer(path);
+	if (!writer.IsGood()) { return false; }
+
+	writer.Write(&header, sizeof(header));
+	writer.PadTo(header.versionsOffset);
+	writer.Write(versions.data(), versions.size() * sizeof(EntityVersion));
+	writer.PadTo(header.availableIndicesOffset);
+	writer.Write(availableIndices.data(), availableIndices.size() * sizeof(uint32_t));
+	writer.PadTo(header.archetypesOffset);
+	writer.Write(records.data(), records.size() * sizeof(SnapshotArchetype));
+
+	std::vector<char> gathered;
+	for (size_t i = 0; i < archetypes.size(); i++)
+	{
+		const std::vector<Chunk>& chunks = archetypes[i]->GetChunks();
+
+		writer.PadTo(records[i].dataOffset);
+		for (size_t chunkIndex = 0; chunkIndex < chunks.size() && chunks[chunkIndex].m_count > 0; chunkIndex++)
+		{
+			writer.Write(chunks[chunkIndex].GetEntities(), chunks[chunkIndex].m_count * sizeof(Entity));
+		}
+
+		// each column is written a chunk at a time, so the rows of every chunk end up in one array. Split components
+		// are gathered back into whole components first, so files do not depend on the chunk layout
+		for (ComponentType type : archetypes[i]->GetComponentTypes())
+		{
+			writer.PadTo(AlignOffset(writer.GetOffset()));
+			for (size_t chunkIndex = 0; chunkIndex < chunks.size() && chunks[chunkIndex].m_count > 0; chunkIndex++)
+			{
+				size_t size = chunks[chunkIndex].m_count * archetypes[i]->GetComponentSize(type);
+				if (archetypes[i]->IsSplitComponent(type))
+				{
+					gathered.resize(size);
+					archetypes[i]->ReadComponents(type, chunkIndex * archetypes[i]->GetChunkCapacity(), gathered.data(), chunks[chunkIndex].m_count);
+					writer.Write(gathered.data(), size);
+				}
+				else
+				{
+					writer.Write(archetypes[i]->GetColumnData(chunkIndex, type), size);
+				}
+			}
+		}
+	}
+
+	auto writeTree = [&writer](const SnapshotTree& record, const AABBTree& tree) {
+		writer.PadTo(record.nodesOffset);
+		writer.Write(tree.m_nodes.data(), tree.m_nodes.size() * sizeof(Node));
+		writer.PadTo(record.enlargedBoxesOffset);
+		writer.Write(tree.m_enlargedBoxes.data(), tree.m_enlargedBoxes.size() * sizeof(AABB));
+		};
+
+	writeTree(header.staticTree, broadPhase.m_staticTree);
+	writeTree(header.dynamicTree, broadPhase.m_dynamicTree);
+	writer.PadTo(header.fileSize);
+
+	return writer.IsGood();
+}
+
+bool SceneSnapshot::Load(const std::string& path, ECSScene& scene, BroadPhase& broadPhase)
+{
+	EntityManager& entityManager = *scene.m_entityManager;
+	ComponentManager& componentManager = *scene.m_componentManager;
+
+	MappedFile file;
+	if (!file.Open(path) || file.GetSize() < sizeof(SnapshotHeader)) { return false; }
+
+	const char* data = file.GetData();
+	const SnapshotHeader& header = *reinterpret_cast<const SnapshotHeader*>(data);
+
+	// check the snapshot was written by a compatible build and fits the scene before anything is restored
+	if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION || header.fileSize != file.GetSize() ||
+		header.maxComponentTypes != MAX_COMPONENT_TYPES || header.nodeSize != sizeof(Node))
+	{
+		return false;
+	}
+
+	for (size_t type = 0; type < MAX_COMPONENT_TYPES; type++)
+	{
+		if (header.componentSizes[type] != componentManager.GetComponentSize((ComponentType)type)) { return false; }
+	}
+
+	if (!entityManager.GetVersions().empty() || !broadPhase.m_staticTree.m_nodes.empty() || !broadPhase.m_dynamicTree.m_nodes.empty())
+	{
+		return false;
+	}
+
+	if (header.availableIndexCount > header.entityIndexCount) { return false; }
+
+	uint64_t fileSize = header.fileSize;
+	if (!IsInFile(fileSize, header.versionsOffset, header.entityIndexCount, sizeof(EntityVersion)) ||
+		!IsInFile(fileSize, header.availableIndicesOffset, header.availableIndexCount, sizeof(uint32_t)) ||
+		!IsInFile(fileSize, header.archetypesOffset, header.archetypeCount, sizeof(SnapshotArchetype)) ||
+		!IsValidTree(header.staticTree, fileSize) || !IsValidTree(header.dynamicTree, fileSize))
+	{
+		return false;
+	}
+
+	// retired indices are neither free nor alive
+	const EntityVersion* versions = reinterpret_cast<const EntityVersion*>(data + header.versionsOffset);
+	uint32_t retiredCount = (uint32_t)std::count(versions, versions + header.entityIndexCount, RETIRED_ENTITY_VERSION);
+	if (header.entityIndexCount - header.availableIndexCount < retiredCount ||
+		header.entityIndexCount - header.availableIndexCount - retiredCount > entityManager.GetMaxEntities())
+	{
+		return false;
+	}
+
+	const SnapshotArchetype* records = reinterpret_cast<const SnapshotArchetype*>(data + header.archetypesOffset);
+
+	// find every column of every archetype, checking each lies inside the file
+	std::vector<std::vector<const void*>> columns(header.archetypeCount);
+	for (uint32_t i = 0; i < header.archetypeCount; i++)
+	{
+		const SnapshotArchetype& record = records[i];
+		if (record.signature.none() || record.entityCount > header.entityIndexCount ||
+			!IsInFile(fileSize, record.dataOffset, record.entityCount, sizeof(Entity)))
+		{
+			return false;
+		}
+
+		uint64_t offset = AlignOffset(record.dataOffset + record.entityCount * sizeof(Entity));
+		bool valid = true;
+		record.signature.ForEachSetBit([&](size_t type) {
+			uint64_t size = header.componentSizes[type];
+			valid = valid && size != 0 && IsInFile(fileSize, offset, record.entityCount, size);
+
+			columns[i].push_back(data + offset);
+			offset = AlignOffset(offset + record.entityCount * size);
+			});
+
+		if (!valid) { return false; }
+	}
+
+	// entity handles and node links index straight into the engine's arrays, so they are checked as well
+	std::vector<bool> isIndexDead;
+	std::vector<bool> isIndexInTree(header.entityIndexCount, false);
+	if (!IsValidEntities(header, data, records, isIndexDead) ||
+		!IsValidTreeNodes(header.staticTree, data, versions, isIndexDead, isIndexInTree) ||
+		!IsValidTreeNodes(header.dynamicTree, data, versions, isIndexDead, isIndexInTree))
+	{
+		return false;
+	}
+
+	// colliders only reach the broad phase when they are inserted, so each must already have its leaf
+	for (uint32_t i = 0; i < header.archetypeCount; i++)
+	{
+		if (!records[i].signature.test(GetComponentID<Collider>())) { continue; }
+
+		const Entity* entities = reinterpret_cast<const Entity*>(data + records[i].dataOffset);
+		for (uint64_t row = 0; row < records[i].entityCount; row++)
+		{
+			if (!isIndexInTree[GetEntityIndex(entities[row])]) { return false; }
+		}
+	}
+
+	// restore the entity table, then copy every archetype's rows straight into its chunks
+	entityManager.Restore(versions, header.entityIndexCount,
+		reinterpret_cast<const uint32_t*>(data + header.availableIndicesOffset), header.availableIndexCount);
+
+	for (uint32_t i = 0; i < header.archetypeCount; i++)
+	{
+		const SnapshotArchetype& record = records[i];
+		const Entity* entities = reinterpret_cast<const Entity*>(data + record.dataOffset);
+
+		componentManager.AddEntities(record.signature, entities, record.entityCount, columns[i].data());
+		for (uint64_t row = 0; row < record.entityCount; row++)
+		{
+			entityManager.SetSignature(entities[row], record.signature);
+		}
+	}
+
+	// pairs are not stored, so every leaf is marked as moved for the first pair update to find them
+	RestoreTree(header.staticTree, data, broadPhase.m_staticTree);
+	RestoreTree(header.dynamicTree, data, broadPhase.m_dynamicTree);
+
+	for (const AABBTree* tree : { &broadPhase.m_staticTree, &broadPhase.m_dynamicTree })
+	{
+		for (const Node& node : tree->m_nodes)
+		{
+			if (node.isLeaf)
+			{
+				broadPhase.MarkMoved(node.entity);
+			}
+		}
+	}
+
+	return true;
+}
+
+uint64_t SceneSnapshot::LayOutTree(SnapshotTree& record, const AABBTree& tree, uint64_t offset)
+{
+	record.rootIndex = tree.m_rootIndex;
+	record.nodeCount = (uint32_t)tree.m_nodes.size();
+	record.allocatedCount = (uint32_t)tree.m_nodeCount;
+	record.freeListIndex = tree.m_freeListIndex;
+	record.nodesOffset = offset;
+	offset = AlignOffset(offset + tree.m_nodes.size() * sizeof(Node));
+	record.enlargedBoxesOffset = offset;
+	return AlignOffset(offset + tree.m_enlargedBoxes.size() * sizeof(AABB));
+}
+
+bool SceneSnapshot::IsValidTree(const SnapshotTree& record, uint64_t fileSize)
+{
+	return record.allocatedCount <= record.nodeCount &&
+		record.rootIndex >= NULL_NODE_INDEX && record.rootIndex < (int64_t)record.nodeCount &&
+		record.freeListIndex >= NULL_NODE_INDEX && record.freeListIndex < (int64_t)record.nodeCount &&
+		IsInFile(fileSize, record.nodesOffset, record.nodeCount, sizeof(Node)) &&
+		IsInFile(fileSize, record.enlargedBoxesOffset, record.nodeCount, sizeof(AABB));
+}
+
+bool SceneSnapshot::IsValidEntities(const SnapshotHeader& header, const char* data, const SnapshotArchetype* records, std::vector<bool>& isIndexDead)
+{
+	const EntityVersion* versions = reinterpret_cast<const EntityVersion*>(data + header.versionsOffset);
+	const uint32_t* availableIndices = reinterpret_cast<const uint32_t*>(data + header.availableIndicesOffset);
+
+	// every index is either retired, free or alive, and an alive index is stored in at most one row
+	isIndexDead.assign(header.entityIndexCount, false);
+	for (uint32_t i = 0; i < header.entityIndexCount; i++)
+	{
+		isIndexDead[i] = versions[i] == RETIRED_ENTITY_VERSION;
+	}
+
+	for (uint32_t i = 0; i < header.availableIndexCount; i++)
+	{
+		uint32_t index = availableIndices[i];
+		if (index >= header.entityIndexCount || isIndexDead[index]) { return false; }
+		isIndexDead[index] = true;
+	}
+
+	std::vector<bool> isIndexStored(header.entityIndexCount, false);
+	for (uint32_t i = 0; i < header.archetypeCount; i++)
+	{
+		const Entity* entities = reinterpret_cast<const Entity*>(data + records[i].dataOffset);
+		for (uint64_t row = 0; row < records[i].entityCount; row++)
+		{
+			uint32_t index = GetEntityIndex(entities[row]);
+			if (index >= header.entityIndexCount || isIndexDead[index] || isIndexStored[index] ||
+				GetEntityVersion(entities[row]) != versions[index])
+			{
+				return false;
+			}
+			isIndexStored[index] = true;
+		}
+	}
+
+	return true;
+}
+
+bool SceneSnapshot::IsValidTreeNodes(const SnapshotTree& record, const char* data, const EntityVersion* versions, const std::vector<bool>& isIndexDead,
+	std::vector<bool>& isIndexInTree)
+{
+	const Node* nodes = reinterpret_cast<const Node*>(data + record.nodesOffset);
+	auto isInPool = [&](int64_t index) { return index >= 0 && index < (int64_t)record.nodeCount; };
+
+	std::vector<bool> isVisited(record.nodeCount, false);
+	uint64_t freeCount = 0;
+	for (int64_t index = record.freeListIndex; index != NULL_NODE_INDEX; index = nodes[index].parentIndex)
+	{
+		if (!isInPool(index) || isVisited[index] || !nodes[index].isFree || nodes[index].isLeaf) { return false; }
+		isVisited[index] = true;
+		freeCount++;
+	}
+
+	if (freeCount != record.nodeCount - record.allocatedCount) { return false; }
+	if (record.rootIndex == NULL_NODE_INDEX) { return record.allocatedCount == 0; }
+	if (nodes[record.rootIndex].parentIndex != NULL_NODE_INDEX) { return false; }
+
+	// walk down from the root, so a cycle or a node shared by two parents is found as a node visited twice
+	uint64_t allocatedCount = 0;
+	std::vector<int> stack = { (int)record.rootIndex };
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+
+		const Node& node = nodes[index];
+		if (isVisited[index] || node.isFree) { return false; }
+		isVisited[index] = true;
+		allocatedCount++;
+
+		if (node.isLeaf)
+		{
+			uint32_t entityIndex = GetEntityIndex(node.entity);
+			if (entityIndex >= isIndexInTree.size() || isIndexDead[entityIndex] || isIndexInTree[entityIndex] ||
+				GetEntityVersion(node.entity) != versions[entityIndex])
+			{
+				return false;
+			}
+			isIndexInTree[entityIndex] = true;
+			continue;
+		}
+
+		for (int child : { node.child1, node.child2 })
+		{
+			if (!isInPool(child) || nodes[child].parentIndex != index) { return false; }
+			stack.push_back(child);
+		}
+	}
+
+	return allocatedCount == record.allocatedCount;
+}
+
+void SceneSnapshot::RestoreTree(const SnapshotTree& record, const char* data, AABBTree& tree)
+{
+	const Node* nodes = reinterpret_cast<const Node*>(data + record.nodesOffset);
+	const AABB* enlargedBoxes = reinterpret_cast<const AABB*>(data + record.enlargedBoxesOffset);
+
+	tree.m_nodes.assign(nodes, nodes + record.nodeCount);
+	tree.m_enlargedBoxes.assign(enlargedBoxes, enlargedBoxes + record.nodeCount);
+	tree.m_costCache.resize(record.nodeCount);
+	tree.m_nodeCount = (int)record.allocatedCount;
+	tree.m_rootIndex = record.rootIndex;
+	tree.m_freeListIndex = record.freeListIndex;
+
+	for (uint32_t i = 0; i < record.nodeCount; i++)
+	{
+		if (nodes[i].isLeaf)
+		{
+			tree.m_entityToNodeIndex.Set(nodes[i].entity, (int)i);
+		}
+	}
+}
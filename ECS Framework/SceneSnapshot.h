@@ -0,0 +1,145 @@
+// Binary snapshots of a whole scene and its broad phase.
+//
+// A snapshot stores the raw bytes of the engine's own arrays: the entity table, then every archetype's
+// signature, entity identifiers and component columns, then the node pools of the broad phase's trees. Loading maps the file
+// and copies each array straight into place with one block copy per chunk, so nothing is parsed and no
+// entity moves through the archetype graph.
+
+#pragma once
+#ifndef SCENE_SNAPSHOT_H_
+#define SCENE_SNAPSHOT_H_
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Definitions.h"
+
+class ECSScene;
+class AABBTree;
+class BroadPhase;
+
+constexpr uint32_t SNAPSHOT_MAGIC = 0x53534345; // "ECSS" read as little endian bytes.
+constexpr uint32_t SNAPSHOT_VERSION = 4; // Incremented whenever the layout of a snapshot changes.
+constexpr uint64_t SNAPSHOT_ALIGNMENT = 64; // Alignment of every array in a snapshot file.
+
+/**
+ * @struct SnapshotTree
+ * @brief Describes the node pool of one AABB tree in a snapshot file.
+ */
+struct SnapshotTree
+{
+	int32_t rootIndex = -1; // Node index of the tree's root.
+	uint32_t nodeCount = 0; // Number of nodes in the pool, free nodes included.
+	uint32_t allocatedCount = 0; // Number of allocated nodes.
+	int32_t freeListIndex = -1; // Node index of the first free node.
+	uint64_t nodesOffset = 0; // Node pool, indexed by node index.
+	uint64_t enlargedBoxesOffset = 0; // AABB enlarged box of every node, indexed by node index.
+};
+
+/**
+ * @struct SnapshotHeader
+ * @brief Describes the contents of a snapshot file, at the start of the file. Every offset is in bytes from the
+ * start of the file.
+ */
+struct SnapshotHeader
+{
+	uint32_t magic = SNAPSHOT_MAGIC;
+	uint32_t version = SNAPSHOT_VERSION;
+	uint64_t fileSize = 0; // Total size of the file, a mismatch means the file was truncated.
+
+	uint32_t maxComponentTypes = MAX_COMPONENT_TYPES;
+	uint32_t nodeSize = 0; // Size of an AABB tree node, as nodes are stored raw.
+	uint32_t componentSizes[MAX_COMPONENT_TYPES] = {}; // Registered size of every component type, 0 if unregistered.
+
+	uint32_t entityIndexCount = 0; // Number of entity indices that have been used.
+	uint32_t availableIndexCount = 0; // Number of indices of destroyed entities waiting to be reused.
+	uint64_t versionsOffset = 0; // One EntityVersion per used entity index.
+	uint64_t availableIndicesOffset = 0; // uint32_t indices of destroyed entities, in reuse order.
+
+	uint32_t archetypeCount = 0; // Number of archetypes holding entities.
+	uint32_t reserved = 0; // Keeps the offsets aligned without leaving uninitialised padding in the file.
+	uint64_t archetypesOffset = 0; // One SnapshotArchetype per archetype.
+
+	SnapshotTree staticTree; // The broad phase's tree of static entities.
+	SnapshotTree dynamicTree; // The broad phase's tree of every other entity.
+};
+
+/**
+ * @struct SnapshotArchetype
+ * @brief Describes the entities of one archetype in a snapshot file. The entity identifiers are followed by one
+ * column per component type of the signature in ascending order, each aligned to SNAPSHOT_ALIGNMENT.
+ */
+struct SnapshotArchetype
+{
+	Signature signature;
+	uint64_t entityCount = 0;
+	uint64_t dataOffset = 0; // Offset of the entity identifiers.
+};
+
+/**
+ * @class SceneSnapshot
+ * @brief Writes a scene and its broad phase to a binary snapshot file, and loads snapshots back into an empty scene.
+ * Components are stored as raw bytes, so every component type must be trivially copyable and a snapshot can only
+ * be loaded by a build with the same component types and sizes.
+ */
+class SceneSnapshot
+{
+public:
+	/**
+	 * @brief Writes a snapshot of a scene. Must not be called while systems are updating.
+	 * @param path The path of the file to write, replaced if it exists.
+	 * @param scene The scene to save.
+	 * @param broadPhase The broad phase of the scene's colliders.
+	 * @return True if the snapshot was written, false if the file could not be written.
+	 */
+	static bool Save(const std::string& path, const ECSScene& scene, const BroadPhase& broadPhase);
+
+	/**
+	 * @brief Loads a snapshot into a scene that has been initialised and had its components registered, but has
+	 * never had entities. Every entity keeps its identifier, and its components are marked as changed.
+	 * @param path The path of the snapshot file.
+	 * @param scene The empty scene to load into.
+	 * @param broadPhase The empty broad phase to load into. Every loaded leaf is treated as moved, so the first pair
+	 * update finds every pair again.
+	 * @return True if the snapshot was loaded, false if the file is missing, was written by an incompatible build,
+	 * does not fit the scene, or is truncated or inconsistent. Nothing is loaded when false is returned.
+	 */
+	static bool Load(const std::string& path, ECSScene& scene, BroadPhase& broadPhase);
+
+private:
+	/**
+	 * @brief Fills in the record of a tree, placing its arrays from an offset onwards.
+	 * @return The aligned offset after the tree's arrays.
+	 */
+	static uint64_t LayOutTree(SnapshotTree& record, const AABBTree& tree, uint64_t offset);
+
+	/**
+	 * @brief Checks that the record of a tree is consistent and its arrays lie inside the file.
+	 */
+	static bool IsValidTree(const SnapshotTree& record, uint64_t fileSize);
+
+	/**
+	 * @brief Checks the entity table and the entities of every archetype record: each free index must be in the table
+	 * once and not retired, and each stored entity must be a living entity of the table that is stored in no other row.
+	 * @param isIndexDead Set to flag every free or retired entity index.
+	 */
+	static bool IsValidEntities(const SnapshotHeader& header, const char* data, const SnapshotArchetype* records, std::vector<bool>& isIndexDead);
+
+	/**
+	 * @brief Checks the links of a tree's node pool: the free list and the nodes reached from the root must cover the
+	 * pool exactly once, every child must point back at its parent, and every leaf's entity must be a living entity of
+	 * the table held by no other leaf of either tree.
+	 * @param versions The version of every entity index in the table.
+	 * @param isIndexDead Flags of the free and retired entity indices, from IsValidEntities.
+	 * @param isIndexInTree Flags of the entity indices already held by a leaf, updated with this tree's leaves.
+	 */
+	static bool IsValidTreeNodes(const SnapshotTree& record, const char* data, const EntityVersion* versions, const std::vector<bool>& isIndexDead,
+		std::vector<bool>& isIndexInTree);
+
+	/**
+	 * @brief Copies the node pool of a tree into an empty tree, rebuilding the entity to leaf map from the leaves.
+	 */
+	static void RestoreTree(const SnapshotTree& record, const char* data, AABBTree& tree);
+};
+
+#endif // SCENE_SNAPSHOT_H_
@@ -0,0 +1,162 @@
+#pragma once
+#ifndef SIGNATURE_H_
+#define SIGNATURE_H_
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class BitSignature
+ * @brief Fixed width set of component types stored as an array of 64 bit words. It keeps the std::bitset
+ * interface used by the engine, and every set operation works on whole words with a fixed trip count and no
+ * early exits, so the compiler can keep them in vector registers however many component types there are.
+ * @tparam Bits The number of component types the signature can hold.
+ */
+template <std::size_t Bits>
+class alignas(16) BitSignature
+{
+public:
+	static constexpr std::size_t WORD_BITS = 64;
+	static constexpr std::size_t WORD_COUNT = (Bits + WORD_BITS - 1) / WORD_BITS;
+
+	constexpr BitSignature() = default;
+
+	constexpr std::size_t size() const { return Bits; }
+
+	constexpr BitSignature& set(std::size_t bit)
+	{
+		m_words[bit / WORD_BITS] |= std::uint64_t(1) << (bit % WORD_BITS);
+		return *this;
+	}
+
+	constexpr BitSignature& reset(std::size_t bit)
+	{
+		m_words[bit / WORD_BITS] &= ~(std::uint64_t(1) << (bit % WORD_BITS));
+		return *this;
+	}
+
+	constexpr BitSignature& reset()
+	{
+		m_words = {};
+		return *this;
+	}
+
+	constexpr bool test(std::size_t bit) const
+	{
+		return (m_words[bit / WORD_BITS] >> (bit % WORD_BITS)) & 1;
+	}
+
+	constexpr bool operator[](std::size_t bit) const { return test(bit); }
+
+	constexpr bool any() const
+	{
+		std::uint64_t combined = 0;
+		for (std::size_t i = 0; i < WORD_COUNT; i++) { combined |= m_words[i]; }
+		return combined != 0;
+	}
+
+	constexpr bool none() const { return !any(); }
+
+	constexpr std::size_t count() const
+	{
+		std::size_t total = 0;
+		for (std::size_t i = 0; i < WORD_COUNT; i++) { total += std::popcount(m_words[i]); }
+		return total;
+	}
+
+	/**
+	 * @brief Checks if every bit of another signature is also set in this one.
+	 */
+	constexpr bool ContainsAll(const BitSignature& other) const
+	{
+		std::uint64_t missing = 0;
+		for (std::size_t i = 0; i < WORD_COUNT; i++) { missing |= other.m_words[i] & ~m_words[i]; }
+		return missing == 0;
+	}
+
+	/**
+	 * @brief Checks if any bit is set in both signatures.
+	 */
+	constexpr bool Intersects(const BitSignature& other) const
+	{
+		std::uint64_t shared = 0;
+		for (std::size_t i = 0; i < WORD_COUNT; i++) { shared |= other.m_words[i] & m_words[i]; }
+		return shared != 0;
+	}
+
+	/**
+	 * @brief Calls a function with the index of every set bit, in ascending order.
+	 */
+	template <typename Function>
+	constexpr void ForEachSetBit(Function&& function) const
+	{
+		for (std::size_t i = 0; i < WORD_COUNT; i++)
+		{
+			for (std::uint64_t word = m_words[i]; word != 0; word &= word - 1)
+			{
+				function(i * WORD_BITS + std::countr_zero(word));
+			}
+		}
+	}
+
+	/**
+	 * @brief Hashes every word of the signature, so signatures differing only in high component types still spread.
+	 */
+	constexpr std::size_t Hash() const
+	{
+		std::uint64_t hash = 0x9E3779B97F4A7C15ull;
+		for (std::size_t i = 0; i < WORD_COUNT; i++)
+		{
+			hash ^= m_words[i] + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+			hash ^= hash >> 33;
+			hash *= 0xFF51AFD7ED558CCDull;
+			hash ^= hash >> 33;
+		}
+		return (std::size_t)hash;
+	}
+
+	constexpr BitSignature operator&(const BitSignature& other) const
+	{
+		BitSignature result;
+		for (std::size_t i = 0; i < WORD_COUNT; i++) { result.m_words[i] = m_words[i] & other.m_words[i]; }
+		return result;
+	}
+
+	constexpr BitSignature operator|(const BitSignature& other) const
+	{
+		BitSignature result;
+		for (std::size_t i = 0; i < WORD_COUNT; i++) { result.m_words[i] = m_words[i] | other.m_words[i]; }
+		return result;
+	}
+
+	constexpr BitSignature& operator&=(const BitSignature& other) { return *this = *this & other; }
+	constexpr BitSignature& operator|=(const BitSignature& other) { return *this = *this | other; }
+
+	constexpr bool operator==(const BitSignature& other) const
+	{
+		std::uint64_t difference = 0;
+		for (std::size_t i = 0; i < WORD_COUNT; i++) { difference |= m_words[i] ^ other.m_words[i]; }
+		return difference == 0;
+	}
+
+	constexpr bool operator!=(const BitSignature& other) const { return !(*this == other); }
+
+	/**
+	 * @brief Orders signatures by their words, highest first. The order only depends on the component types, so
+	 * sorting by it gives the same result on every run.
+	 */
+	constexpr bool operator<(const BitSignature& other) const
+	{
+		for (std::size_t i = WORD_COUNT; i-- > 0;)
+		{
+			if (m_words[i] != other.m_words[i]) { return m_words[i] < other.m_words[i]; }
+		}
+		return false;
+	}
+
+private:
+	std::array<std::uint64_t, WORD_COUNT> m_words = {};
+};
+
+#endif // SIGNATURE_H_
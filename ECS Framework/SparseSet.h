@@ -1,5 +1,6 @@
 #pragma once
 #include "Definitions.h"
+#include "PagedSparseMap.h"
 #include <vector>
 #include <cassert>
 
@@ -14,24 +15,22 @@ template <typename T>
 class SparseSet : public ISparseSet
 {
 public:
-    SparseSet() : m_entityToDenseIndex(MAX_ENTITIES, UINT32_MAX) {}
-
     void AddComponent(Entity entity, const T& component)
     {
-        assert(m_entityToDenseIndex[entity] == UINT32_MAX && "Entity already has this component.");
+        assert(!m_entityToDenseIndex.Contains(entity) && "Entity already has this component.");
 
         // Map entity to dense array index
-        m_entityToDenseIndex[entity] = m_denseArray.size();
+        m_entityToDenseIndex.Set(entity, (uint32_t)m_denseArray.size());
         m_denseArray.push_back(component);
         m_denseIndexToEntity.push_back(entity);
     }
 
     void RemoveComponent(Entity entity)
     {
-        assert(m_entityToDenseIndex[entity] != UINT32_MAX && "Removing non-existent component.");
+        assert(m_entityToDenseIndex.Contains(entity) && "Removing non-existent component.");
 
         // Get indices
-        size_t removedEntityIndex = m_entityToDenseIndex[entity];
+        size_t removedEntityIndex = m_entityToDenseIndex.Get(entity);
         size_t lastEntityIndex = m_denseArray.size() - 1;
 
         // Replace removed element with the last one
@@ -39,19 +38,19 @@ public:
         Entity lastEntity = m_denseIndexToEntity[lastEntityIndex];
 
         // Update mappings
-        m_entityToDenseIndex[lastEntity] = removedEntityIndex;
+        m_entityToDenseIndex.Set(lastEntity, (uint32_t)removedEntityIndex);
         m_denseIndexToEntity[removedEntityIndex] = lastEntity;
 
         // Erase removed entity
-        m_entityToDenseIndex[entity] = UINT32_MAX;
+        m_entityToDenseIndex.Erase(entity);
         m_denseArray.pop_back();
         m_denseIndexToEntity.pop_back();
     }
 
     T& GetComponent(Entity entity)
     {
-        assert(m_entityToDenseIndex[entity] != UINT32_MAX && "Retrieving non-existent component.");
-        return m_denseArray[m_entityToDenseIndex[entity]];
+        assert(m_entityToDenseIndex.Contains(entity) && "Retrieving non-existent component.");
+        return m_denseArray[m_entityToDenseIndex.Get(entity)];
     }
 
     std::vector<T>& GetAllComponents()
@@ -61,7 +60,7 @@ public:
 
     void EntityDestroyed(Entity entity) override
     {
-        if (m_entityToDenseIndex[entity] != UINT32_MAX)
+        if (m_entityToDenseIndex.Contains(entity))
         {
             RemoveComponent(entity);
         }
@@ -70,5 +69,5 @@ public:
 private:
     std::vector<T> m_denseArray;                 // Contiguous array of components
     std::vector<Entity> m_denseIndexToEntity;    // Maps dense index -> entity
-    std::vector<size_t> m_entityToDenseIndex;    // Maps entity -> dense index
+    PagedSparseMap<uint32_t, UINT32_MAX> m_entityToDenseIndex; // Maps entity index -> dense index
 };
\ No newline at end of file
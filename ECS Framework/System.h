@@ -1,11 +1,98 @@
 #pragma once
 #include "Definitions.h"
+#include "ComponentID.h"
 #include <set>
+#include <vector>
 
 class ECSScene;
 
+/**
+ * @struct SystemAccess
+ * @brief The data a system reads and writes during its update. The system manager uses it to run
+ * systems that do not conflict with each other at the same time.
+ */
+struct SystemAccess
+{
+	Signature reads; // Component types read by the system.
+	Signature writes; // Component types written by the system.
+	std::vector<const void*> readResources; // Shared non-component data read by the system, such as the AABB tree.
+	std::vector<const void*> writeResources; // Shared non-component data written by the system.
+
+	// Set for systems that create or destroy entities or add or remove components. These are sync points:
+	// they run alone, after every system registered before them and before every system registered after.
+	bool structuralChanges = false;
+
+	template <typename T>
+	void Read() { reads.set(GetComponentID<T>()); }
+
+	template <typename T>
+	void Write() { writes.set(GetComponentID<T>()); }
+
+	void ReadResource(const void* resource) { readResources.push_back(resource); }
+	void WriteResource(const void* resource) { writeResources.push_back(resource); }
+
+	/**
+	 * @brief Checks if two systems can not run at the same time.
+	 * @return True if either system makes structural changes or writes data the other system uses.
+	 */
+	bool ConflictsWith(const SystemAccess& other) const
+	{
+		if (structuralChanges || other.structuralChanges)
+		{
+			return true;
+		}
+
+		if (writes.Intersects(other.reads | other.writes) || other.writes.Intersects(reads))
+		{
+			return true;
+		}
+
+		for (const void* resource : writeResources)
+		{
+			if (UsesResource(other, resource)) { return true; }
+		}
+
+		for (const void* resource : other.writeResources)
+		{
+			if (UsesResource(*this, resource)) { return true; }
+		}
+
+		return false;
+	}
+
+private:
+	static bool UsesResource(const SystemAccess& access, const void* resource)
+	{
+		for (const void* read : access.readResources)
+		{
+			if (read == resource) { return true; }
+		}
+
+		for (const void* write : access.writeResources)
+		{
+			if (write == resource) { return true; }
+		}
+
+		return false;
+	}
+};
+
 class System
 {
 public:
+	virtual ~System() = default;
+
 	virtual void Update(ECSScene& scene, float dt) = 0;
-};
\ No newline at end of file
+
+	/**
+	 * @brief Declares the components and resources used by the system. Systems that do not override this
+	 * are assumed to make structural changes, so they always run on their own.
+	 * @param access The access description to fill in.
+	 */
+	virtual void DeclareAccess(SystemAccess& access) { access.structuralChanges = true; }
+
+	/**
+	 * @brief Gets the name the system is reported under by the system profiler.
+	 */
+	virtual const char* GetName() const { return "System"; }
+};
@@ -1,25 +1,226 @@
 #pragma once
 #include "System.h"
+#include "JobSystem.h"
+#include "ChangeVersion.h"
+#include "SystemProfiler.h"
 #include <unordered_map>
 #include <memory>
 #include <cassert>
+#include <atomic>
+#include <functional>
 
 class SystemManager
 {
 public:
 	void RegisterSystem(std::unique_ptr<System> system)
 	{
+		m_profiler.AddSystem(system->GetName());
 		m_systems.push_back(std::move(system));
+		m_lastRunVersions.push_back(0);
 	}
 
+	/**
+	 * @brief Sets the function called at every sync point, used by the scene to play back command buffers.
+	 * Sync points are directly before and after each system that makes structural changes, when no other
+	 * system is running.
+	 */
+	void SetSyncPointCallback(std::function<void()> callback)
+	{
+		m_syncPointCallback = std::move(callback);
+	}
+
+	/**
+	 * @brief Updates every registered system. Each system depends on the earlier registered systems it
+	 * conflicts with, and systems run on the job system as soon as their dependencies have finished, so
+	 * systems with no conflicting access run concurrently while the registration order of conflicting
+	 * systems is kept.
+	 * @param scene The scene being updated.
+	 * @param dt The time step.
+	 */
 	void Update(ECSScene& scene, float dt)
 	{
-		for (const auto& system : m_systems)
+		m_profiling = m_profiler.IsEnabled();
+		int64_t frameStart = m_profiling ? m_profiler.Now() : 0;
+
+		BuildSchedule();
+
+		m_scene = &scene;
+		m_deltaTime = dt;
+
+		std::atomic<size_t> counter = m_systems.size();
+		m_counter = &counter;
+
+		// systems without dependencies are submitted from a list built beforehand, as running systems
+		// release their dependents concurrently with this loop
+		for (size_t systemIndex : m_rootSystems)
 		{
-			system->Update(scene, dt);
+			SubmitSystem(systemIndex);
 		}
+
+		JobSystem::GetInstance().Wait(counter);
+
+		if (m_profiling)
+		{
+			SystemSample frameSample;
+			frameSample.frame = m_frame;
+			frameSample.startNanoseconds = frameStart;
+			frameSample.durationNanoseconds = m_profiler.Now() - frameStart;
+			frameSample.systemIndex = SystemProfiler::FRAME_SAMPLE;
+			frameSample.threadIndex = (uint32_t)JobSystem::GetThreadIndex();
+			for (const ProfileCounters& counters : m_systemCounters)
+			{
+				frameSample.counters.entities += counters.entities;
+				frameSample.counters.allocatedBytes += counters.allocatedBytes;
+				frameSample.counters.archetypes += counters.archetypes;
+				frameSample.counters.allocations += counters.allocations;
+			}
+			m_profiler.Record(frameSample);
+		}
+
+		m_frame++;
 	}
 
+	/**
+	 * @brief Gets the profiler recording the timing and work counters of every system update.
+	 */
+	SystemProfiler& GetProfiler() { return m_profiler; }
+
 private:
 	std::vector<std::unique_ptr<System>> m_systems;
-};
\ No newline at end of file
+	std::vector<uint32_t> m_lastRunVersions; // Write version of each system's previous update, 0 before the first.
+
+	std::vector<SystemAccess> m_access; // The declared access of each system for the current frame.
+	std::vector<std::vector<size_t>> m_dependents; // Indices of the systems waiting on each system.
+	std::vector<size_t> m_rootSystems; // Indices of the systems with no dependencies.
+	std::unique_ptr<std::atomic<size_t>[]> m_remainingDependencies; // Unfinished dependencies of each system.
+	size_t m_remainingDependenciesSize = 0;
+
+	ECSScene* m_scene = nullptr; // The scene being updated by the current frame.
+	float m_deltaTime = 0.0f; // The time step of the current frame.
+	std::atomic<size_t>* m_counter = nullptr; // Number of systems left to finish in the current frame.
+	std::function<void()> m_syncPointCallback; // Called before and after each system making structural changes.
+
+	SystemProfiler m_profiler; // Timing and work counters of every system update.
+	std::vector<ProfileCounters> m_systemCounters; // Work counted by each system in the current frame.
+	uint64_t m_frame = 0; // Number of frames updated.
+	bool m_profiling = false; // True if the current frame is being profiled.
+
+	/**
+	 * @brief Builds the dependency graph for this frame from the declared access of every system.
+	 */
+	void BuildSchedule()
+	{
+		size_t systemCount = m_systems.size();
+
+		m_access.assign(systemCount, SystemAccess());
+		m_systemCounters.assign(systemCount, ProfileCounters());
+		m_dependents.resize(systemCount);
+		if (m_remainingDependenciesSize != systemCount)
+		{
+			m_remainingDependencies = std::make_unique<std::atomic<size_t>[]>(systemCount);
+			m_remainingDependenciesSize = systemCount;
+		}
+
+		for (size_t i = 0; i < systemCount; i++)
+		{
+			m_systems[i]->DeclareAccess(m_access[i]);
+			m_dependents[i].clear();
+			m_remainingDependencies[i] = 0;
+		}
+
+		m_rootSystems.clear();
+		for (size_t i = 0; i < systemCount; i++)
+		{
+			for (size_t j = 0; j < i; j++)
+			{
+				if (m_access[i].ConflictsWith(m_access[j]))
+				{
+					m_dependents[j].push_back(i);
+					m_remainingDependencies[i]++;
+				}
+			}
+
+			if (m_remainingDependencies[i] == 0)
+			{
+				m_rootSystems.push_back(i);
+			}
+		}
+	}
+
+	/**
+	 * @brief Submits a system whose dependencies have all finished to the job system.
+	 */
+	void SubmitSystem(size_t systemIndex)
+	{
+		Job job;
+		job.function = &SystemManager::RunSystem;
+		job.data = this;
+		job.begin = systemIndex;
+		job.end = systemIndex + 1;
+		job.counter = m_counter;
+
+		JobSystem::GetInstance().Submit(job, JobSystem::GetThreadIndex());
+	}
+
+	/**
+	 * @brief Updates a system while counting its work, and records its sample. The counters only include work done
+	 * on the calling thread, so the rows of parallel loops are counted when the loop splits them.
+	 */
+	void ProfileSystem(size_t systemIndex)
+	{
+		ProfileCounters& counters = m_systemCounters[systemIndex];
+		SystemSample sample;
+		sample.frame = m_frame;
+		sample.systemIndex = (uint32_t)systemIndex;
+		sample.threadIndex = (uint32_t)JobSystem::GetThreadIndex();
+		sample.startNanoseconds = m_profiler.Now();
+
+		{
+			ProfileCounters::Scope counterScope(counters);
+			m_systems[systemIndex]->Update(*m_scene, m_deltaTime);
+		}
+
+		sample.durationNanoseconds = m_profiler.Now() - sample.startNanoseconds;
+		sample.counters = counters;
+		m_profiler.Record(sample);
+	}
+
+	/**
+	 * @brief Job function that updates a single system and releases the systems that depend on it.
+	 */
+	static void RunSystem(void* data, size_t begin, size_t end)
+	{
+		SystemManager* manager = static_cast<SystemManager*>(data);
+
+		// structural systems run alone, so deferred changes can be applied around them
+		bool syncPoint = manager->m_access[begin].structuralChanges && manager->m_syncPointCallback;
+		if (syncPoint) { manager->m_syncPointCallback(); }
+
+		{
+			// every update writes at a new version and sees the changes made since its previous update
+			ChangeContext changeContext = { ChangeVersion::Next(), manager->m_lastRunVersions[begin] };
+			ChangeVersion::Scope changeScope(changeContext);
+
+			if (manager->m_profiling)
+			{
+				manager->ProfileSystem(begin);
+			}
+			else
+			{
+				manager->m_systems[begin]->Update(*manager->m_scene, manager->m_deltaTime);
+			}
+			manager->m_lastRunVersions[begin] = changeContext.writeVersion;
+		}
+
+		if (syncPoint) { manager->m_syncPointCallback(); }
+
+		// the frame's counter is only decremented after this returns, so the frame is still in progress
+		for (size_t dependent : manager->m_dependents[begin])
+		{
+			if (--manager->m_remainingDependencies[dependent] == 0)
+			{
+				manager->SubmitSystem(dependent);
+			}
+		}
+	}
+};
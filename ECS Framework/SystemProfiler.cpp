@@ -0,0 +1,114 @@
+#include "SystemProfiler.h"
+#include <cmath>
+#include <fstream>
+#include <set>
+
+namespace
+{
+	/**
+	 * @brief Gets a percentile of sorted durations with the nearest rank method, in milliseconds.
+	 */
+	double GetPercentile(const std::vector<int64_t>& sortedDurations, double percentile)
+	{
+		size_t rank = (size_t)std::ceil(percentile * sortedDurations.size());
+		return sortedDurations[std::max<size_t>(rank, 1) - 1] / 1.0e6;
+	}
+
+	/**
+	 * @brief Writes a string as a JSON string literal.
+	 */
+	void WriteJsonString(std::ofstream& file, const char* text)
+	{
+		file << '"';
+		for (const char* c = text; *c != '\0'; c++)
+		{
+			if (*c == '"' || *c == '\\') { file << '\\'; }
+			file << *c;
+		}
+		file << '"';
+	}
+}
+
+std::vector<SystemTimingSummary> SystemProfiler::GetSummaries() const
+{
+	std::vector<SystemSample> samples;
+	CopySamples(samples);
+
+	// the last summary is of the frame samples
+	size_t systemCount = m_systemNames.size();
+	std::vector<std::vector<int64_t>> durations(systemCount + 1);
+	std::vector<SystemTimingSummary> summaries(systemCount + 1);
+	for (const SystemSample& sample : samples)
+	{
+		size_t index = std::min<size_t>(sample.systemIndex, systemCount);
+		durations[index].push_back(sample.durationNanoseconds);
+
+		summaries[index].meanEntities += (double)sample.counters.entities;
+		summaries[index].meanArchetypes += sample.counters.archetypes;
+		summaries[index].meanAllocations += sample.counters.allocations;
+	}
+
+	for (size_t i = 0; i <= systemCount; i++)
+	{
+		SystemTimingSummary& summary = summaries[i];
+		summary.name = GetSystemName(i < systemCount ? (uint32_t)i : FRAME_SAMPLE);
+		summary.sampleCount = durations[i].size();
+		if (summary.sampleCount == 0) { continue; }
+
+		std::sort(durations[i].begin(), durations[i].end());
+		summary.p50Milliseconds = GetPercentile(durations[i], 0.50);
+		summary.p95Milliseconds = GetPercentile(durations[i], 0.95);
+		summary.p99Milliseconds = GetPercentile(durations[i], 0.99);
+		summary.meanEntities /= summary.sampleCount;
+		summary.meanArchetypes /= summary.sampleCount;
+		summary.meanAllocations /= summary.sampleCount;
+	}
+
+	return summaries;
+}
+
+bool SystemProfiler::ExportChromeTrace(const std::string& path) const
+{
+	std::vector<SystemSample> samples;
+	CopySamples(samples);
+
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.good()) { return false; }
+
+	// timestamps are in microseconds, kept to nanosecond precision
+	file.setf(std::ios::fixed);
+	file.precision(3);
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	// name the track of every thread that ran a system
+	std::set<uint32_t> threads;
+	for (const SystemSample& sample : samples)
+	{
+		threads.insert(sample.threadIndex);
+	}
+
+	bool first = true;
+	for (uint32_t thread : threads)
+	{
+		std::string name = thread == 0 ? "Main thread" : "Worker " + std::to_string(thread);
+		file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread << ",\"args\":{\"name\":";
+		WriteJsonString(file, name.c_str());
+		file << "}}";
+		first = false;
+	}
+
+	for (const SystemSample& sample : samples)
+	{
+		file << (first ? "" : ",\n") << "{\"name\":";
+		WriteJsonString(file, GetSystemName(sample.systemIndex));
+		file << ",\"cat\":\"" << (sample.systemIndex == FRAME_SAMPLE ? "frame" : "system") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << sample.threadIndex
+			<< ",\"ts\":" << sample.startNanoseconds / 1.0e3 << ",\"dur\":" << sample.durationNanoseconds / 1.0e3
+			<< ",\"args\":{\"frame\":" << sample.frame << ",\"entities\":" << sample.counters.entities << ",\"archetypes\":" << sample.counters.archetypes
+			<< ",\"allocations\":" << sample.counters.allocations << ",\"allocatedBytes\":" << sample.counters.allocatedBytes << "}}";
+		first = false;
+	}
+
+	file << "\n]}\n";
+	return file.good();
+}
@@ -0,0 +1,182 @@
+// Per-system timing and work counters recorded by the system manager.
+//
+// Every system update is recorded as one sample in a fixed size ring buffer. Systems finish on any job system
+// thread, so samples are written without locking: each writer claims a slot with an atomic increment and
+// publishes it with a sequence number, and readers skip slots that are being written. The samples can be
+// summarised as rolling percentiles or exported as a Chrome trace, which Perfetto and chrome://tracing open.
+
+#pragma once
+#ifndef SYSTEM_PROFILER_H_
+#define SYSTEM_PROFILER_H_
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ProfileCounters.h"
+
+/**
+ * @struct SystemSample
+ * @brief The timing and counters of one system update, or of one whole frame of updates.
+ */
+struct SystemSample
+{
+	uint64_t frame = 0; // Index of the SystemManager::Update call the sample belongs to.
+	int64_t startNanoseconds = 0; // Start time since the profiler was created.
+	int64_t durationNanoseconds = 0; // Wall time of the update.
+	ProfileCounters counters; // Work done by the update, summed over every system for a frame sample.
+	uint32_t systemIndex = 0; // Registration index of the system, FRAME_SAMPLE for a whole frame.
+	uint32_t threadIndex = 0; // Job system thread the update ran on.
+};
+
+/**
+ * @struct SystemTimingSummary
+ * @brief Rolling statistics of one system over the samples held by the profiler.
+ */
+struct SystemTimingSummary
+{
+	std::string name;
+	size_t sampleCount = 0;
+	double p50Milliseconds = 0.0;
+	double p95Milliseconds = 0.0;
+	double p99Milliseconds = 0.0;
+	double meanEntities = 0.0; // Mean rows iterated per update.
+	double meanArchetypes = 0.0; // Mean archetypes iterated per update.
+	double meanAllocations = 0.0; // Mean chunks allocated per update.
+};
+
+/**
+ * @class SystemProfiler
+ * @brief Lock free ring buffer of system update samples, with percentile summaries and a Chrome trace export.
+ * Samples may be recorded from any thread. Reading is safe at any time, but samples recorded while reading may be
+ * left out.
+ */
+class SystemProfiler
+{
+public:
+	static constexpr size_t CAPACITY = 4096; // Number of samples kept, older samples are overwritten.
+	static constexpr uint32_t FRAME_SAMPLE = UINT32_MAX; // System index of samples covering a whole frame.
+
+	SystemProfiler() : m_slots(std::make_unique<Slot[]>(CAPACITY)), m_origin(std::chrono::steady_clock::now()) {}
+
+	SystemProfiler(const SystemProfiler&) = delete;
+	SystemProfiler& operator=(const SystemProfiler&) = delete;
+
+	void SetEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+	bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief Adds the name of the next registered system. Must not be called while systems are updating.
+	 */
+	void AddSystem(const char* name) { m_systemNames.emplace_back(name); }
+
+	/**
+	 * @brief Gets the name of a system index, or "Frame" for frame samples.
+	 */
+	const char* GetSystemName(uint32_t systemIndex) const
+	{
+		return systemIndex < m_systemNames.size() ? m_systemNames[systemIndex].c_str() : "Frame";
+	}
+
+	/**
+	 * @brief Gets the time since the profiler was created, the clock every sample is measured with.
+	 */
+	int64_t Now() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_origin).count();
+	}
+
+	/**
+	 * @brief Adds a sample, overwriting the oldest one if the buffer is full. Safe to call from several threads.
+	 */
+	void Record(const SystemSample& sample)
+	{
+		uint64_t index = m_writeIndex.fetch_add(1, std::memory_order_relaxed);
+		Slot& slot = m_slots[index & (CAPACITY - 1)];
+
+		// an odd sequence marks the slot as being written
+		slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(&slot.sample, &sample, sizeof(SystemSample));
+		slot.sequence.store(index * 2 + 2, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Copies every complete sample held by the buffer, oldest first.
+	 * @param samples Replaced with the samples.
+	 */
+	void CopySamples(std::vector<SystemSample>& samples) const
+	{
+		samples.clear();
+
+		uint64_t end = m_writeIndex.load(std::memory_order_acquire);
+		uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+		samples.reserve((size_t)(end - begin));
+
+		for (uint64_t index = begin; index < end; index++)
+		{
+			const Slot& slot = m_slots[index & (CAPACITY - 1)];
+			uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+			if (sequence != index * 2 + 2) { continue; }
+
+			SystemSample sample;
+			std::memcpy(&sample, &slot.sample, sizeof(SystemSample));
+
+			// the slot was reused while it was copied if its sequence moved on
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) != sequence) { continue; }
+
+			samples.push_back(sample);
+		}
+	}
+
+	/**
+	 * @brief Forgets every sample. Must not be called while systems are updating.
+	 */
+	void Clear()
+	{
+		uint64_t end = m_writeIndex.load(std::memory_order_acquire);
+		for (size_t i = 0; i < CAPACITY; i++)
+		{
+			m_slots[i].sequence.store(0, std::memory_order_relaxed);
+		}
+		m_writeIndex.store(std::max<uint64_t>(end, CAPACITY), std::memory_order_release);
+	}
+
+	/**
+	 * @brief Summarises the samples of each system, followed by the frame samples.
+	 * @return One summary per registered system in registration order, then one for whole frames.
+	 */
+	std::vector<SystemTimingSummary> GetSummaries() const;
+
+	/**
+	 * @brief Writes the samples as a Chrome trace event file, with one track per job system thread and the work
+	 * counters of each update as its arguments.
+	 * @param path The path of the file to write, replaced if it exists.
+	 * @return True if the file was written.
+	 */
+	bool ExportChromeTrace(const std::string& path) const;
+
+private:
+	/**
+	 * @struct Slot
+	 * @brief A sample and the sequence number publishing it, 2 * (write index + 1) once complete.
+	 */
+	struct Slot
+	{
+		std::atomic<uint64_t> sequence = 0;
+		SystemSample sample;
+	};
+
+	std::unique_ptr<Slot[]> m_slots; // Ring buffer of CAPACITY samples.
+	std::atomic<uint64_t> m_writeIndex = 0; // Total number of samples recorded.
+	std::atomic<bool> m_enabled = true;
+	std::chrono::steady_clock::time_point m_origin; // Time every sample is measured from.
+	std::vector<std::string> m_systemNames; // Name of each registered system.
+};
+
+#endif // SYSTEM_PROFILER_H_
@@ -73,8 +73,17 @@ bool Terrain::Init(ID3D11Device* device, ID3D11DeviceContext* context, const std
 	return true;
 }
 
-void Terrain::BuildCollision(ECSScene* scene, AABBTree* tree)
+void Terrain::BuildCollision(ECSScene* scene, BroadPhase* broadPhase)
 {
+	size_t triangleCount = m_indices.size() / 3;
+
+	std::vector<Transform> transforms;
+	std::vector<Collider> colliders;
+	std::vector<AABB> bounds;
+	transforms.reserve(triangleCount);
+	colliders.reserve(triangleCount);
+	bounds.reserve(triangleCount);
+
 	for (int i = 0; i < m_indices.size(); i += 3)
 	{
 		SimpleVertex v1 = m_vertices[m_indices[i]];
@@ -90,26 +99,23 @@ void Terrain::BuildCollision(ECSScene* scene, AABBTree* tree)
 		Vector3 e2 = p3 - p1;
 		Vector3 normal = Vector3::Cross(e1, e2).normalized();
 
-		Entity entity = scene->CreateEntity();
-		scene->AddComponent(
-			entity,
-			Transform(center, Quaternion(), Vector3::One)
-		);
-		/*scene->AddComponent(
-			entity,
-			Particle(-1.0f)
-		);*/
-		/*scene->AddComponent(
-			entity,
-			RigidBody(Vector3::Zero)
-		);*/
-		scene->AddComponent(
-			entity,
-			Collider{ HalfSpaceTriangle(p1, p2, p3, normal) }
-		);
-
-		tree->InsertEntity(entity, AABB::FromTriangle(p1, p2, p3), true);
+		transforms.push_back(Transform(center, Quaternion(), Vector3::One));
+		colliders.push_back(Collider{ HalfSpaceTriangle(p1, p2, p3, normal) });
+		bounds.push_back(AABB::FromTriangle(p1, p2, p3));
+	}
+
+	// every triangle has the same component set, so they are spawned as one batch
+	std::vector<StaticCollider> tags(triangleCount);
+	std::vector<Entity> entities = scene->CreateEntities(triangleCount, transforms, colliders, tags);
+	if (entities.empty()) { return; }
+
+	// the triangles are built in bulk into the static tree, rather than inserted one at a time
+	std::vector<TreeProxy> proxies(triangleCount);
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		proxies[i] = { entities[i], bounds[i], true };
 	}
+	broadPhase->Build(proxies);
 }
 
 void Terrain::Draw(ID3D11DeviceContext* context)
@@ -4,7 +4,7 @@
 #include <vector>
 #include "Structures.h"
 #include "ECSScene.h"
-#include "AABBTree.h"
+#include "BroadPhase.h"
 
 class Terrain
 {
@@ -13,7 +13,7 @@ public:
 	~Terrain();
 
 	bool Init(ID3D11Device* device, ID3D11DeviceContext* context, const std::string& heightMapFile, int fileWidth, int fileHeight, int terrainWidth, int terrainDepth, int heightScale);
-	void BuildCollision(ECSScene* scene, AABBTree* tree);
+	void BuildCollision(ECSScene* scene, BroadPhase* broadPhase);
 	void Draw(ID3D11DeviceContext* context);
 
 private: